@@ -5,6 +5,7 @@ import java.io.FileDescriptor;
 import java.io.FileInputStream;
 import java.io.IOException;
 import java.lang.ref.WeakReference;
+import java.nio.ByteBuffer;
 import java.util.Map;
 
 import android.annotation.SuppressLint;
@@ -12,6 +13,7 @@ import android.content.ContentResolver;
 import android.content.Context;
 import android.content.res.AssetFileDescriptor;
 import android.graphics.Bitmap;
+import android.media.AudioManager;
 import android.net.Uri;
 import android.os.Bundle;
 import android.os.Handler;
@@ -55,6 +57,7 @@ public class DtPlayer {
 
     private OnInfoListener mOnInfoListener;
     private OnTimedTextListener mOnTimedTextListener;
+    private OnSnapshotListener mOnSnapshotListener;
 
     private static EventHandler mEventHandler;
 
@@ -71,6 +74,69 @@ public class DtPlayer {
     private static final int MEDIA_HW_ERROR = 400;
     private static final int MEDIA_TIMED_TEXT = 1000;
     private static final int MEDIA_CACHING_UPDATE = 2000;
+    private static final int MEDIA_SNAPSHOT = 3000;
+
+    // aspect modes, applied by the renderer, the decoder keeps its size
+    public static final int VIDEO_MODE_NORMAL = 0;     // fit, keep aspect ratio
+    public static final int VIDEO_MODE_FULL = 1;       // stretch to the view
+    public static final int VIDEO_MODE_4_3 = 2;
+    public static final int VIDEO_MODE_16_9 = 3;
+    public static final int VIDEO_MODE_ZOOM = 4;       // fill the view, crop
+
+    public static final int UPSCALE_FILTER_BILINEAR = 0;
+    public static final int UPSCALE_FILTER_BICUBIC = 1;
+
+    // native_setInfo commands
+    private static final int INFO_UPSCALE_FILTER = 0x100;
+    private static final int INFO_TEXTURE_SETS = 0x101;
+    private static final int INFO_UPLOAD_DOWNSCALE = 0x102;
+    private static final int INFO_VIDEO_OUTPUT = 0x103;
+    private static final int INFO_AUDIO_PROFILE = 0x104;
+    private static final int INFO_AUDIO_BURST = 0x105;
+    private static final int INFO_AUDIO_DEVICE_RATE = 0x106;
+    private static final int INFO_AUDIO_RESAMPLE = 0x107;
+    private static final int INFO_STAT_HIST = 0x200;
+    private static final int INFO_STAT_JANK = 0x210;
+    private static final int INFO_STAT_GPU_TIMER = 0x211;
+    private static final int INFO_STAT_BUCKETS = 0x212;
+    private static final int INFO_STAT_BOUND = 0x213;
+    private static final int INFO_STAT_RESET = 0x214;
+    private static final int INFO_STAT_AUDIO = 0x220;
+
+    // setVideoOutput, the window outputs convert on the CPU without GL
+    public static final int VIDEO_OUTPUT_GL = 0;
+    public static final int VIDEO_OUTPUT_WINDOW_RGBA = 1;
+    public static final int VIDEO_OUTPUT_WINDOW_RGB565 = 2;
+
+    // setAudioProfile, how much audio the device queue holds
+    public static final int AUDIO_PROFILE_DEFAULT = 0;         // 4 x 10 ms
+    public static final int AUDIO_PROFILE_LOW_LATENCY = 1;     // 2 x device burst
+    public static final int AUDIO_PROFILE_POWER_SAVING = 2;    // 4 x 100 ms
+    public static final int AUDIO_PROFILE_ADAPTIVE = 3;        // device bursts, 2 to 8 deep
+
+    // setAudioResample, streams are converted to the device's native rate
+    public static final int AUDIO_RESAMPLE_OFF = -1;   // only rates OpenSL refuses
+    public static final int AUDIO_RESAMPLE_FAST = 0;
+    public static final int AUDIO_RESAMPLE_MEDIUM = 1; // default
+    public static final int AUDIO_RESAMPLE_HIGH = 2;
+    public static final int AUDIO_RESAMPLE_BEST = 3;
+
+    // getAudioStat, counted from the start of the stream
+    public static final int AUDIO_STAT_UNDERRUNS = 0;  // the device queue ran dry
+    public static final int AUDIO_STAT_SILENT = 1;     // periods padded, decoding was late
+    public static final int AUDIO_STAT_DEPTH = 2;      // periods queued now
+    public static final int AUDIO_STAT_PERIOD = 3;     // us
+
+    // render loop histograms, all in us
+    public static final int STAT_UPLOAD_CPU = 0;
+    public static final int STAT_DRAW_CPU = 1;
+    public static final int STAT_UPLOAD_GPU = 2;   // only with hasGpuTimer()
+    public static final int STAT_DRAW_GPU = 3;
+    public static final int STAT_INTERVAL = 4;     // between draws of a running render loop
+    // getRenderStat what, >= 0 is a bucket index
+    public static final int STAT_COUNT = -1;
+    public static final int STAT_MEAN = -2;
+    public static final int STAT_MAX = -3;
 
     static {
         System.loadLibrary("dtp");
@@ -89,6 +155,8 @@ public class DtPlayer {
           */
         native_setup(new WeakReference<DtPlayer>(this));
         native_hw_enable(0);
+        native_setInfo(INFO_AUDIO_DEVICE_RATE, getAudioProperty(AudioManager.PROPERTY_OUTPUT_SAMPLE_RATE));
+        setCacheDirectory(ctx.getCacheDir().getAbsolutePath());
     }
 
     public DtPlayer(Context ctx, boolean isHardWare) {
@@ -276,6 +344,21 @@ public class DtPlayer {
 
     }
 
+    // GL thread, rgba null when the snapshot failed
+    private static void postSnapshotFromNative(Object dtp, byte[] rgba, int width, int height,
+                                               long pts) {
+        DtPlayer mp = (DtPlayer) ((WeakReference) dtp).get();
+        if (mp == null || mEventHandler == null) {
+            return;
+        }
+        Bitmap bitmap = null;
+        if (rgba != null) {
+            // ARGB_8888 is stored as r, g, b, a bytes, the readback's order
+            bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
+            bitmap.copyPixelsFromBuffer(ByteBuffer.wrap(rgba));
+        }
+        mEventHandler.sendMessage(mEventHandler.obtainMessage(MEDIA_SNAPSHOT, (int) pts, 0, bitmap));
+    }
 
     public void start() throws IllegalStateException {
         stayAwake(true);
@@ -389,6 +472,12 @@ public class DtPlayer {
                     if (mOnHWRenderFailedListener != null)
                         mOnHWRenderFailedListener.onFailed();
                     return;
+                case MEDIA_SNAPSHOT:
+                    if (mOnSnapshotListener != null)
+                        mOnSnapshotListener.onSnapshot(mMediaPlayer, (Bitmap) msg.obj, msg.arg1);
+                    else if (msg.obj != null)
+                        ((Bitmap) msg.obj).recycle();
+                    break;
                 default:
                     Log.e("", "Unknown message type " + msg.what);
                     return;
@@ -424,6 +513,7 @@ public class DtPlayer {
         mOnVideoSizeChangedListener = null;
         mOnCachingUpdateListener = null;
         mOnHWRenderFailedListener = null;
+        mOnSnapshotListener = null;
         native_stop();
         native_release();
         closeFD();
@@ -545,6 +635,16 @@ public class DtPlayer {
         public void onTimedTextUpdate(byte[] pixels, int width, int height);
     }
 
+    public interface OnSnapshotListener {
+        /**
+         * Called with the result of snapshot()
+         *
+         * @param bitmap the frame that was on screen, null when it could not be grabbed
+         * @param pts    of the frame, ms; -1 unknown
+         */
+        public void onSnapshot(DtPlayer mp, Bitmap bitmap, long pts);
+    }
+
 
     /**
      * Register a callback to be invoked when the media source is ready for
@@ -634,6 +734,10 @@ public class DtPlayer {
         mOnTimedTextListener = listener;
     }
 
+    public void setOnSnapshotListener(OnSnapshotListener listener) {
+        mOnSnapshotListener = listener;
+    }
+
     public int getCurrentPosition() {
         return native_getCurrentPosition();
     }
@@ -654,6 +758,111 @@ public class DtPlayer {
         return native_setVideoSize(w, h);
     }
 
+    public int setVideoMode(int mode) {
+        return native_setVideoMode(mode);
+    }
+
+    public int setUpscaleFilter(int filter) {
+        return native_setInfo(INFO_UPSCALE_FILTER, filter);
+    }
+
+    // 1..3 texture sets the renderer uploads into in turn, more sets let
+    // uploads overlap the GPU drawing the previous frame
+    public int setTextureSets(int sets) {
+        return native_setInfo(INFO_TEXTURE_SETS, sets);
+    }
+
+    // video 2 or 4 times larger than the view is shrunk before upload, on
+    // by default
+    public int setUploadDownscale(boolean enable) {
+        return native_setInfo(INFO_UPLOAD_DOWNSCALE, enable ? 1 : 0);
+    }
+
+    // before setDataSource or after stop; takes over the current surface.
+    // Players of one process should use the same output, the native player
+    // library registers a single video output for all of them
+    public int setVideoOutput(int output) {
+        return native_setInfo(INFO_VIDEO_OUTPUT, output);
+    }
+
+    // from the next start. Players of one process share the setting, like
+    // the video output
+    public int setAudioProfile(int profile) {
+        native_setInfo(INFO_AUDIO_BURST, getAudioBurstUs());
+        return native_setInfo(INFO_AUDIO_PROFILE, profile);
+    }
+
+    // from the next start, process wide like setAudioProfile
+    public int setAudioResample(int quality) {
+        return native_setInfo(INFO_AUDIO_RESAMPLE, quality);
+    }
+
+    public int getAudioStat(int stat) {
+        return native_getInfo(INFO_STAT_AUDIO + stat, 0);
+    }
+
+    // the mixer's native burst, 0 if the device does not say
+    private int getAudioBurstUs() {
+        int frames = getAudioProperty(AudioManager.PROPERTY_OUTPUT_FRAMES_PER_BUFFER);
+        int rate = getAudioProperty(AudioManager.PROPERTY_OUTPUT_SAMPLE_RATE);
+        return (rate > 0) ? (int) (frames * 1000000L / rate) : 0;
+    }
+
+    private int getAudioProperty(String key) {
+        AudioManager am = (AudioManager) mContext.getSystemService(Context.AUDIO_SERVICE);
+        if (am == null) {
+            return 0;
+        }
+        try {
+            return Integer.parseInt(am.getProperty(key));
+        } catch (NumberFormatException e) {
+            return 0;
+        }
+    }
+
+    public int getRenderStat(int stat, int what) {
+        return native_getInfo(INFO_STAT_HIST + stat, what);
+    }
+
+    // bucket i counts samples below getRenderStatBound(i), the last the rest
+    public int[] getRenderHistogram(int stat) {
+        int[] buckets = new int[native_getInfo(INFO_STAT_BUCKETS, 0)];
+        for (int i = 0; i < buckets.length; i++) {
+            buckets[i] = native_getInfo(INFO_STAT_HIST + stat, i);
+        }
+        return buckets;
+    }
+
+    public int getRenderStatBound(int bucket) {
+        return native_getInfo(INFO_STAT_BOUND, bucket);
+    }
+
+    // draws more than 1.5 refresh periods after the previous one
+    public int getJankCount() {
+        return native_getInfo(INFO_STAT_JANK, 0);
+    }
+
+    /**
+     * Grab the frame on screen at the given size, drawn again by the GL
+     * renderer and read back without stalling playback. 0 keeps the frame's
+     * aspect ratio, both 0 its own size. The result goes to the
+     * OnSnapshotListener.
+     *
+     * @return -1 when a snapshot is still pending or the video does not go
+     * through the GL renderer
+     */
+    public int snapshot(int width, int height) {
+        return native_snapshot(width, height);
+    }
+
+    public boolean hasGpuTimer() {
+        return native_getInfo(INFO_STAT_GPU_TIMER, 0) == 1;
+    }
+
+    public int resetRenderStats() {
+        return native_setInfo(INFO_STAT_RESET, 0);
+    }
+
     public int getVideoWidth() {
         return native_getVideoWidth();
     }
@@ -674,9 +883,58 @@ public class DtPlayer {
         return 0;
     }
 
+    /**
+     * @return 1 when the native renderer has been idle for a while and
+     * does not need further vsync callbacks until MEDIA_FRESH_VIDEO
+     */
     public int onDrawFrame() {
-        native_draw_frame();
-        return 0;
+        return native_draw_frame();
+    }
+
+    //----------------------------------
+    //mosaic: one GLSurfaceView drawing the pictures of several players in a grid.
+    //Source players are not drawn by views of their own, their OnFreshVideo
+    //has to request a render of the mosaic view instead.
+
+    /**
+     * GL thread, from onSurfaceCreated; the handle dies with the GL context
+     *
+     * @return 0 when the grid does not fit a texture
+     */
+    public static long mosaicCreate(int cols, int rows, int cellWidth, int cellHeight) {
+        return native_mosaic_create(cols, rows, cellWidth, cellHeight);
+    }
+
+    /**
+     * GL thread; the sources are detached, not released
+     */
+    public static void mosaicDestroy(long mosaic) {
+        if (mosaic != 0)
+            native_mosaic_destroy(mosaic);
+    }
+
+    /**
+     * any thread; player null empties the tile. Detach a player before
+     * releasing it. The tile is taken over on the next draw, so request one.
+     */
+    public static int mosaicSetSource(long mosaic, int tile, DtPlayer player) {
+        if (mosaic == 0)
+            return -1;
+        return native_mosaic_set_source(mosaic, tile, player);
+    }
+
+    public static void mosaicSurfaceChanged(long mosaic, int w, int h) {
+        if (mosaic != 0)
+            native_mosaic_surface_change(mosaic, w, h);
+    }
+
+    /**
+     * @return 1 when every source went idle, see onDrawFrame
+     */
+    public static int mosaicDrawFrame(long mosaic) {
+        if (mosaic == 0)
+            return 1;
+        return native_mosaic_draw(mosaic);
     }
 
     /**
@@ -743,6 +1001,8 @@ public class DtPlayer {
 
     public native int native_setInfo(int cmd, long arg);
 
+    public native int native_snapshot(int width, int height);
+
     //opengl esv2
     public native int native_surface_create();
 
@@ -750,6 +1010,16 @@ public class DtPlayer {
 
     public native int native_draw_frame();
 
+    public static native long native_mosaic_create(int cols, int rows, int cellWidth, int cellHeight);
+
+    public static native void native_mosaic_destroy(long mosaic);
+
+    public static native int native_mosaic_set_source(long mosaic, int tile, DtPlayer player);
+
+    public static native void native_mosaic_surface_change(long mosaic, int w, int h);
+
+    public static native int native_mosaic_draw(long mosaic);
+
     public native int native_setAudioEffect(int t);
 
     /**
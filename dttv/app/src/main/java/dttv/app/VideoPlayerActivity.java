@@ -284,6 +284,7 @@ public class VideoPlayerActivity extends Activity implements OnClickListener, On
             if (mDisplayMode == VIDEOPLAYER_DISPLAY_FULLSCREEN) {
                 width = mScreenWidth;
                 height = mScreenHeight;
+                dtPlayer.setVideoMode(DtPlayer.VIDEO_MODE_FULL);
             }
 
             Log.d(TAG, "--width:" + width + "  height:" + height);
@@ -610,11 +611,13 @@ public class VideoPlayerActivity extends Activity implements OnClickListener, On
                 mButtonRatio.setBackgroundResource(R.drawable.videoplayer_button_ratio_fullscreen);
                 layoutParams.width = mScreenWidth;
                 layoutParams.height = mSurfaceHeight;
+                dtPlayer.setVideoMode(DtPlayer.VIDEO_MODE_FULL);
             } else {
                 mDisplayMode = VIDEOPLAYER_DISPLAY_ORIGINAL;
                 mButtonRatio.setBackgroundResource(R.drawable.videoplayer_button_ratio_normal);
                 layoutParams.width = dtPlayer.getVideoWidth();
                 layoutParams.height = dtPlayer.getVideoHeight();
+                dtPlayer.setVideoMode(DtPlayer.VIDEO_MODE_NORMAL);
             }
 
             mGLSurfaceView.setLayoutParams(layoutParams);
@@ -676,6 +679,7 @@ public class VideoPlayerActivity extends Activity implements OnClickListener, On
     class MyGLSurfaceViewRender implements GLSurfaceView.Renderer {
 
         private Lock lock = new ReentrantLock();
+        private int mRenderMode = GLSurfaceView.RENDERMODE_WHEN_DIRTY;
 
         @Override
         public void onSurfaceCreated(GL10 gl,
@@ -708,8 +712,16 @@ public class VideoPlayerActivity extends Activity implements OnClickListener, On
             //gl.glClear(GL10.GL_COLOR_BUFFER_BIT);
             //Log.i(TAG, "draw enter");
             lock.lock();
-            dtPlayer.onDrawFrame();
+            int idle = dtPlayer.onDrawFrame();
             lock.unlock();
+            // draw every vsync while frames flow, native picks the frame per
+            // refresh; park once it reports idle, MEDIA_FRESH_VIDEO wakes us
+            int mode = (idle == 1) ? GLSurfaceView.RENDERMODE_WHEN_DIRTY
+                    : GLSurfaceView.RENDERMODE_CONTINUOUSLY;
+            if (mode != mRenderMode) {
+                mRenderMode = mode;
+                mGLSurfaceView.setRenderMode(mode);
+            }
         }
     }
 
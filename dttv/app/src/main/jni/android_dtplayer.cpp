@@ -5,6 +5,13 @@
 #include "android_jni.h"
 #include "../../../../3rd/libdtp/include/vo_wrapper.h"
 #include "gl_yuv.h"
+#include "gl_render_thread.h"
+#include "plugin_vo_android.h"
+#include "plugin_vo_window.h"
+#include "yuv2rgb.h"
+#include "native_atomic.h"
+
+#include <android/native_window.h>
 
 extern "C" {
 
@@ -19,14 +26,21 @@ extern "C" {
 
 extern "C" int dtap_change_effect(ao_wrapper_t *wrapper, int id);
 #ifdef ENABLE_OPENSL
-extern "C" void ao_opensl_setup(ao_wrapper_t *ao);
+extern "C" {
+#include "plugin/ao_opensl.h"
+}
+
+// frames are picked against the audio device, it counts from the first
+// sample, the scheduler places the origin from frame arrivals
+static int64_t audio_master(void *opaque) {
+    int64_t pts, systime;
+    return (ao_opensl_clock(&pts, &systime) == 0) ? pts : -1;
+}
 #endif
 #ifdef ENABLE_ANDROID_OMX
 extern "C" void vd_stagefright_setup(vd_wrapper_t *vd);
 #endif
 
-void vo_android_setup(vo_wrapper_t **vo);
-
 namespace android {
 
     DTPlayer::DTPlayer()
@@ -38,9 +52,19 @@ namespace android {
               mSeekPosition(-1),
               mDuration(-1),
               mDisplayHeight(0),
-              mDisplayWidth(0) {
+              mDisplayWidth(0),
+              mNativeWindow(NULL),
+              mRenderThread(NULL),
+              mVideoOutput(VIDEO_OUTPUT_GL),
+              mWindowOutput(NULL),
+              mStarting(0) {
         memset(&media_info, 0, sizeof(dt_media_info_t));
         dt_lock_init(&dtp_mutex, NULL);
+        mRenderer = yuv_renderer_create();
+        yuv_reg_player(mRenderer, this);
+#ifdef ENABLE_OPENSL
+        yuv_set_master_clock(mRenderer, audio_master, NULL);
+#endif
         LOGV("dtplayer constructor ok \n");
     }
 
@@ -52,10 +76,20 @@ namespace android {
               mSeekPosition(-1),
               mDuration(-1),
               mDisplayHeight(0),
-              mDisplayWidth(0) {
+              mDisplayWidth(0),
+              mNativeWindow(NULL),
+              mRenderThread(NULL),
+              mVideoOutput(VIDEO_OUTPUT_GL),
+              mWindowOutput(NULL),
+              mStarting(0) {
         memset(&media_info, 0, sizeof(dt_media_info_t));
         dt_lock_init(&dtp_mutex, NULL);
         mListenner = listenner;
+        mRenderer = yuv_renderer_create();
+        yuv_reg_player(mRenderer, this);
+#ifdef ENABLE_OPENSL
+        yuv_set_master_clock(mRenderer, audio_master, NULL);
+#endif
         LOGV("dtplayer constructor ok \n");
     }
 
@@ -63,10 +97,14 @@ namespace android {
         status = 0;
         mCurrentPosition = mSeekPosition = -1;
         mDtpHandle = NULL;
+        releaseVideoSurface();
+        unbindVideo();
+        window_output_destroy(mWindowOutput);
+        // fails a pending snapshot, its callback may still use the listener
+        yuv_renderer_destroy(mRenderer);
         if (mListenner) {
             delete mListenner;
         }
-        yuv_dttv_init();
         LOGV("dtplayer destructor called \n");
     }
 
@@ -75,6 +113,58 @@ namespace android {
         return 0;
     }
 
+    yuv_renderer_t *DTPlayer::getRenderer() {
+        return mRenderer;
+    }
+
+    dtpListenner *DTPlayer::getListenner() {
+        return mListenner;
+    }
+
+    int DTPlayer::setVideoSurface(void *window) {
+        // acquired first, window may be the one being released
+        ANativeWindow_acquire((ANativeWindow *) window);
+        releaseVideoSurface();
+        mNativeWindow = window;
+
+        if (mVideoOutput != VIDEO_OUTPUT_GL) {
+            if (!windowOutput()) {
+                LOGV("window output failed, no video on this surface \n");
+                return -1;
+            }
+            window_output_set_window(mWindowOutput, (ANativeWindow *) window);
+            LOGV("video goes through the window output \n");
+            return 0;
+        }
+
+        render_thread_para_t para;
+        memset(&para, 0, sizeof(render_thread_para_t));
+        para.renderer = mRenderer;
+        para.window = (EGLNativeWindowType) window;
+        mRenderThread = render_thread_create(&para);
+        if (!mRenderThread) {
+            LOGV("native render thread failed, no video on this surface \n");
+            return -1;
+        }
+        LOGV("video goes through the native render thread \n");
+        return 0;
+    }
+
+    int DTPlayer::releaseVideoSurface() {
+        if (mRenderThread) {
+            render_thread_destroy(mRenderThread);
+            mRenderThread = NULL;
+        }
+        if (mWindowOutput) {
+            window_output_set_window(mWindowOutput, NULL);
+        }
+        if (mNativeWindow) {
+            ANativeWindow_release((ANativeWindow *) mNativeWindow);
+            mNativeWindow = NULL;
+        }
+        return 0;
+    }
+
     int DTPlayer::setListenner(dtpListenner *listenner) {
         LOGV("[%d:%p] [%d:%p]", sizeof(mListenner), this->mListenner, sizeof(listenner), listenner);
         this->mListenner = listenner;
@@ -151,7 +241,11 @@ namespace android {
         dtplayer_register_ext_vd(&vd);
 #endif
 
-        vo_android_setup(&vo);
+        if (mVideoOutput == VIDEO_OUTPUT_GL) {
+            vo_android_setup(&vo);
+        } else {
+            vo_window_setup(&vo);
+        }
         dtplayer_register_ext_vo(vo);
 
         status = PLAYER_INITED;
@@ -199,17 +293,16 @@ namespace android {
             return pause();
         }
 
-        if (status != PLAYER_PREPARED) {
+        if (status != PLAYER_PREPARED || mStarting) {
             LOGV("player is running \n");
             goto END;
         }
 
-        ret = dtplayer_start(handle);
+        ret = startVideo();
         if (ret < 0) {
             ret = -1;
             goto END;
         }
-        status = PLAYER_RUNNING;
 
         END:
         return ret;
@@ -279,6 +372,13 @@ namespace android {
             ret = -1;
             goto END;
         }
+        // drops a start still queued behind another player's vo, or waits
+        // out one running; a stream without video never claimed the binding,
+        // do not leave it for the next player's vo
+        unbindVideo();
+        dt_lock(&dtp_mutex);
+        mStarting = 0;
+        dt_unlock(&dtp_mutex);
         if (status <= PLAYER_PREPARED) {
             ret = -1;
             goto END;
@@ -301,41 +401,19 @@ namespace android {
     }
 
     int DTPlayer::setVideoMode(int mode) {
-        vstream_info_t *vstream = NULL;
-        void *handle = mDtpHandle;
-        if (!handle) {
-            return -1;
-        }
-
-        vstream = media_info.vstreams[0];
-
-        int orig_width = vstream->width;
-        int orig_height = vstream->height;
-
-        int dw, dh;
-        //reset w h
         switch (mode) {
             case DT_SCREEN_MODE_NORMAL:
-                dw = orig_width;
-                dh = orig_height;
-                break;
             case DT_SCREEN_MODE_FULL:
-                dw = orig_width;
-                dh = orig_height;
-                break;
             case DT_SCREEN_MODE_16_9:
-                dw = orig_width;
-                dh = orig_height;
-                break;
             case DT_SCREEN_MODE_4_3:
-                dw = orig_width;
-                dh = orig_height;
+            case DT_SCREEN_MODE_ZOOM:
                 break;
             default:
-                return 0;
+                return -1;
         }
-
-        dtplayer_set_video_size(handle, dw, dh);
+        // scaling is the renderer's job, the decoder keeps its native size
+        yuv_set_video_mode(mRenderer, mode);
+        LOGV("video mode %d \n", mode);
         return 0;
     }
 
@@ -444,6 +522,150 @@ namespace android {
         return 0;
     }
 
+    int DTPlayer::setInfo(int cmd, int64_t arg) {
+        switch (cmd) {
+            case INFO_UPSCALE_FILTER:
+                yuv_set_upscale_filter(mRenderer, (int) arg);
+                return 0;
+            case INFO_TEXTURE_SETS:
+                return yuv_set_texture_sets(mRenderer, (int) arg);
+            case INFO_UPLOAD_DOWNSCALE:
+                yuv_set_downscale(mRenderer, (int) arg);
+                return 0;
+            case INFO_VIDEO_OUTPUT:
+                return setVideoOutput((int) arg);
+            case INFO_STAT_RESET:
+                stats_reset(yuv_get_stats(mRenderer));
+                return 0;
+#ifdef ENABLE_OPENSL
+            case INFO_AUDIO_PROFILE:
+                return ao_opensl_set_profile((int) arg);
+            case INFO_AUDIO_BURST:
+                ao_opensl_set_burst((int) arg);
+                return 0;
+            case INFO_AUDIO_DEVICE_RATE:
+                ao_opensl_set_device_rate((int) arg);
+                return 0;
+            case INFO_AUDIO_RESAMPLE:
+                return ao_opensl_set_resample((int) arg);
+#endif
+            default:
+                LOGV("setInfo cmd %d not supported \n", cmd);
+                return -1;
+        }
+    }
+
+    int DTPlayer::setVideoOutput(int output) {
+        if (output < VIDEO_OUTPUT_GL || output > VIDEO_OUTPUT_WINDOW_RGB565) {
+            return -1;
+        }
+        // the vo is registered in setDataSource and bound in start
+        if (status != PLAYER_IDLE && status != PLAYER_STOPPED) {
+            LOGV("video output can not change in status:%d \n", status);
+            return -1;
+        }
+        if (output == mVideoOutput) {
+            return 0;
+        }
+        mVideoOutput = output;
+        // format is fixed per output, nothing is bound to it while stopped
+        window_output_destroy(mWindowOutput);
+        mWindowOutput = NULL;
+        if (mNativeWindow) {
+            // move the current surface over to the new output
+            setVideoSurface(mNativeWindow);
+        }
+        LOGV("video output %d \n", output);
+        return 0;
+    }
+
+    window_output_t *DTPlayer::windowOutput() {
+        if (!mWindowOutput) {
+            int format = (mVideoOutput == VIDEO_OUTPUT_WINDOW_RGB565) ? YUV2RGB_RGB565
+                                                                      : YUV2RGB_RGBA8888;
+            mWindowOutput = window_output_create(format, 0);
+        }
+        return mWindowOutput;
+    }
+
+    int DTPlayer::startVideo() {
+        mStartReq.start = startPlayer;
+        mStartReq.opaque = this;
+        if (!media_info.has_video) {
+            // no vo will come up to take a binding and let the next player start
+            return startPlayer(this, 0);
+        }
+        dt_lock(&dtp_mutex);
+        mStarting = 1;
+        dt_unlock(&dtp_mutex);
+        // frames of this player go to its own renderer or window output;
+        // never waits for another player's vo, the start is queued instead
+        if (mVideoOutput == VIDEO_OUTPUT_GL) {
+            return vo_android_start(mRenderer, &mStartReq);
+        } else if (windowOutput()) {
+            return vo_window_start(mWindowOutput, &mStartReq);
+        }
+        return startPlayer(this, 0);
+    }
+
+    int DTPlayer::startPlayer(void *opaque, int queued) {
+        DTPlayer *dtp = (DTPlayer *) opaque;
+        int ret = dtplayer_start(dtp->mDtpHandle);
+        dt_lock(&dtp->dtp_mutex);
+        dtp->mStarting = 0;
+        if (ret >= 0) {
+            dtp->status = PLAYER_RUNNING;
+        }
+        dt_unlock(&dtp->dtp_mutex);
+        if (ret < 0 && queued) {
+            // native_start returned long ago
+            LOGV("queued start failed \n");
+            dtp->Notify(MEDIA_ERROR);
+        }
+        return ret;
+    }
+
+    void DTPlayer::unbindVideo() {
+        vo_android_unbind(mRenderer);
+        if (mWindowOutput) {
+            vo_window_unbind(mWindowOutput);
+        }
+    }
+
+    int DTPlayer::getInfo(int cmd, int64_t arg) {
+        render_stats_t *stats = yuv_get_stats(mRenderer);
+        if (cmd >= INFO_STAT_HIST && cmd < INFO_STAT_HIST + STATS_HIST_NB) {
+            return stats_query(stats, cmd - INFO_STAT_HIST, (int) arg);
+        }
+#ifdef ENABLE_OPENSL
+        if (cmd >= INFO_STAT_AUDIO && cmd <= INFO_STAT_AUDIO + AO_OPENSL_STAT_PERIOD) {
+            return ao_opensl_get_stat(cmd - INFO_STAT_AUDIO);
+        }
+#endif
+        switch (cmd) {
+            case INFO_STAT_JANK:
+                return dt_atomic_load(&stats->jank);
+            case INFO_STAT_GPU_TIMER:
+                return dt_atomic_load(&stats->gpuTimer);
+            case INFO_STAT_BUCKETS:
+                return STATS_BUCKETS;
+            case INFO_STAT_BOUND:
+                return (arg >= 0 && arg < STATS_BUCKETS - 1) ? g_statsBounds[arg] : -1;
+            default:
+                LOGV("getInfo cmd %d not supported \n", cmd);
+                return -1;
+        }
+    }
+
+    int DTPlayer::snapshot(int width, int height, snapshot_cb_t cb, void *opaque) {
+        if (mVideoOutput != VIDEO_OUTPUT_GL) {
+            // the window output has no GL renderer to draw it again
+            return -1;
+        }
+        // drawn and read back on the GL thread, cb gets the pixels there
+        return yuv_request_snapshot(mRenderer, width, height, cb, opaque);
+    }
+
     int DTPlayer::setHWEnable(int enable) {
         mHWEnable = (enable == 0) ? 0 : 1;
         return 0;
@@ -2,6 +2,9 @@
 #define ANDROID_DTPLAYER_H
 
 #include "android_jni.h"
+#include "gl_render_thread.h"
+#include "window_output.h"
+#include "vo_bind.h"
 
 extern "C" {
 #include "dtplayer_api.h"
@@ -24,6 +27,29 @@ namespace android {
     const static int MEDIA_TIMED_TEXT = 1000;
     const static int MEDIA_CACHING_UPDATE = 2000;
 
+    // native_setInfo commands, keep in sync with DtPlayer.java
+    const static int INFO_UPSCALE_FILTER = 0x100;
+    const static int INFO_TEXTURE_SETS = 0x101;
+    const static int INFO_UPLOAD_DOWNSCALE = 0x102;
+    const static int INFO_VIDEO_OUTPUT = 0x103;     // VIDEO_OUTPUT_*, idle or stopped players only
+    // where frames are drawn; the window outputs convert on the CPU, no GL
+    const static int VIDEO_OUTPUT_GL = 0;
+    const static int VIDEO_OUTPUT_WINDOW_RGBA = 1;
+    const static int VIDEO_OUTPUT_WINDOW_RGB565 = 2;
+    // audio output profile, AO_OPENSL_PROFILE_* in plugin/ao_opensl.h, from the next start
+    const static int INFO_AUDIO_PROFILE = 0x104;
+    const static int INFO_AUDIO_BURST = 0x105;      // us, the device's native burst
+    const static int INFO_AUDIO_DEVICE_RATE = 0x106;    // Hz, streams are resampled to it
+    const static int INFO_AUDIO_RESAMPLE = 0x107;   // AO_OPENSL_RESAMPLE_OFF or RESAMPLE_*
+    // native_getInfo: render loop telemetry, see render_stats.h
+    const static int INFO_STAT_HIST = 0x200;        // + STATS_*, arg bucket or STATS_COUNT/MEAN/MAX
+    const static int INFO_STAT_JANK = 0x210;
+    const static int INFO_STAT_GPU_TIMER = 0x211;   // 1 when the GPU histograms fill
+    const static int INFO_STAT_BUCKETS = 0x212;
+    const static int INFO_STAT_BOUND = 0x213;       // arg bucket, upper bound in us
+    const static int INFO_STAT_RESET = 0x214;       // native_setInfo
+    const static int INFO_STAT_AUDIO = 0x220;       // + AO_OPENSL_STAT_*
+
     class DTPlayer {
     public:
         DTPlayer();
@@ -34,6 +60,16 @@ namespace android {
 
         int setGLContext(void *pgl);
 
+        yuv_renderer_t *getRenderer();
+
+        dtpListenner *getListenner();
+
+        // native render mode: own EGL context on the given ANativeWindow,
+        // or the CPU window output when INFO_VIDEO_OUTPUT selects it
+        int setVideoSurface(void *window);
+
+        int releaseVideoSurface();
+
         int setListenner(dtpListenner *listenner);
 
         int setDataSource(const char *uri);
@@ -74,12 +110,31 @@ namespace android {
 
         int setHWEnable(int enable);
 
+        int setInfo(int cmd, int64_t arg);
+
+        int getInfo(int cmd, int64_t arg);
+
+        // thumbnail of the frame on screen, 0 keeps the aspect ratio
+        int snapshot(int width, int height, snapshot_cb_t cb, void *opaque);
+
         int Notify(int msg);
 
         static int notify(void *cookie, player_state_t *state);
 
     private:
 
+        int setVideoOutput(int output);
+
+        // created on first use, surfaces come and go around it
+        window_output_t *windowOutput();
+
+        // dtplayer_start, through the vo binding when the stream has video
+        int startVideo();
+
+        static int startPlayer(void *opaque, int queued);
+
+        void unbindVideo();
+
         enum {
             PLAYER_IDLE = 0X0,
             PLAYER_INITED = 0x01,
@@ -103,6 +158,13 @@ namespace android {
         int mSeekPosition;
         int mDuration;
         void *mGLContext;
+        yuv_renderer_t *mRenderer;
+        void *mNativeWindow;
+        render_thread_t *mRenderThread;
+        int mVideoOutput;                   // VIDEO_OUTPUT_*
+        window_output_t *mWindowOutput;     // window outputs only
+        vo_bind_req_t mStartReq;
+        int mStarting;                      // start queued or running, see vo_bind.h
         dtpListenner *mListenner;
         dt_lock_t dtp_mutex;
         player_state_t dtp_state;
@@ -8,6 +8,10 @@
 #include "android_dtplayer.h"
 #include "android_jni.h"
 #include "gl_yuv.h"
+#include "gl_program_cache.h"
+#include "gl_mosaic.h"
+
+#include <android/native_window_jni.h>
 
 #include "native_log.h"
 
@@ -24,6 +28,7 @@ struct fields_t {
     jfieldID surface_texture;
 
     jmethodID post_event;
+    jmethodID post_snapshot;
 
     jmethodID proxyConfigGetHost;
     jmethodID proxyConfigGetPort;
@@ -78,6 +83,43 @@ int dtpListenner::notify(int msg, int ext1, int ext2) {
     return 0;
 }
 
+int dtpListenner::snapshot(const uint8_t *rgba, int width, int height, int64_t pts) {
+    JNIEnv *env = NULL;
+    int isAttached = 0;
+    if (gvm->GetEnv((void **) &env, JNI_VERSION_1_4) != JNI_OK) {
+        // native render thread
+        if (gvm->AttachCurrentThread(&env, NULL) != JNI_OK) {
+            LOGV("jvm AttachCurrentThread failed \n ");
+            return -1;
+        }
+        isAttached = 1;
+    }
+
+    jbyteArray pixels = NULL;
+    if (!fields.post_snapshot || !mClass) {
+        LOGV("postSnapshotFromNative not found \n");
+        goto END;
+    }
+    if (rgba) {
+        pixels = env->NewByteArray(width * height * 4);
+        if (!pixels) {
+            env->ExceptionClear();
+            goto END;
+        }
+        env->SetByteArrayRegion(pixels, 0, width * height * 4, (const jbyte *) rgba);
+    }
+    env->CallStaticVoidMethod(mClass, fields.post_snapshot, mObject, pixels, width, height,
+                              (jlong) pts);
+    if (pixels) {
+        env->DeleteLocalRef(pixels);
+    }
+    END:
+    if (isAttached) {
+        gvm->DetachCurrentThread();
+    }
+    return 0;
+}
+
 static DTPlayer *setMediaPlayer(JNIEnv *env, jobject thiz, DTPlayer *player) {
     dt_lock(&mutex);
     DTPlayer *old = (DTPlayer *) env->GetLongField(thiz, fields.context);
@@ -113,6 +155,12 @@ static void android_dttv_native_init(JNIEnv *env) {
         return;
     }
 
+    fields.post_snapshot = env->GetStaticMethodID(clazz, "postSnapshotFromNative",
+                                                  "(Ljava/lang/Object;[BIIJ)V");
+    if (fields.post_snapshot == NULL) {
+        return;
+    }
+
 }
 
 static int android_dttv_native_setup(JNIEnv *env, jobject obj, jobject weak_thiz) {
@@ -246,16 +294,40 @@ int android_dttv_native_reset(JNIEnv *env, jobject thiz) {
     return mp->reset();
 }
 
-void android_dttv_native_releaseSurface(JNIEnv *env, jobject thiz) {
+static void android_dttv_native_set_video_surface(JNIEnv *env, jobject thiz, jobject surface) {
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        LOGV("set video surface failed, mp == null ");
+        return;
+    }
+    ANativeWindow *window = (surface != NULL) ? ANativeWindow_fromSurface(env, surface) : NULL;
+    if (window == NULL) {
+        mp->releaseVideoSurface();
+        return;
+    }
+    // DTPlayer holds its own reference from here on
+    mp->setVideoSurface(window);
+    ANativeWindow_release(window);
+}
 
+void android_dttv_native_releaseSurface(JNIEnv *env, jobject thiz) {
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return;
+    }
+    mp->releaseVideoSurface();
 }
 
 int android_dttv_native_setVideoSize(JNIEnv *env, jobject obj, int w, int h) {
     return 0;
 }
 
-int android_dttv_native_setVideoMode(JNIEnv *env, jobject obj, int mode) {
-    return 0;
+int android_dttv_native_setVideoMode(JNIEnv *env, jobject thiz, int mode) {
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    return mp->setVideoMode(mode);
 }
 
 int android_dttv_native_getVideoWidth(JNIEnv *env, jobject thiz) {
@@ -299,29 +371,113 @@ int android_dttv_native_getDuration(JNIEnv *env, jobject thiz) {
 }
 
 int android_dttv_native_getInfo(JNIEnv *env, jobject thiz, int cmd, jlong arg) {
-    return 0;
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    return mp->getInfo(cmd, arg);
 }
 
 int android_dttv_native_setInfo(JNIEnv *env, jobject thiz, int cmd, jlong arg) {
-    return 0;
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    return mp->setInfo(cmd, arg);
+}
+
+// GL thread, copied out to java before the pixels go away
+static void snapshot_done(void *opaque, const uint8_t *rgba, int width, int height,
+                          int64_t pts) {
+    int64_t ms = PTS_VALID(pts) ? pts / DT_PTS_FREQ_MS : -1;
+    ((dtpListenner *) opaque)->snapshot(rgba, width, height, ms);
+}
+
+int android_dttv_native_snapshot(JNIEnv *env, jobject thiz, int width, int height) {
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    return mp->snapshot(width, height, snapshot_done, mp->getListenner());
 }
 
 int jni_gl_surface_create(JNIEnv *env, jobject thiz) {
-    yuv_dttv_init();
-    yuv_reg_player((void *) getMediaPlayer(env, thiz));
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    yuv_dttv_init(mp->getRenderer());
     return 0;
 }
 
-int jni_gl_surface_change(JNIEnv *env, jobject obj, int w, int h) {
-    yuv_setupGraphics(w, h);
+int jni_gl_surface_change(JNIEnv *env, jobject thiz, int w, int h) {
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        return -1;
+    }
+    yuv_setupGraphics(mp->getRenderer(), w, h);
     LOGV("on surface changed, w:%d h:%d \n", w, h);
     return 0;
 }
 
 
 int jni_gl_draw_frame(JNIEnv *env, jobject thiz) {
-    yuv_renderFrame();
-    return 0;
+    DTPlayer *mp = getMediaPlayer(env, thiz);
+    if (mp == NULL) {
+        // released under the GL thread, nothing to draw or wait for
+        return 1;
+    }
+    return yuv_renderFrame(mp->getRenderer());
+}
+
+// mosaic, one GL view drawing the pictures of several players
+static jlong jni_mosaic_create(JNIEnv *env, jclass clazz, int cols, int rows, int cellWidth,
+                               int cellHeight) {
+    mosaic_para_t para;
+    para.cols = cols;
+    para.rows = rows;
+    para.cellWidth = cellWidth;
+    para.cellHeight = cellHeight;
+    return (jlong) mosaic_create(&para);
+}
+
+static void jni_mosaic_destroy(JNIEnv *env, jclass clazz, jlong mosaic) {
+    mosaic_destroy((mosaic_t *) mosaic);
+}
+
+static int jni_mosaic_set_source(JNIEnv *env, jclass clazz, jlong mosaic, int tile,
+                                 jobject player) {
+    yuv_renderer_t *renderer = NULL;
+    if (player != NULL) {
+        DTPlayer *mp = getMediaPlayer(env, player);
+        if (mp == NULL) {
+            return -1;
+        }
+        renderer = mp->getRenderer();
+    }
+    return mosaic_set_source((mosaic_t *) mosaic, tile, renderer);
+}
+
+static void jni_mosaic_surface_change(JNIEnv *env, jclass clazz, jlong mosaic, int w, int h) {
+    mosaic_set_viewport((mosaic_t *) mosaic, w, h);
+}
+
+static int jni_mosaic_draw(JNIEnv *env, jclass clazz, jlong mosaic) {
+    return mosaic_draw((mosaic_t *) mosaic);
+}
+
+static void android_dttv_setCacheDirectory(JNIEnv *env, jobject thiz, jstring directory) {
+    if (directory == NULL) {
+        setProgramCacheDir(NULL);
+        return;
+    }
+    const char *dir = env->GetStringUTFChars(directory, NULL);
+    if (dir == NULL) {
+        return;
+    }
+    // linked shader programs are kept there across runs
+    setProgramCacheDir(dir);
+    env->ReleaseStringUTFChars(directory, dir);
 }
 
 static int android_dttv_native_setAudioEffect(JNIEnv *env, jobject thiz, jint id) {
@@ -339,6 +495,8 @@ static JNINativeMethod g_Methods[] = {
         {"native_setup",              "(Ljava/lang/Object;)I", (void *) android_dttv_native_setup},
         {"native_hw_enable",          "(I)I",                  (void *) android_dttv_native_hw_enable},
         {"native_release",            "()I",                   (void *) android_dttv_native_release},
+        {"native_set_video_surface",  "(Landroid/view/Surface;)V", (void *) android_dttv_native_set_video_surface},
+        {"native_release_surface",    "()V",                   (void *) android_dttv_native_releaseSurface},
         {"native_setDataSource",      "(Ljava/lang/String;)I", (void *) android_dttv_native_setDataSource},
         {"native_prePare",            "()I",                   (void *) android_dttv_native_prePare},
         {"native_prePareAsync",       "()I",                   (void *) android_dttv_native_prepareAsync},
@@ -357,12 +515,20 @@ static JNINativeMethod g_Methods[] = {
 
         {"native_getInfo",            "(IJ)I",                 (void *) android_dttv_native_getInfo},
         {"native_setInfo",            "(IJ)I",                 (void *) android_dttv_native_setInfo},
+        {"native_snapshot",           "(II)I",                 (void *) android_dttv_native_snapshot},
 
         {"native_surface_create",     "()I",                   (void *) jni_gl_surface_create},
         {"native_surface_change",     "(II)I",                 (void *) jni_gl_surface_change},
         {"native_draw_frame",         "()I",                   (void *) jni_gl_draw_frame},
 
+        {"native_mosaic_create",      "(IIII)J",               (void *) jni_mosaic_create},
+        {"native_mosaic_destroy",     "(J)V",                  (void *) jni_mosaic_destroy},
+        {"native_mosaic_set_source",  "(JILdttv/app/DtPlayer;)I", (void *) jni_mosaic_set_source},
+        {"native_mosaic_surface_change", "(JII)V",             (void *) jni_mosaic_surface_change},
+        {"native_mosaic_draw",        "(J)I",                  (void *) jni_mosaic_draw},
+
         {"native_setAudioEffect",     "(I)I",                  (void *) android_dttv_native_setAudioEffect},
+        {"setCacheDirectory",         "(Ljava/lang/String;)V", (void *) android_dttv_setCacheDirectory},
 };
 
 static int register_natives(JNIEnv *env) {
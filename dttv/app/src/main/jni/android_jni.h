@@ -2,6 +2,7 @@
 #define ANDROID_JNI_H
 
 #include <jni.h>
+#include <stdint.h>
 
 class dtpListenner {
 public:
@@ -11,6 +12,9 @@ public:
 
     int notify(int, int ext1 = 0, int ext2 = 0);
 
+    // rgba NULL: the snapshot failed, pts in ms or -1
+    int snapshot(const uint8_t *rgba, int width, int height, int64_t pts);
+
 private:
     dtpListenner();
 
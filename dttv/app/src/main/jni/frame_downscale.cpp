@@ -0,0 +1,195 @@
+//
+// frame_downscale - 2x/4x box downscale of picture planes on the CPU.
+//
+
+#include <string.h>
+
+#include "frame_downscale.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define DOWNSCALE_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DOWNSCALE_SSE2
+#endif
+
+static int texelBytes(int kind) {
+    return (kind == DOWNSCALE_BYTES) ? 1 : 2;
+}
+
+int downscale_size(int size, int factor) {
+    return (size + factor - 1) / factor;
+}
+
+int downscale_scratch_size(int width, int kind, int factor) {
+    if (factor != 4) {
+        return 0;
+    }
+    return 2 * downscale_size(width, 2) * texelBytes(kind);
+}
+
+/*
+ * Texels [from, dstWidth) of a halved row, odd source widths repeat their
+ * last texel. Also the whole row without SIMD.
+ */
+static void halveTail(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int from, int dstWidth,
+                      int srcWidth, int kind) {
+    for (int j = from; j < dstWidth; j++) {
+        int x0 = 2 * j;
+        int x1 = (x0 + 1 < srcWidth) ? x0 + 1 : x0;
+        if (kind == DOWNSCALE_BYTES) {
+            d[j] = (uint8_t) ((s0[x0] + s0[x1] + s1[x0] + s1[x1] + 2) >> 2);
+        } else if (kind == DOWNSCALE_PAIRS) {
+            for (int c = 0; c < 2; c++) {
+                d[2 * j + c] = (uint8_t) ((s0[2 * x0 + c] + s0[2 * x1 + c] +
+                                           s1[2 * x0 + c] + s1[2 * x1 + c] + 2) >> 2);
+            }
+        } else {
+            const uint16_t *w0 = (const uint16_t *) s0;
+            const uint16_t *w1 = (const uint16_t *) s1;
+            ((uint16_t *) d)[j] = (uint16_t) (((uint32_t) w0[x0] + w0[x1] + w1[x0] + w1[x1] + 2)
+                    >> 2);
+        }
+    }
+}
+
+#if defined(DOWNSCALE_NEON)
+
+// pairwise widening adds do the horizontal sum, the rounding narrow the /4
+static int halveVector(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int dstWidth,
+                       int srcWidth, int kind) {
+    int j = 0;
+    if (kind == DOWNSCALE_BYTES) {
+        for (; 2 * (j + 8) <= srcWidth && j + 8 <= dstWidth; j += 8) {
+            uint16x8_t sum = vpaddlq_u8(vld1q_u8(s0 + 2 * j));
+            sum = vpadalq_u8(sum, vld1q_u8(s1 + 2 * j));
+            vst1_u8(d + j, vrshrn_n_u16(sum, 2));
+        }
+    } else if (kind == DOWNSCALE_PAIRS) {
+        for (; 2 * (j + 8) <= srcWidth && j + 8 <= dstWidth; j += 8) {
+            // deinterleaves into the two chroma planes and back
+            uint8x16x2_t a = vld2q_u8(s0 + 4 * j);
+            uint8x16x2_t b = vld2q_u8(s1 + 4 * j);
+            uint8x8x2_t out;
+            out.val[0] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[0]), b.val[0]), 2);
+            out.val[1] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[1]), b.val[1]), 2);
+            vst2_u8(d + 2 * j, out);
+        }
+    } else {
+        const uint16_t *w0 = (const uint16_t *) s0;
+        const uint16_t *w1 = (const uint16_t *) s1;
+        for (; 2 * (j + 4) <= srcWidth && j + 4 <= dstWidth; j += 4) {
+            uint32x4_t sum = vpaddlq_u16(vld1q_u16(w0 + 2 * j));
+            sum = vpadalq_u16(sum, vld1q_u16(w1 + 2 * j));
+            vst1_u16((uint16_t *) d + j, vrshrn_n_u32(sum, 2));
+        }
+    }
+    return j;
+}
+
+#elif defined(DOWNSCALE_SSE2)
+
+// rows are added widened, neighbours folded in by lane shifts
+static int halveVector(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int dstWidth,
+                       int srcWidth, int kind) {
+    const __m128i zero = _mm_setzero_si128();
+    int j = 0;
+    if (kind == DOWNSCALE_BYTES) {
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i round = _mm_set1_epi16(2);
+        for (; 2 * (j + 8) <= srcWidth && j + 8 <= dstWidth; j += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (s0 + 2 * j));
+            __m128i b = _mm_loadu_si128((const __m128i *) (s1 + 2 * j));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            __m128i sum = _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+            _mm_storel_epi64((__m128i *) (d + j), _mm_packus_epi16(sum, sum));
+        }
+    } else if (kind == DOWNSCALE_PAIRS) {
+        const __m128i round = _mm_set1_epi16(2);
+        for (; 2 * (j + 4) <= srcWidth && j + 4 <= dstWidth; j += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (s0 + 4 * j));
+            __m128i b = _mm_loadu_si128((const __m128i *) (s1 + 4 * j));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            // u0 v0 u1 v1: add the pair two lanes up, keep dwords 0 and 2
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 4));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 4));
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), round), 2);
+            _mm_storel_epi64((__m128i *) (d + 2 * j), _mm_packus_epi16(sum, sum));
+        }
+    } else {
+        const __m128i round = _mm_set1_epi32(2);
+        const __m128i bias32 = _mm_set1_epi32(0x8000);
+        const __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+        const uint16_t *w0 = (const uint16_t *) s0;
+        const uint16_t *w1 = (const uint16_t *) s1;
+        for (; 2 * (j + 4) <= srcWidth && j + 4 <= dstWidth; j += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (w0 + 2 * j));
+            __m128i b = _mm_loadu_si128((const __m128i *) (w1 + 2 * j));
+            __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero));
+            __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero));
+            lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+            hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i sum = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), round), 2);
+            // no unsigned 32->16 pack before SSE4.1: go through the signed one
+            sum = _mm_packs_epi32(_mm_sub_epi32(sum, bias32), _mm_sub_epi32(sum, bias32));
+            _mm_storel_epi64((__m128i *) ((uint16_t *) d + j), _mm_xor_si128(sum, bias16));
+        }
+    }
+    return j;
+}
+
+#else
+
+static int halveVector(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int dstWidth,
+                       int srcWidth, int kind) {
+    return 0;
+}
+
+#endif
+
+static void halveRow(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int srcWidth, int kind) {
+    int dstWidth = downscale_size(srcWidth, 2);
+    int j = halveVector(s0, s1, d, dstWidth, srcWidth, kind);
+    halveTail(s0, s1, d, j, dstWidth, srcWidth, kind);
+}
+
+void downscale_plane(const uint8_t *src, int srcStride, int width, int height, int kind,
+                     int factor, uint8_t *dst, int dstStride, uint8_t *scratch) {
+    int dstHeight = downscale_size(height, factor);
+    if (factor == 2) {
+        for (int y = 0; y < dstHeight; y++) {
+            const uint8_t *s0 = src + 2 * y * srcStride;
+            // odd height, the last row pairs with itself
+            const uint8_t *s1 = (2 * y + 1 < height) ? s0 + srcStride : s0;
+            halveRow(s0, s1, dst + y * dstStride, width, kind);
+        }
+        return;
+    }
+
+    // 4x: two halved rows, then those halved again
+    int halfWidth = downscale_size(width, 2);
+    uint8_t *r0 = scratch;
+    uint8_t *r1 = scratch + halfWidth * texelBytes(kind);
+    for (int y = 0; y < dstHeight; y++) {
+        int row = 4 * y;
+        const uint8_t *s0 = src + row * srcStride;
+        const uint8_t *s1 = (row + 1 < height) ? s0 + srcStride : s0;
+        halveRow(s0, s1, r0, width, kind);
+        const uint8_t *h1 = r0;
+        if (row + 2 < height) {
+            const uint8_t *s2 = s0 + 2 * srcStride;
+            const uint8_t *s3 = (row + 3 < height) ? s2 + srcStride : s2;
+            halveRow(s2, s3, r1, width, kind);
+            h1 = r1;
+        }
+        halveRow(r0, h1, dst + y * dstStride, halfWidth, kind);
+    }
+}
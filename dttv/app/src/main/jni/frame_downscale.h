@@ -0,0 +1,45 @@
+//
+// frame_downscale - 2x/4x box downscale of picture planes on the CPU.
+//
+// For pictures much larger than the surface showing them: the upload then
+// moves a quarter or a sixteenth of the bytes and the GPU samples a texture
+// close to screen size instead of minifying most of it away.
+//
+// Rows are consumed in pairs straight from the decoder buffer, 4x halves
+// twice through two scratch rows that stay in L1. NEON when the compiler
+// targets it (-mfpu=neon, arm64), SSE2 on x86, plain C otherwise.
+//
+
+#ifndef GLES2JNI_FRAME_DOWNSCALE_H
+#define GLES2JNI_FRAME_DOWNSCALE_H
+
+#include <stdint.h>
+
+// what a texel of the plane is
+enum {
+    DOWNSCALE_BYTES = 0,    // one 8-bit sample
+    DOWNSCALE_PAIRS,        // interleaved 8-bit chroma pair, NV12/NV21
+    DOWNSCALE_WORDS,        // one 16-bit sample, 9 to 16 bit depths
+};
+
+/*
+ * texels of a side after downscale, partial blocks at the right and bottom
+ * edges still make a texel
+ */
+int downscale_size(int size, int factor);
+
+/*
+ * bytes of scratch downscale_plane needs for factor 4, 0 for 2
+ */
+int downscale_scratch_size(int width, int kind, int factor);
+
+/*
+ * Average factor x factor blocks of src into dst.
+ * width, height - source size in texels
+ * factor - 2 or 4
+ * scratch - downscale_scratch_size bytes
+ */
+void downscale_plane(const uint8_t *src, int srcStride, int width, int height, int kind,
+                     int factor, uint8_t *dst, int dstStride, uint8_t *scratch);
+
+#endif //GLES2JNI_FRAME_DOWNSCALE_H
@@ -0,0 +1,193 @@
+//
+// frame_mailbox - bounded lock-free SPSC hand-off between vo_android_render
+// (decoder output thread) and the GL render thread.
+//
+// Every slot carries a small state machine, slots only change owner through
+// a CAS, so neither side ever blocks on the other:
+//
+//   FREE -> WRITING -> READY            producer
+//   READY -> WRITING                    producer, overwrite of an unseen frame
+//   READY -> READING -> FREE            consumer
+//
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_log.h"
+#include "native_atomic.h"
+#include "frame_mailbox.h"
+
+#define TAG "FRAME-MAILBOX"
+
+enum {
+    SLOT_FREE = 0,
+    SLOT_WRITING,
+    SLOT_READY,
+    SLOT_READING,
+};
+
+// wrap-safe "a is older than b"
+#define SEQ_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+static void mailbox_default_release(dt_av_frame_t *frame) {
+    if (frame->data[0]) {
+        free(frame->data[0]);
+    }
+}
+
+static void release_slot(frame_mailbox_t *mb, mailbox_slot_t *slot) {
+    mb->release(&slot->frame);
+    memset(&slot->frame, 0, sizeof(dt_av_frame_t));
+}
+
+void mailbox_init(frame_mailbox_t *mb, mailbox_release_t release) {
+    memset(mb, 0, sizeof(frame_mailbox_t));
+    mb->release = release ? release : mailbox_default_release;
+}
+
+int mailbox_push(frame_mailbox_t *mb, dt_av_frame_t *frame) {
+    return mailbox_push_timed(mb, frame, 0);
+}
+
+int mailbox_push_timed(frame_mailbox_t *mb, dt_av_frame_t *frame, int64_t time) {
+    mailbox_slot_t *slot = NULL;
+    int overwritten = 0;
+
+    while (!slot) {
+        mailbox_slot_t *oldest = NULL;
+        for (int i = 0; i < MAILBOX_SLOTS; i++) {
+            mailbox_slot_t *s = &mb->slots[i];
+            int state = dt_atomic_load(&s->state);
+            if (state == SLOT_FREE) {
+                if (dt_atomic_cas(&s->state, SLOT_FREE, SLOT_WRITING)) {
+                    slot = s;
+                    break;
+                }
+            } else if (state == SLOT_READY) {
+                if (!oldest || SEQ_BEFORE(s->seq, oldest->seq)) {
+                    oldest = s;
+                }
+            }
+        }
+        if (slot || !oldest) {
+            continue;
+        }
+        // consumer is behind: steal the oldest frame it has not picked up yet
+        if (dt_atomic_cas(&oldest->state, SLOT_READY, SLOT_WRITING)) {
+            release_slot(mb, oldest);
+            dt_atomic_inc(&mb->stat.overwritten);
+            overwritten = 1;
+            slot = oldest;
+        }
+    }
+
+    memcpy(&slot->frame, frame, sizeof(dt_av_frame_t));
+    slot->time = time;
+    slot->seq = ++mb->write_seq;
+    dt_atomic_store(&slot->state, SLOT_READY);
+    dt_atomic_inc(&mb->stat.pushed);
+    return overwritten;
+}
+
+static mailbox_slot_t *find_ready(frame_mailbox_t *mb, int newest) {
+    mailbox_slot_t *found = NULL;
+    for (int i = 0; i < MAILBOX_SLOTS; i++) {
+        mailbox_slot_t *s = &mb->slots[i];
+        if (dt_atomic_load(&s->state) != SLOT_READY) {
+            continue;
+        }
+        if (!found || (newest ? SEQ_BEFORE(found->seq, s->seq) : SEQ_BEFORE(s->seq, found->seq))) {
+            found = s;
+        }
+    }
+    return found;
+}
+
+dt_av_frame_t *mailbox_acquire(frame_mailbox_t *mb) {
+    mailbox_slot_t *slot;
+    while ((slot = find_ready(mb, 0)) != NULL) {
+        if (!dt_atomic_cas(&slot->state, SLOT_READY, SLOT_READING)) {
+            continue; // overwritten by producer meanwhile, rescan
+        }
+        if (mb->read_seq && !SEQ_BEFORE(mb->read_seq, slot->seq)) {
+            // older than what we already showed, keep pts order
+            release_slot(mb, slot);
+            dt_atomic_store(&slot->state, SLOT_FREE);
+            dt_atomic_inc(&mb->stat.late);
+            continue;
+        }
+        mb->read_seq = slot->seq;
+        return &slot->frame;
+    }
+    return NULL;
+}
+
+dt_av_frame_t *mailbox_acquire_latest(frame_mailbox_t *mb) {
+    mailbox_slot_t *newest = find_ready(mb, 1);
+    if (!newest) {
+        return NULL;
+    }
+    uint32_t target = newest->seq;
+    dt_av_frame_t *frame;
+    while ((frame = mailbox_acquire(mb)) != NULL) {
+        mailbox_slot_t *slot = (mailbox_slot_t *) ((char *) frame - offsetof(mailbox_slot_t, frame));
+        if (!SEQ_BEFORE(slot->seq, target)) {
+            return frame;
+        }
+        release_slot(mb, slot);
+        dt_atomic_store(&slot->state, SLOT_FREE);
+        dt_atomic_inc(&mb->stat.late);
+    }
+    return NULL;
+}
+
+void mailbox_release(frame_mailbox_t *mb, dt_av_frame_t *frame) {
+    if (!frame) {
+        return;
+    }
+    mailbox_slot_t *slot = (mailbox_slot_t *) ((char *) frame - offsetof(mailbox_slot_t, frame));
+    release_slot(mb, slot);
+    dt_atomic_store(&slot->state, SLOT_FREE);
+}
+
+int mailbox_take(frame_mailbox_t *mb, dt_av_frame_t *frame, int64_t *time) {
+    dt_av_frame_t *ready = mailbox_acquire(mb);
+    if (!ready) {
+        return -1;
+    }
+    mailbox_slot_t *slot = (mailbox_slot_t *) ((char *) ready - offsetof(mailbox_slot_t, frame));
+    memcpy(frame, ready, sizeof(dt_av_frame_t));
+    if (time) {
+        *time = slot->time;
+    }
+    memset(&slot->frame, 0, sizeof(dt_av_frame_t));
+    dt_atomic_store(&slot->state, SLOT_FREE);
+    return 0;
+}
+
+void mailbox_flush(frame_mailbox_t *mb) {
+    for (int i = 0; i < MAILBOX_SLOTS; i++) {
+        mailbox_slot_t *s = &mb->slots[i];
+        if (dt_atomic_cas(&s->state, SLOT_READY, SLOT_READING)) {
+            release_slot(mb, s);
+            dt_atomic_store(&s->state, SLOT_FREE);
+        }
+    }
+}
+
+int mailbox_pending(frame_mailbox_t *mb) {
+    int count = 0;
+    for (int i = 0; i < MAILBOX_SLOTS; i++) {
+        if (dt_atomic_load(&mb->slots[i].state) == SLOT_READY) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void mailbox_get_stat(frame_mailbox_t *mb, mailbox_stat_t *stat) {
+    stat->pushed = dt_atomic_load_relaxed(&mb->stat.pushed);
+    stat->overwritten = dt_atomic_load_relaxed(&mb->stat.overwritten);
+    stat->late = dt_atomic_load_relaxed(&mb->stat.late);
+}
@@ -0,0 +1,72 @@
+//
+// frame_mailbox - bounded lock-free SPSC hand-off between vo_android_render
+// (decoder output thread) and the GL render thread.
+//
+
+#ifndef GLES2JNI_FRAME_MAILBOX_H
+#define GLES2JNI_FRAME_MAILBOX_H
+
+#include <stdint.h>
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_av.h"
+}
+
+#define MAILBOX_SLOTS 4
+
+typedef void (*mailbox_release_t)(dt_av_frame_t *frame);
+
+typedef struct {
+    dt_av_frame_t frame;
+    int64_t time;     // producer supplied timestamp, see mailbox_push_timed
+    uint32_t seq;
+    int state;
+} mailbox_slot_t;
+
+typedef struct {
+    int pushed;       // frames handed in by the producer
+    int overwritten;  // frames replaced by the producer before the consumer saw them
+    int late;         // frames skipped by the consumer because a newer one was ready
+} mailbox_stat_t;
+
+typedef struct {
+    mailbox_slot_t slots[MAILBOX_SLOTS];
+    uint32_t write_seq;  // producer only
+    uint32_t read_seq;   // consumer only, seq of the last acquired frame
+    mailbox_release_t release;
+    mailbox_stat_t stat;
+} frame_mailbox_t;
+
+/*
+ * Producer side never waits: if every slot is occupied, the oldest frame
+ * not yet picked up by the consumer is released and replaced.
+ * Consumer side always gets frames in push (pts) order.
+ */
+void mailbox_init(frame_mailbox_t *mb, mailbox_release_t release);
+
+int mailbox_push(frame_mailbox_t *mb, dt_av_frame_t *frame);
+
+/*
+ * push with an arrival time the consumer gets back from mailbox_take
+ */
+int mailbox_push_timed(frame_mailbox_t *mb, dt_av_frame_t *frame, int64_t time);
+
+dt_av_frame_t *mailbox_acquire(frame_mailbox_t *mb);
+
+dt_av_frame_t *mailbox_acquire_latest(frame_mailbox_t *mb);
+
+void mailbox_release(frame_mailbox_t *mb, dt_av_frame_t *frame);
+
+/*
+ * move the oldest ready frame out of the mailbox, ownership of its buffers
+ * goes to the caller and the slot is free again right away
+ * @return 0 success, -1 nothing ready
+ */
+int mailbox_take(frame_mailbox_t *mb, dt_av_frame_t *frame, int64_t *time);
+
+void mailbox_flush(frame_mailbox_t *mb);
+
+int mailbox_pending(frame_mailbox_t *mb);
+
+void mailbox_get_stat(frame_mailbox_t *mb, mailbox_stat_t *stat);
+
+#endif //GLES2JNI_FRAME_MAILBOX_H
@@ -0,0 +1,241 @@
+//
+// frame_scheduler - vsync aligned presentation on top of frame_mailbox.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_log.h"
+#include "frame_scheduler.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_macro.h"
+#include "../../../../3rd/libdtp/include/dt_time.h"
+}
+
+#define TAG "FRAME-SCHEDULER"
+
+#define SCHED_DEFAULT_PERIOD  16667
+#define SCHED_MIN_PERIOD      4000      // 250Hz
+#define SCHED_MAX_PERIOD      50000     // 20Hz, longer gaps are stalls not vsyncs
+#define SCHED_RESYNC_US       1000000   // clock jump treated as discontinuity
+#define SCHED_STAT_FRAMES     300
+#define SCHED_PTS_DUE_NOW     ((int64_t) 0x8000000000000000ULL)  // sorts before any pts
+
+static int64_t default_now(void *opaque) {
+    return dt_gettime();
+}
+
+void scheduler_init(frame_scheduler_t *s, frame_mailbox_t *mb, const sched_clock_t *clock) {
+    memset(s, 0, sizeof(frame_scheduler_t));
+    s->mailbox = mb;
+    if (clock) {
+        s->clock = *clock;
+    }
+    if (!s->clock.now) {
+        s->clock.now = default_now;
+    }
+    s->period = SCHED_DEFAULT_PERIOD;  // until the first vsync interval
+    s->stat.vsync_period = SCHED_DEFAULT_PERIOD;
+    strcpy(s->stat.cadence, "-");
+}
+
+static int64_t master_time(frame_scheduler_t *s) {
+    return s->clock.master ? s->clock.master(s->clock.opaque) : -1;
+}
+
+int scheduler_push(frame_scheduler_t *s, dt_av_frame_t *frame) {
+    // switching between the two clocks is a discontinuity, see update_offset
+    int64_t master = master_time(s);
+    return mailbox_push_timed(s->mailbox, frame,
+                              (master >= 0) ? master : s->clock.now(s->clock.opaque));
+}
+
+void scheduler_release(frame_scheduler_t *s, dt_av_frame_t *frame) {
+    if (frame && frame->data[0]) {
+        s->mailbox->release(frame);
+    }
+    if (frame) {
+        memset(frame, 0, sizeof(dt_av_frame_t));
+    }
+}
+
+static void drop_head(frame_scheduler_t *s, int n) {
+    for (int i = 0; i < n; i++) {
+        scheduler_release(s, &s->queue[i].frame);
+        s->stat.dropped++;
+    }
+    memmove(&s->queue[0], &s->queue[n], (s->count - n) * sizeof(sched_entry_t));
+    s->count -= n;
+}
+
+void scheduler_flush(frame_scheduler_t *s) {
+    dt_av_frame_t frame;
+    while (mailbox_take(s->mailbox, &frame, NULL) == 0) {
+        scheduler_release(s, &frame);
+    }
+    for (int i = 0; i < s->count; i++) {
+        scheduler_release(s, &s->queue[i].frame);
+    }
+    s->count = 0;
+    s->offset_valid = 0;
+}
+
+static void update_period(frame_scheduler_t *s, int64_t now) {
+    int64_t delta = now - s->last_vsync;
+    s->last_vsync = now;
+    if (delta < SCHED_MIN_PERIOD || delta > SCHED_MAX_PERIOD) {
+        return;
+    }
+    if (!s->period_valid) {
+        // may be a multiple of the real period, the filter below only
+        // converges downwards from there
+        s->period = delta;
+        s->period_valid = 1;
+    }
+    // a late draw callback spans several refreshes
+    int64_t n = (delta + s->period / 2) / s->period;
+    if (n < 1) {
+        n = 1;
+    }
+    s->period += (delta / n - s->period) / 8;
+    s->stat.vsync_period = (int) s->period;
+}
+
+/*
+ * media clock origin from arrival times: libdtp hands frames to the vo when
+ * they are due, so arrival - pts is the clock offset plus delivery jitter.
+ * Track the low edge, late deliveries must not push the clock back.
+ */
+static void update_offset(frame_scheduler_t *s, int64_t offset) {
+    if (!s->offset_valid || llabs(offset - s->offset) > SCHED_RESYNC_US) {
+        s->offset = offset;
+        s->offset_valid = 1;
+    } else if (offset < s->offset) {
+        s->offset = offset;
+    } else {
+        s->offset += (offset - s->offset) / 32;
+    }
+}
+
+static int pull_frames(frame_scheduler_t *s) {
+    dt_av_frame_t frame;
+    int64_t arrival;
+    int pulled = 0;
+    while (mailbox_take(s->mailbox, &frame, &arrival) == 0) {
+        if (s->count == SCHED_QUEUE_SIZE) {
+            drop_head(s, 1);
+        }
+        sched_entry_t *e = &s->queue[s->count++];
+        memcpy(&e->frame, &frame, sizeof(dt_av_frame_t));
+        if (PTS_VALID(frame.pts)) {
+            e->pts = frame.pts * 1000000 / DT_PTS_FREQ;
+            update_offset(s, arrival - e->pts);
+        } else {
+            // no timestamp: due at the next refresh
+            e->pts = SCHED_PTS_DUE_NOW;
+        }
+        pulled++;
+    }
+    return pulled;
+}
+
+static void update_cadence(frame_scheduler_t *s) {
+    s->cadence[s->cadence_count % SCHED_CADENCE_HISTORY] = s->shown_vsyncs;
+    s->cadence_count++;
+    if (s->cadence_count < SCHED_CADENCE_HISTORY) {
+        return;
+    }
+
+    int same = 1, alternate = 1;
+    int a = s->cadence[0], b = s->cadence[1];
+    for (int i = 0; i < SCHED_CADENCE_HISTORY; i++) {
+        same = same && s->cadence[i] == a;
+        alternate = alternate && s->cadence[i] == ((i & 1) ? b : a);
+    }
+    char cadence[sizeof(s->stat.cadence)];
+    if (same) {
+        snprintf(cadence, sizeof(cadence), "%d", a);
+    } else if (alternate) {
+        // ring order does not matter for a 2-cycle, print the longer first
+        snprintf(cadence, sizeof(cadence), "%d:%d", a > b ? a : b, a > b ? b : a);
+    } else {
+        strcpy(cadence, "irregular");
+    }
+    if (strcmp(cadence, s->stat.cadence) != 0) {
+        LOGV("cadence %s -> %s, vsync period %d us \n", s->stat.cadence, cadence,
+             s->stat.vsync_period);
+        strcpy(s->stat.cadence, cadence);
+    }
+}
+
+dt_av_frame_t *scheduler_on_vsync(frame_scheduler_t *s, int *idle) {
+    int64_t now = s->clock.now(s->clock.opaque);
+    update_period(s, now);
+
+    if (pull_frames(s) > 0 || s->count > 0) {
+        s->idle_vsyncs = 0;
+    } else if (s->idle_vsyncs < SCHED_IDLE_VSYNCS) {
+        s->idle_vsyncs++;
+    }
+    if (idle) {
+        *idle = (s->idle_vsyncs >= SCHED_IDLE_VSYNCS);
+    }
+
+    int64_t master = master_time(s);
+    int64_t time = ((master >= 0) ? master : now) - s->offset;
+    int64_t target;
+    if (master >= 0) {
+        // media time at the refresh this draw is scanned out on, the frame
+        // nearest to it wins. The master runs on through late deliveries and
+        // stands still with a paused or starved device
+        target = time + s->period * SCHED_PRESENT_VSYNCS + s->period / 2;
+    } else {
+        // recovered clock only knows a frame is due once it arrived, judge
+        // against half a period ago so delivery jitter around the vsync
+        // does not flip a frame between two refreshes
+        target = time - s->period / 2;
+    }
+
+    int best = -1;
+    for (int i = 0; i < s->count; i++) {
+        if (s->queue[i].pts <= target) {
+            best = i;
+        }
+    }
+    if (best < 0 && s->count > 0 &&
+        (!s->shown || s->queue[0].pts > target + SCHED_RESYNC_US)) {
+        // first picture, or the clock is far behind (seek): show right away
+        best = 0;
+    }
+
+    if (best < 0) {
+        if (s->shown) {
+            s->shown_vsyncs++;
+            s->stat.repeated++;
+        }
+        return NULL;
+    }
+
+    drop_head(s, best);
+    memcpy(&s->current, &s->queue[0].frame, sizeof(dt_av_frame_t));
+    memmove(&s->queue[0], &s->queue[1], (s->count - 1) * sizeof(sched_entry_t));
+    s->count--;
+
+    if (s->shown) {
+        update_cadence(s);
+    }
+    s->shown = 1;
+    s->shown_vsyncs = 1;
+    if (++s->stat.displayed % SCHED_STAT_FRAMES == 0) {
+        LOGV("displayed:%d dropped:%d repeated:%d period:%d us cadence:%s \n",
+             s->stat.displayed, s->stat.dropped, s->stat.repeated, s->stat.vsync_period,
+             s->stat.cadence);
+    }
+    return &s->current;
+}
+
+void scheduler_get_stat(frame_scheduler_t *s, sched_stat_t *stat) {
+    memcpy(stat, &s->stat, sizeof(sched_stat_t));
+}
@@ -0,0 +1,96 @@
+//
+// frame_scheduler - vsync aligned presentation on top of frame_mailbox.
+//
+// The producer pushes frames with their arrival time. On every vsync the
+// render thread asks the scheduler which frame should be on screen when the
+// next refresh happens: the newest frame whose pts is due by then against
+// the master clock. Older frames are dropped before they cost an upload and
+// a vsync without a due frame just redraws the current textures.
+//
+
+#ifndef GLES2JNI_FRAME_SCHEDULER_H
+#define GLES2JNI_FRAME_SCHEDULER_H
+
+#include <stdint.h>
+#include "frame_mailbox.h"
+
+#define SCHED_QUEUE_SIZE      8
+#define SCHED_CADENCE_HISTORY 12
+#define SCHED_IDLE_VSYNCS     30    // ~0.5s at 60Hz without frames -> idle
+#define SCHED_PRESENT_VSYNCS  1     // a frame drawn now is scanned out this many vsyncs later
+
+typedef struct {
+    int64_t (*now)(void *opaque);     // monotonic time, us
+    // media clock, us, any origin, e.g. the audio device position; negative
+    // while it does not run. Arrivals are stamped with it and only place its
+    // origin against the pts. NULL - recovered from arrival on now alone
+    int64_t (*master)(void *opaque);
+    void *opaque;
+} sched_clock_t;
+
+typedef struct {
+    int displayed;      // frames handed out for upload
+    int dropped;        // frames discarded before upload, already late
+    int repeated;       // vsyncs that kept the previous frame on screen
+    int vsync_period;   // estimated refresh period, us
+    char cadence[16];   // vsyncs per frame, e.g. "3:2" for 24fps on 60Hz, "2" for 30fps
+} sched_stat_t;
+
+typedef struct {
+    dt_av_frame_t frame;
+    int64_t pts;        // us
+} sched_entry_t;
+
+typedef struct {
+    frame_mailbox_t *mailbox;
+    sched_clock_t clock;
+
+    sched_entry_t queue[SCHED_QUEUE_SIZE];  // pts order, consumer only
+    int count;
+    dt_av_frame_t current;                  // handed out by scheduler_on_vsync
+
+    int64_t last_vsync;
+    int64_t period;
+    int period_valid;
+
+    int64_t offset;     // arrival - pts, origin of the media clock
+    int offset_valid;
+
+    int shown;          // something is on screen
+    int shown_vsyncs;   // vsyncs the current frame has been on screen
+    int cadence[SCHED_CADENCE_HISTORY];
+    int cadence_count;
+    int idle_vsyncs;
+
+    sched_stat_t stat;
+} frame_scheduler_t;
+
+/*
+ * clock NULL: dt_gettime() and a media clock recovered from arrivals
+ */
+void scheduler_init(frame_scheduler_t *s, frame_mailbox_t *mb, const sched_clock_t *clock);
+
+/*
+ * producer side, stamps the frame with clock->master while it runs, else
+ * clock->now
+ */
+int scheduler_push(frame_scheduler_t *s, dt_av_frame_t *frame);
+
+/*
+ * consumer side, call once per vsync (every draw callback)
+ * @return frame to upload, caller hands it back with scheduler_release;
+ *         NULL keep showing the current one
+ * *idle set when no frame came in for SCHED_IDLE_VSYNCS vsyncs
+ */
+dt_av_frame_t *scheduler_on_vsync(frame_scheduler_t *s, int *idle);
+
+void scheduler_release(frame_scheduler_t *s, dt_av_frame_t *frame);
+
+/*
+ * drop queued frames, e.g. on a new context or after seek
+ */
+void scheduler_flush(frame_scheduler_t *s);
+
+void scheduler_get_stat(frame_scheduler_t *s, sched_stat_t *stat);
+
+#endif //GLES2JNI_FRAME_SCHEDULER_H
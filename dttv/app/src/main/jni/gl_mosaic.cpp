@@ -0,0 +1,506 @@
+//
+// gl_mosaic - draw the frames of several players as one grid.
+//
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "native_log.h"
+#include "gl_util.h"
+#include "gl_program_cache.h"
+#include "gl_mosaic.h"
+#include "dt_lock.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_time.h"
+}
+
+#define TAG "GL-MOSAIC"
+
+#define MOSAIC_STAGING_SIZE (64 * 1024)
+#define MOSAIC_VERTEX_SIZE  6           // x, y, u, v, bt709, full range
+#define MOSAIC_STAT_DRAWS   600
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2 // GLES3 / GL_EXT_unpack_subimage
+#endif
+
+static const char gMosaicVertexShader[] = {
+        "attribute vec4 aPosition;\n"
+                "attribute vec2 aTextureCoord;\n"
+                "attribute vec2 aMatrix;\n"
+                "varying vec2 vTextureCoord;\n"
+                "varying vec2 vMatrix;\n"
+                "void main() {\n"
+                "  gl_Position = aPosition;\n"
+                "  vTextureCoord = aTextureCoord;\n"
+                "  vMatrix = aMatrix;\n"
+                "}\n"
+};
+
+// same coefficients as the gl_yuv variants, picked per tile by vMatrix:
+// x 0 BT.601 / 1 BT.709, y 0 limited / 1 full range
+static const char gMosaicFragmentShader[] = {
+        "precision mediump float;\n"
+                "uniform sampler2D Ytex;\n"
+                "uniform sampler2D Utex,Vtex;\n"
+                "varying vec2 vTextureCoord;\n"
+                "varying vec2 vMatrix;\n"
+                "void main(void) {\n"
+                "  float y,u,v,c;\n"
+                "  y=texture2D(Ytex,vTextureCoord).r;\n"
+                "  u=texture2D(Utex,vTextureCoord).r;\n"
+                "  v=texture2D(Vtex,vTextureCoord).r;\n"
+                "  y=mix(1.1644*(y-0.0625),y,vMatrix.y);\n"
+                "  c=mix(1.1384,1.0,vMatrix.y);\n"
+                "  u=c*(u-0.5);\n"
+                "  v=c*(v-0.5);\n"
+                "  vec4 k=mix(vec4(1.4020,0.3441,0.7141,1.7720),\n"
+                "             vec4(1.5748,0.1873,0.4681,1.8556),vMatrix.x);\n"
+                "  gl_FragColor=vec4(y+k.x*v,y-k.y*u-k.z*v,y+k.w*u,1.0);\n"
+                "}\n"
+};
+
+typedef struct {
+    int draws;          // mosaic_draw calls
+    int uploads;        // tiles uploaded, i.e. changed since the last draw
+    int unchanged;      // tiles drawn from what was already in the atlas
+    int64_t upload_us;  // total upload time
+} mosaic_stat_t;
+
+typedef struct {
+    yuv_renderer_t *renderer;
+    int serial;         // bumped by mosaic_set_source, a draw's copy is stale then
+    int attached;       // renderer was initialised on the mosaic's GL thread
+    int shown;          // cell holds a picture
+    int frameWidth;     // source size, for the aspect ratio
+    int frameHeight;
+    int width;          // size in the cell after decimation
+    int height;
+    int bt709;
+    int fullRange;
+} mosaic_tile_t;
+
+struct mosaic {
+    mosaic_para_t para;
+    int atlasWidth;
+    int atlasHeight;
+    GLuint textures[3];     // Y, U, V atlas, chroma cells are half size
+    GLuint program;
+    gl_state_t gl;          // binds in the mosaic's context, see gl_util.h
+    GLint positionHandle;
+    GLint textureHandle;
+    GLint matrixHandle;
+    int hasUnpackRowLength;
+    uint8_t *staging;
+    int stagingSize;
+    int viewportWidth;
+    int viewportHeight;
+
+    dt_lock_t lock;         // tiles and viewport, against mosaic_set_source
+    mosaic_tile_t tiles[MOSAIC_MAX_TILES];
+    int drawing;            // a draw uses its copy of the sources, unlocked
+    pthread_cond_t drawn;   // drawing cleared
+
+    // geometry of the shown tiles, rebuilt when a tile or the viewport changes
+    GLfloat vertices[MOSAIC_MAX_TILES * 4 * MOSAIC_VERTEX_SIZE];
+    GLubyte indices[MOSAIC_MAX_TILES * 6];
+    int indexCount;
+    int geometryDirty;
+
+    mosaic_stat_t stat;
+};
+
+static int setupProgram(mosaic_t *m) {
+    m->program = createCachedProgram(gMosaicVertexShader, gMosaicFragmentShader);
+    if (!m->program) {
+        LOGV("Could not create mosaic program");
+        return -1;
+    }
+    m->positionHandle = glGetAttribLocation(m->program, "aPosition");
+    m->textureHandle = glGetAttribLocation(m->program, "aTextureCoord");
+    m->matrixHandle = glGetAttribLocation(m->program, "aMatrix");
+    if (m->positionHandle == -1 || m->textureHandle == -1 || m->matrixHandle == -1) {
+        LOGV("%s: Could not get attribute handles", __FUNCTION__);
+        return -1;
+    }
+    gl_use_program(&m->gl, m->program);
+    glUniform1i(glGetUniformLocation(m->program, "Ytex"), 0);
+    glUniform1i(glGetUniformLocation(m->program, "Utex"), 1);
+    glUniform1i(glGetUniformLocation(m->program, "Vtex"), 2);
+    checkGlError("mosaic setupProgram");
+    return 0;
+}
+
+mosaic_t *mosaic_create(const mosaic_para_t *para) {
+    if (para->cols <= 0 || para->rows <= 0 || para->cols * para->rows > MOSAIC_MAX_TILES) {
+        LOGV("mosaic %dx%d not supported, max %d tiles \n", para->cols, para->rows,
+             MOSAIC_MAX_TILES);
+        return NULL;
+    }
+    mosaic_t *m = (mosaic_t *) malloc(sizeof(mosaic_t));
+    if (!m) {
+        return NULL;
+    }
+    memset(m, 0, sizeof(mosaic_t));
+    m->para = *para;
+    // even cells keep the half size chroma cells aligned with the luma ones
+    m->para.cellWidth = (para->cellWidth + 1) & ~1;
+    m->para.cellHeight = (para->cellHeight + 1) & ~1;
+    m->atlasWidth = m->para.cols * m->para.cellWidth;
+    m->atlasHeight = m->para.rows * m->para.cellHeight;
+    dt_lock_init(&m->lock, NULL);
+    pthread_cond_init(&m->drawn, NULL);
+    gl_state_reset(&m->gl);
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (m->atlasWidth > maxTextureSize || m->atlasHeight > maxTextureSize) {
+        LOGV("mosaic atlas %dx%d exceeds max texture size %d \n", m->atlasWidth,
+             m->atlasHeight, maxTextureSize);
+        pthread_cond_destroy(&m->drawn);
+        free(m);
+        return NULL;
+    }
+
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    m->hasUnpackRowLength = (version && strstr(version, "OpenGL ES 3.") != NULL) ||
+                            (extensions && strstr(extensions, "GL_EXT_unpack_subimage") != NULL);
+    m->stagingSize = (m->para.cellWidth > MOSAIC_STAGING_SIZE) ? m->para.cellWidth :
+                     MOSAIC_STAGING_SIZE;
+    m->staging = (uint8_t *) malloc(m->stagingSize);
+    if (!m->staging || setupProgram(m) < 0) {
+        mosaic_destroy(m);
+        return NULL;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(3, m->textures);
+    for (int i = 0; i < 3; i++) {
+        int w = i ? m->atlasWidth / 2 : m->atlasWidth;
+        int h = i ? m->atlasHeight / 2 : m->atlasHeight;
+        gl_bind_texture(&m->gl, i, m->textures[i]);
+        // tiles are mostly shrunk on screen
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, w, h, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+    }
+    checkGlError("mosaic_create");
+    LOGV("mosaic %dx%d created, cell %dx%d atlas %dx%d \n", m->para.cols, m->para.rows,
+         m->para.cellWidth, m->para.cellHeight, m->atlasWidth, m->atlasHeight);
+    return m;
+}
+
+void mosaic_destroy(mosaic_t *m) {
+    if (!m) {
+        return;
+    }
+    for (int i = 0; i < MOSAIC_MAX_TILES; i++) {
+        mosaic_set_source(m, i, NULL);
+    }
+    if (m->textures[0]) {
+        gl_delete_textures(&m->gl, 3, m->textures);
+    }
+    if (m->program) {
+        glDeleteProgram(m->program);
+    }
+    free(m->staging);
+    pthread_cond_destroy(&m->drawn);
+    free(m);
+}
+
+int mosaic_set_source(mosaic_t *m, int tile, yuv_renderer_t *renderer) {
+    if (tile < 0 || tile >= m->para.cols * m->para.rows) {
+        return -1;
+    }
+    dt_lock(&m->lock);
+    mosaic_tile_t *t = &m->tiles[tile];
+    yuv_renderer_t *old = t->renderer;
+    int serial = t->serial + 1;
+    // the GL side (yuv_dttv_init) is taken over by the next mosaic_draw
+    memset(t, 0, sizeof(mosaic_tile_t));
+    t->renderer = renderer;
+    t->serial = serial;
+    m->geometryDirty = 1;
+    // a running draw may still hold the old source
+    while (old && m->drawing) {
+        pthread_cond_wait(&m->drawn, &m->lock);
+    }
+    dt_unlock(&m->lock);
+    return 0;
+}
+
+void mosaic_set_viewport(mosaic_t *m, int width, int height) {
+    glViewport(0, 0, width, height);
+    dt_lock(&m->lock);
+    m->viewportWidth = width;
+    m->viewportHeight = height;
+    m->geometryDirty = 1;
+    dt_unlock(&m->lock);
+}
+
+/*
+ * copy a w x h region into an atlas texture, taking every pixStride-th
+ * byte of every rowStride-th row of src; shift > 0 reads little-endian
+ * 16-bit samples there and keeps their top 8 bits
+ */
+static void uploadRegion(mosaic_t *m, int plane, int x, int y, int w, int h, const uint8_t *src,
+                         int pixStride, int rowStride, int shift) {
+    // each plane on the unit it is drawn from, the draw then binds nothing
+    gl_bind_texture(&m->gl, plane, m->textures[plane]);
+    if (pixStride == 1 && rowStride == w) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_LUMINANCE, GL_UNSIGNED_BYTE, src);
+        return;
+    }
+    if (pixStride == 1 && m->hasUnpackRowLength) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, rowStride);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_LUMINANCE, GL_UNSIGNED_BYTE, src);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    int bandRows = m->stagingSize / w;
+    for (int row = 0; row < h; row += bandRows) {
+        int rows = (h - row < bandRows) ? h - row : bandRows;
+        for (int r = 0; r < rows; r++) {
+            const uint8_t *s = src + (row + r) * rowStride;
+            uint8_t *d = m->staging + r * w;
+            if (pixStride == 1) {
+                memcpy(d, s, w);
+            } else if (shift) {
+                // previews are 8-bit anyway, the atlas stays one format
+                for (int i = 0; i < w; i++) {
+                    d[i] = (uint8_t) ((s[i * pixStride] | (s[i * pixStride + 1] << 8)) >> shift);
+                }
+            } else {
+                for (int i = 0; i < w; i++) {
+                    d[i] = s[i * pixStride];
+                }
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y + row, w, rows, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                        m->staging);
+    }
+}
+
+/*
+ * into the cell of tile index, tile is the draw's copy
+ * @return 1 when the geometry has to be rebuilt
+ */
+static int uploadTile(mosaic_t *m, int index, mosaic_tile_t *tile, dt_av_frame_t *frame) {
+    yuv_format_t fmt;
+    yuv_planes_t planes;
+    yuv_get_format(frame->pixfmt, &fmt);
+    yuv_get_planes(frame, &fmt, &planes);
+
+    // integer decimation keeps the fit a strided copy, previews do not
+    // need better than nearest
+    int step = 1;
+    while ((frame->width + step - 1) / step > m->para.cellWidth ||
+           (frame->height + step - 1) / step > m->para.cellHeight) {
+        step++;
+    }
+    int w = (frame->width + step - 1) / step;
+    int h = (frame->height + step - 1) / step;
+    int x = (index % m->para.cols) * m->para.cellWidth;
+    int y = (index / m->para.cols) * m->para.cellHeight;
+
+    int bpp = planes.bpp[0];
+    int shift = fmt.depth - 8;
+    uploadRegion(m, 0, x, y, w, h, planes.data[0], step * bpp, step * planes.linesize[0], shift);
+
+    // atlas chroma is 4:2:0, take the source sample under each atlas sample
+    int stepX = (2 * step) >> fmt.chromaShiftW;
+    int stepY = (2 * step) >> fmt.chromaShiftH;
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+    if (planes.count == 3) {
+        uploadRegion(m, 1, x / 2, y / 2, cw, ch, planes.data[1], stepX * bpp,
+                     stepY * planes.linesize[1], shift);
+        uploadRegion(m, 2, x / 2, y / 2, cw, ch, planes.data[2], stepX * bpp,
+                     stepY * planes.linesize[2], shift);
+    } else {
+        int u = (fmt.layout == YUV_LAYOUT_NV21) ? 1 : 0;
+        uploadRegion(m, 1, x / 2, y / 2, cw, ch, planes.data[1] + u, 2 * stepX,
+                     stepY * planes.linesize[1], 0);
+        uploadRegion(m, 2, x / 2, y / 2, cw, ch, planes.data[1] + 1 - u, 2 * stepX,
+                     stepY * planes.linesize[1], 0);
+    }
+
+    int bt709 = (frame->height >= YUV_HD_HEIGHT);
+    int changed = 0;
+    if (!tile->shown || tile->frameWidth != frame->width || tile->frameHeight != frame->height ||
+        tile->width != w || tile->height != h || tile->bt709 != bt709 ||
+        tile->fullRange != fmt.fullRange) {
+        changed = 1;
+    }
+    tile->shown = 1;
+    tile->frameWidth = frame->width;
+    tile->frameHeight = frame->height;
+    tile->width = w;
+    tile->height = h;
+    tile->bt709 = bt709;
+    tile->fullRange = fmt.fullRange;
+    return changed;
+}
+
+static void buildGeometry(mosaic_t *m) {
+    GLfloat cellW = 2.0f / m->para.cols;
+    GLfloat cellH = 2.0f / m->para.rows;
+    int n = 0;
+
+    for (int i = 0; i < m->para.cols * m->para.rows; i++) {
+        mosaic_tile_t *tile = &m->tiles[i];
+        if (!tile->renderer || !tile->shown) {
+            continue;
+        }
+        // fit the picture into its grid cell, keep the aspect ratio
+        GLfloat sx = 1.0f, sy = 1.0f;
+        if (m->viewportWidth > 0 && m->viewportHeight > 0) {
+            GLfloat cellAspect = ((GLfloat) m->viewportWidth / m->para.cols) /
+                                 ((GLfloat) m->viewportHeight / m->para.rows);
+            GLfloat aspect = (GLfloat) tile->frameWidth / tile->frameHeight;
+            if (aspect > cellAspect) {
+                sy = cellAspect / aspect;
+            } else {
+                sx = aspect / cellAspect;
+            }
+        }
+        GLfloat cx = -1.0f + cellW * (i % m->para.cols + 0.5f);
+        GLfloat cy = 1.0f - cellH * (i / m->para.cols + 0.5f);
+        GLfloat x0 = cx - cellW * sx / 2, x1 = cx + cellW * sx / 2;
+        GLfloat y0 = cy - cellH * sy / 2, y1 = cy + cellH * sy / 2;
+
+        // one luma texel (half a chroma texel) inset, linear filtering must
+        // not pull in the neighbour cell
+        int inset = (tile->width > 2 && tile->height > 2) ? 1 : 0;
+        int ax = (i % m->para.cols) * m->para.cellWidth;
+        int ay = (i / m->para.cols) * m->para.cellHeight;
+        GLfloat u0 = (GLfloat) (ax + inset) / m->atlasWidth;
+        GLfloat u1 = (GLfloat) (ax + tile->width - inset) / m->atlasWidth;
+        GLfloat v0 = (GLfloat) (ay + inset) / m->atlasHeight;
+        GLfloat v1 = (GLfloat) (ay + tile->height - inset) / m->atlasHeight;
+
+        GLfloat corners[4][4] = {
+                // X, Y, U, V
+                {x0, y0, u0, v1}, // Bottom Left
+                {x1, y0, u1, v1}, // Bottom Right
+                {x1, y1, u1, v0}, // Top Right
+                {x0, y1, u0, v0}, // Top Left
+        };
+        GLfloat *v = &m->vertices[n * 4 * MOSAIC_VERTEX_SIZE];
+        for (int c = 0; c < 4; c++) {
+            memcpy(v, corners[c], sizeof(corners[c]));
+            v[4] = (GLfloat) tile->bt709;
+            v[5] = (GLfloat) tile->fullRange;
+            v += MOSAIC_VERTEX_SIZE;
+        }
+        static const GLubyte quad[6] = {0, 3, 2, 0, 2, 1};
+        for (int k = 0; k < 6; k++) {
+            m->indices[n * 6 + k] = (GLubyte) (n * 4 + quad[k]);
+        }
+        n++;
+    }
+    m->indexCount = n * 6;
+    m->geometryDirty = 0;
+}
+
+int mosaic_draw(mosaic_t *m) {
+    mosaic_tile_t tiles[MOSAIC_MAX_TILES];
+    int idle[MOSAIC_MAX_TILES];
+    int changed[MOSAIC_MAX_TILES];
+    int sources = 0, allIdle = 1, parked = 1;
+    int count = m->para.cols * m->para.rows;
+
+    // uploads run on a copy of the tiles, mosaic_set_source waits for them
+    // to end before it hands a detached renderer back
+    dt_lock(&m->lock);
+    memcpy(tiles, m->tiles, count * sizeof(mosaic_tile_t));
+    m->drawing = 1;
+    dt_unlock(&m->lock);
+
+    int64_t start = dt_gettime();
+    for (int i = 0; i < count; i++) {
+        mosaic_tile_t *tile = &tiles[i];
+        changed[i] = 0;
+        if (!tile->renderer) {
+            continue;
+        }
+        sources++;
+        if (!tile->attached) {
+            // the mosaic is the renderer's GL side from now on
+            yuv_dttv_init(tile->renderer);
+            tile->attached = 1;
+        }
+        // update on change: a tile without a due frame keeps its cell
+        dt_av_frame_t *frame = yuv_acquire_frame(tile->renderer, &idle[i]);
+        if (frame) {
+            changed[i] = uploadTile(m, i, tile, frame);
+            yuv_release_frame(tile->renderer, frame);
+            m->stat.uploads++;
+        } else if (tile->shown) {
+            m->stat.unchanged++;
+        }
+        allIdle = allIdle && idle[i];
+    }
+    m->stat.upload_us += dt_gettime() - start;
+
+    // park only when every source is idle, each then wakes us on its own
+    for (int i = 0; i < count; i++) {
+        if (tiles[i].renderer) {
+            parked = yuv_park(tiles[i].renderer, allIdle) && parked;
+        }
+    }
+
+    // a tile whose source was set meanwhile stays as mosaic_set_source left it
+    dt_lock(&m->lock);
+    for (int i = 0; i < count; i++) {
+        if (tiles[i].renderer && m->tiles[i].serial == tiles[i].serial) {
+            m->tiles[i] = tiles[i];
+            m->geometryDirty = m->geometryDirty || changed[i];
+        }
+    }
+    if (m->geometryDirty) {
+        buildGeometry(m);
+    }
+    m->drawing = 0;
+    pthread_cond_broadcast(&m->drawn);
+    dt_unlock(&m->lock);
+
+    // vertices and indices are only written on this thread
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (m->indexCount > 0) {
+        gl_use_program(&m->gl, m->program);
+        for (int i = 0; i < 3; i++) {
+            gl_bind_texture(&m->gl, i, m->textures[i]);
+        }
+        // geometry changes with the tiles, it stays in client arrays
+        gl_bind_buffer(&m->gl, GL_ARRAY_BUFFER, 0);
+        gl_bind_buffer(&m->gl, GL_ELEMENT_ARRAY_BUFFER, 0);
+        if (gl_state_attribs(&m->gl, m->program, m->vertices)) {
+            GLsizei stride = MOSAIC_VERTEX_SIZE * sizeof(GLfloat);
+            glVertexAttribPointer(m->positionHandle, 2, GL_FLOAT, false, stride, m->vertices);
+            glEnableVertexAttribArray(m->positionHandle);
+            glVertexAttribPointer(m->textureHandle, 2, GL_FLOAT, false, stride, &m->vertices[2]);
+            glEnableVertexAttribArray(m->textureHandle);
+            glVertexAttribPointer(m->matrixHandle, 2, GL_FLOAT, false, stride, &m->vertices[4]);
+            glEnableVertexAttribArray(m->matrixHandle);
+        }
+        // the whole grid in one call
+        glDrawElements(GL_TRIANGLES, m->indexCount, GL_UNSIGNED_BYTE, m->indices);
+        checkGlError("mosaic_draw");
+    }
+
+    if (++m->stat.draws % MOSAIC_STAT_DRAWS == 0) {
+        LOGV("mosaic draws:%d uploads:%d unchanged:%d upload avg:%lld us/draw \n", m->stat.draws,
+             m->stat.uploads, m->stat.unchanged, (long long) (m->stat.upload_us / m->stat.draws));
+    }
+    return (sources == 0 || parked) ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+//
+// gl_mosaic - draw the frames of several players as one grid.
+//
+// Every tile owns a cell of one Y/U/V atlas. Per vsync the mosaic asks each
+// source renderer for its due frame and uploads only the tiles that changed,
+// then draws the whole grid with a single program bind and a single draw
+// call. Color matrix and range travel per vertex, so tiles of different
+// formats still share the program.
+//
+// A renderer used as a mosaic source must not be drawn by its own GL view
+// at the same time, both would consume its frames.
+//
+
+#ifndef GLES2JNI_GL_MOSAIC_H
+#define GLES2JNI_GL_MOSAIC_H
+
+#include "gl_yuv.h"
+
+#define MOSAIC_MAX_TILES 16
+
+typedef struct {
+    int cols;
+    int rows;
+    int cellWidth;      // atlas cell, larger frames are decimated to fit
+    int cellHeight;
+} mosaic_para_t;
+
+typedef struct mosaic mosaic_t;
+
+/*
+ * GL thread, with the context current
+ * @return NULL if the atlas does not fit GL_MAX_TEXTURE_SIZE
+ */
+mosaic_t *mosaic_create(const mosaic_para_t *para);
+
+/*
+ * GL thread; sources are detached, not destroyed
+ */
+void mosaic_destroy(mosaic_t *m);
+
+/*
+ * any thread; renderer NULL empties the tile. The source is taken over on
+ * the GL thread by the next mosaic_draw, so one has to be requested. Once
+ * this returns the mosaic no longer touches a detached renderer, it waits
+ * out a draw still uploading from it.
+ */
+int mosaic_set_source(mosaic_t *m, int tile, yuv_renderer_t *renderer);
+
+/*
+ * GL thread, from onSurfaceChanged
+ */
+void mosaic_set_viewport(mosaic_t *m, int width, int height);
+
+/*
+ * draw callback, once per vsync
+ * @return 1 when every source went idle, 0 otherwise
+ */
+int mosaic_draw(mosaic_t *m);
+
+#endif //GLES2JNI_GL_MOSAIC_H
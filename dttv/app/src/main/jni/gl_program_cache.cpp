@@ -0,0 +1,306 @@
+//
+// gl_program_cache - keep linked GL programs as driver binaries.
+//
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "native_log.h"
+#include "gl_util.h"
+#include "gl_program_cache.h"
+#include "dt_lock.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_time.h"
+}
+
+#define TAG "GL-PROGRAM-CACHE"
+
+#define CACHE_MAGIC       0x42505444  // "DTPB"
+#define CACHE_VERSION     1
+#define CACHE_MAX_ENTRIES 32          // a handful of yuv variants per driver
+#define CACHE_FILE_PREFIX "dttv_prog_"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t driver;
+    uint32_t format;
+    uint32_t length;
+} cache_header_t;
+
+typedef struct {
+    uint64_t key;
+    uint64_t driver;
+    GLenum format;
+    GLsizei length;
+    void *data;
+} cache_entry_t;
+
+static dt_lock_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_cacheDir[PATH_MAX];
+static cache_entry_t g_entries[CACHE_MAX_ENTRIES];
+static int g_entryCount = 0;
+
+// the driver's entry points, refreshed by setupProgramCache under g_lock;
+// the contexts of a process share one driver
+static PFNGLGETPROGRAMBINARYOESPROC g_getProgramBinary = NULL;
+static PFNGLPROGRAMBINARYOESPROC g_programBinary = NULL;
+static uint64_t g_driver = 0;
+
+static uint64_t hashString(uint64_t h, const char *s) {
+    // FNV-1a, stable across runs so it can name files
+    if (!s) {
+        return h;
+    }
+    while (*s) {
+        h ^= (uint8_t) *s++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+void setProgramCacheDir(const char *dir) {
+    dt_lock(&g_lock);
+    if (dir && strlen(dir) < sizeof(g_cacheDir)) {
+        strcpy(g_cacheDir, dir);
+    } else {
+        g_cacheDir[0] = '\0';
+    }
+    dt_unlock(&g_lock);
+    LOGV("program cache dir:%s \n", dir ? dir : "none");
+}
+
+void setupProgramCache() {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+
+    PFNGLGETPROGRAMBINARYOESPROC getProgramBinary = NULL;
+    PFNGLPROGRAMBINARYOESPROC programBinary = NULL;
+    if (extensions && strstr(extensions, "GL_OES_get_program_binary")) {
+        getProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinaryOES");
+        programBinary = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinaryOES");
+    } else if (version && strstr(version, "OpenGL ES 3.")) {
+        // core in GLES3, same signature and enums as the OES entry points
+        getProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinary");
+        programBinary = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinary");
+    }
+
+    GLint formats = 0;
+    if (getProgramBinary && programBinary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    }
+    if (formats <= 0) {
+        // extension advertised without any format is useless
+        getProgramBinary = NULL;
+        programBinary = NULL;
+    }
+    checkGlError("setupProgramCache");
+
+    uint64_t driver = hashString(HASH_INIT, (const char *) glGetString(GL_RENDERER));
+    driver = hashString(driver, version);
+
+    // another context's thread may be in createCachedProgram
+    dt_lock(&g_lock);
+    g_getProgramBinary = getProgramBinary;
+    g_programBinary = programBinary;
+    g_driver = driver;
+    dt_unlock(&g_lock);
+    LOGV("program binary %s, formats:%d \n", programBinary ? "supported" : "not supported",
+         formats);
+}
+
+static void buildPath(char *path, int size, uint64_t key) {
+    snprintf(path, size, "%s/" CACHE_FILE_PREFIX "%016llx.bin", g_cacheDir,
+             (unsigned long long) key);
+}
+
+static cache_entry_t *findEntry(uint64_t key) {
+    for (int i = 0; i < g_entryCount; i++) {
+        if (g_entries[i].key == key && g_entries[i].driver == g_driver) {
+            return &g_entries[i];
+        }
+    }
+    return NULL;
+}
+
+// takes ownership of data
+static cache_entry_t *addEntry(uint64_t key, GLenum format, GLsizei length, void *data) {
+    cache_entry_t *entry = findEntry(key);
+    if (!entry) {
+        if (g_entryCount == CACHE_MAX_ENTRIES) {
+            // full: drop the oldest, it is most likely from a previous driver
+            free(g_entries[0].data);
+            memmove(&g_entries[0], &g_entries[1], (CACHE_MAX_ENTRIES - 1) * sizeof(cache_entry_t));
+            g_entryCount--;
+        }
+        entry = &g_entries[g_entryCount++];
+    } else {
+        free(entry->data);
+    }
+    entry->key = key;
+    entry->driver = g_driver;
+    entry->format = format;
+    entry->length = length;
+    entry->data = data;
+    return entry;
+}
+
+static void dropEntry(uint64_t key) {
+    cache_entry_t *entry = findEntry(key);
+    if (!entry) {
+        return;
+    }
+    free(entry->data);
+    int index = entry - g_entries;
+    memmove(entry, entry + 1, (g_entryCount - index - 1) * sizeof(cache_entry_t));
+    g_entryCount--;
+}
+
+static cache_entry_t *loadFile(uint64_t key) {
+    char path[PATH_MAX + 64];
+    if (!g_cacheDir[0]) {
+        return NULL;
+    }
+    buildPath(path, sizeof(path), key);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    cache_header_t header;
+    void *data = NULL;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION || header.key != key || header.driver != g_driver ||
+        header.length == 0) {
+        LOGV("stale program binary %s \n", path);
+        goto FAIL;
+    }
+    data = malloc(header.length);
+    if (!data || fread(data, 1, header.length, fp) != header.length) {
+        goto FAIL;
+    }
+    fclose(fp);
+    return addEntry(key, header.format, header.length, data);
+
+    FAIL:
+    free(data);
+    fclose(fp);
+    unlink(path);
+    return NULL;
+}
+
+static void storeFile(cache_entry_t *entry) {
+    char path[PATH_MAX + 64];
+    char tmp[PATH_MAX + 72];
+    if (!g_cacheDir[0]) {
+        return;
+    }
+    buildPath(path, sizeof(path), entry->key);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        LOGV("can not write program binary %s \n", tmp);
+        return;
+    }
+
+    cache_header_t header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.key = entry->key;
+    header.driver = entry->driver;
+    header.format = entry->format;
+    header.length = (uint32_t) entry->length;
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(entry->data, 1, entry->length, fp) == (size_t) entry->length;
+    ok = (fclose(fp) == 0) && ok;
+    // rename so a crash never leaves a truncated binary behind
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
+
+static GLuint programFromBinary(cache_entry_t *entry) {
+    GLuint program = glCreateProgram();
+    if (!program) {
+        return 0;
+    }
+    g_programBinary(program, entry->format, entry->data, entry->length);
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (linkStatus != GL_TRUE) {
+        // driver refused it, e.g. updated without changing its version string
+        glDeleteProgram(program);
+        glGetError();
+        return 0;
+    }
+    return program;
+}
+
+static void saveBinary(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return;
+    }
+    void *data = malloc(length);
+    if (!data) {
+        return;
+    }
+    GLenum format = 0;
+    GLsizei written = 0;
+    g_getProgramBinary(program, length, &written, &format, data);
+    if (glGetError() != GL_NO_ERROR || written <= 0) {
+        free(data);
+        return;
+    }
+    storeFile(addEntry(key, format, written, data));
+}
+
+GLuint createCachedProgram(const char *pVertexSource, const char *pFragmentSource) {
+    int64_t start = dt_gettime();
+    uint64_t key = hashString(hashString(HASH_INIT, pVertexSource), pFragmentSource);
+    GLuint program = 0;
+    const char *from = "memory";
+
+    // the entry points and driver tag are read under the lock from here on
+    dt_lock(&g_lock);
+    if (!g_programBinary) {
+        dt_unlock(&g_lock);
+        return createProgram(pVertexSource, pFragmentSource);
+    }
+    cache_entry_t *entry = findEntry(key);
+    if (!entry) {
+        entry = loadFile(key);
+        from = "disk";
+    }
+    if (entry) {
+        program = programFromBinary(entry);
+        if (!program) {
+            dropEntry(key);
+        }
+    }
+    if (!program) {
+        from = "source";
+        program = createProgram(pVertexSource, pFragmentSource);
+        if (program) {
+            saveBinary(key, program);
+        }
+    }
+    dt_unlock(&g_lock);
+
+    LOGV("program %016llx from %s in %lld us \n", (unsigned long long) key, from,
+         (long long) (dt_gettime() - start));
+    return program;
+}
@@ -0,0 +1,31 @@
+//
+// gl_program_cache - keep linked GL programs as driver binaries so a new
+// EGL context (surface recreation, cold start) skips shader compilation.
+//
+// Binaries live in memory for the process lifetime and, once a cache
+// directory is set, on disk. Both are keyed by the shader sources and
+// tagged with GL_RENDERER/GL_VERSION, a driver update just misses.
+//
+
+#ifndef GLES2JNI_GL_PROGRAM_CACHE_H
+#define GLES2JNI_GL_PROGRAM_CACHE_H
+
+#include <GLES2/gl2.h>
+
+/*
+ * directory for persisted binaries, NULL disables the disk cache
+ * may be called from any thread
+ */
+void setProgramCacheDir(const char *dir);
+
+/*
+ * bind the cache to the current context, call after every context creation
+ */
+void setupProgramCache();
+
+/*
+ * same contract as createProgram(), served from a cached binary when possible
+ */
+GLuint createCachedProgram(const char *pVertexSource, const char *pFragmentSource);
+
+#endif //GLES2JNI_GL_PROGRAM_CACHE_H
@@ -0,0 +1,270 @@
+//
+// gl_render_thread - native render loop with its own EGL context.
+//
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __ANDROID__
+#include <android/native_window.h>
+#endif
+
+#include "native_log.h"
+#include "native_atomic.h"
+#include "gl_yuv.h"
+#include "gl_render_thread.h"
+#include "dt_lock.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_time.h"
+}
+
+#define TAG "GL-RENDER-THREAD"
+
+#define RENDER_STAT_LOOPS 600
+
+struct render_thread {
+    render_thread_para_t para;
+    pthread_t tid;
+
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+
+    dt_lock_t lock;
+    pthread_cond_t cond;
+    int ready;          // 1 running, -1 EGL setup failed
+    int quit;
+    int wake;
+    int64_t wake_time;
+
+    render_thread_stat_t stat;
+};
+
+static int egl_setup(render_thread_t *rt) {
+    int window = (rt->para.window != 0);
+    EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, window ? EGL_WINDOW_BIT : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_NONE
+    };
+    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    EGLConfig config;
+    EGLint numConfigs = 0;
+
+    rt->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (rt->display == EGL_NO_DISPLAY || !eglInitialize(rt->display, NULL, NULL)) {
+        LOGV("egl init failed, error:0x%x \n", eglGetError());
+        return -1;
+    }
+    if (!eglChooseConfig(rt->display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        LOGV("no egl config, error:0x%x \n", eglGetError());
+        return -1;
+    }
+
+    if (window) {
+#ifdef __ANDROID__
+        // match the window buffers to the config, avoids a conversion blit
+        EGLint format;
+        eglGetConfigAttrib(rt->display, config, EGL_NATIVE_VISUAL_ID, &format);
+        ANativeWindow_setBuffersGeometry((ANativeWindow *) rt->para.window, 0, 0, format);
+#endif
+        rt->surface = eglCreateWindowSurface(rt->display, config, rt->para.window, NULL);
+    } else {
+        EGLint pbufferAttribs[] = {EGL_WIDTH, rt->para.width, EGL_HEIGHT, rt->para.height, EGL_NONE};
+        rt->surface = eglCreatePbufferSurface(rt->display, config, pbufferAttribs);
+    }
+    if (rt->surface == EGL_NO_SURFACE) {
+        LOGV("create surface failed, error:0x%x \n", eglGetError());
+        return -1;
+    }
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+    rt->context = eglCreateContext(rt->display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (rt->context == EGL_NO_CONTEXT) {
+        LOGV("create context failed, error:0x%x \n", eglGetError());
+        return -1;
+    }
+    if (!eglMakeCurrent(rt->display, rt->surface, rt->surface, rt->context)) {
+        LOGV("make current failed, error:0x%x \n", eglGetError());
+        return -1;
+    }
+    // swap blocks until the next refresh, that is our vsync
+    eglSwapInterval(rt->display, 1);
+    LOGV("egl setup ok, %s \n", window ? "window" : "pbuffer");
+    return 0;
+}
+
+static void egl_teardown(render_thread_t *rt) {
+    if (rt->display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(rt->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (rt->context != EGL_NO_CONTEXT) {
+        eglDestroyContext(rt->display, rt->context);
+    }
+    if (rt->surface != EGL_NO_SURFACE) {
+        eglDestroySurface(rt->display, rt->surface);
+    }
+    // no eglTerminate, the display is shared with the rest of the process
+    eglReleaseThread();
+}
+
+// producer side, called from yuv_update_frame when the loop is parked
+static void render_wakeup(void *opaque) {
+    render_thread_t *rt = (render_thread_t *) opaque;
+    dt_lock(&rt->lock);
+    if (!rt->wake) {
+        rt->wake = 1;
+        rt->wake_time = dt_gettime();
+    }
+    pthread_cond_signal(&rt->cond);
+    dt_unlock(&rt->lock);
+}
+
+static void render_loop(render_thread_t *rt) {
+    int width = 0, height = 0;
+    int64_t wake_time = 0;
+    int64_t tick = 0;
+
+    while (!dt_atomic_load(&rt->quit)) {
+        EGLint w = 0, h = 0;
+        eglQuerySurface(rt->display, rt->surface, EGL_WIDTH, &w);
+        eglQuerySurface(rt->display, rt->surface, EGL_HEIGHT, &h);
+        if (w != width || h != height) {
+            width = w;
+            height = h;
+            yuv_setupGraphics(rt->para.renderer, width, height);
+        }
+
+        int64_t start = dt_gettime();
+        int idle = yuv_renderFrame(rt->para.renderer);
+        int64_t drawn = dt_gettime();
+        if (wake_time) {
+            rt->stat.wake_us += drawn - wake_time;
+            wake_time = 0;
+        }
+        if (!eglSwapBuffers(rt->display, rt->surface)) {
+            // window went away under us, wait for render_thread_destroy
+            LOGV("swap failed, error:0x%x, render loop stops \n", eglGetError());
+            break;
+        }
+        int64_t swapped = dt_gettime();
+        rt->stat.draw_us += drawn - start;
+        rt->stat.swap_us += swapped - drawn;
+        if (++rt->stat.loops % RENDER_STAT_LOOPS == 0) {
+            LOGV("loops:%d wakeups:%d draw avg:%lld us swap avg:%lld us \n", rt->stat.loops,
+                 rt->stat.wakeups, (long long) (rt->stat.draw_us / rt->stat.loops),
+                 (long long) (rt->stat.swap_us / rt->stat.loops));
+        }
+
+        if (!rt->para.window && rt->para.pace_us > 0) {
+            // pbuffer swaps do not wait for anything, fake the refresh; a
+            // late loop waits for the next tick like it would for vsync
+            if (!tick) {
+                tick = swapped;
+            }
+            tick += ((swapped - tick) / rt->para.pace_us + 1) * rt->para.pace_us;
+            dt_usleep((unsigned) (tick - swapped));
+        }
+
+        dt_lock(&rt->lock);
+        if (!idle) {
+            // wake raised before this draw already got its frame
+            rt->wake = 0;
+            dt_unlock(&rt->lock);
+            continue;
+        }
+        while (!rt->wake && !rt->quit) {
+            pthread_cond_wait(&rt->cond, &rt->lock);
+        }
+        if (rt->wake) {
+            rt->stat.wakeups++;
+            wake_time = rt->wake_time;
+            rt->wake = 0;
+        }
+        dt_unlock(&rt->lock);
+        tick = 0;
+    }
+}
+
+static void *render_thread_main(void *arg) {
+    render_thread_t *rt = (render_thread_t *) arg;
+    int ret = egl_setup(rt);
+    if (ret == 0) {
+        // fresh context, same as onSurfaceCreated on the GlVideoView path
+        yuv_dttv_init(rt->para.renderer);
+        yuv_set_wakeup(rt->para.renderer, render_wakeup, rt);
+    }
+
+    dt_lock(&rt->lock);
+    rt->ready = (ret == 0) ? 1 : -1;
+    pthread_cond_broadcast(&rt->cond);
+    dt_unlock(&rt->lock);
+
+    if (ret == 0) {
+        render_loop(rt);
+        yuv_set_wakeup(rt->para.renderer, NULL, NULL);
+    }
+    egl_teardown(rt);
+    return NULL;
+}
+
+render_thread_t *render_thread_create(const render_thread_para_t *para) {
+    render_thread_t *rt = (render_thread_t *) malloc(sizeof(render_thread_t));
+    if (!rt) {
+        return NULL;
+    }
+    memset(rt, 0, sizeof(render_thread_t));
+    rt->para = *para;
+    rt->display = EGL_NO_DISPLAY;
+    rt->surface = EGL_NO_SURFACE;
+    rt->context = EGL_NO_CONTEXT;
+    dt_lock_init(&rt->lock, NULL);
+    pthread_cond_init(&rt->cond, NULL);
+
+    if (pthread_create(&rt->tid, NULL, render_thread_main, rt) != 0) {
+        LOGV("create render thread failed \n");
+        free(rt);
+        return NULL;
+    }
+
+    dt_lock(&rt->lock);
+    while (rt->ready == 0) {
+        pthread_cond_wait(&rt->cond, &rt->lock);
+    }
+    dt_unlock(&rt->lock);
+    if (rt->ready < 0) {
+        pthread_join(rt->tid, NULL);
+        free(rt);
+        return NULL;
+    }
+    LOGV("render thread started \n");
+    return rt;
+}
+
+void render_thread_destroy(render_thread_t *rt) {
+    if (!rt) {
+        return;
+    }
+    dt_lock(&rt->lock);
+    rt->quit = 1;
+    pthread_cond_signal(&rt->cond);
+    dt_unlock(&rt->lock);
+    pthread_join(rt->tid, NULL);
+
+    LOGV("render thread exit, loops:%d wakeups:%d \n", rt->stat.loops, rt->stat.wakeups);
+    pthread_cond_destroy(&rt->cond);
+    free(rt);
+}
+
+void render_thread_get_stat(render_thread_t *rt, render_thread_stat_t *stat) {
+    memcpy(stat, &rt->stat, sizeof(render_thread_stat_t));
+}
@@ -0,0 +1,45 @@
+//
+// gl_render_thread - native render loop with its own EGL context.
+//
+// Alternative to the GlVideoView path: frames go from the vo plugin to
+// eglSwapBuffers on a native thread, no JNI callback, Handler or
+// requestRender per frame. With no window it renders into a pbuffer,
+// that is how the renderer core runs on desktop Mesa.
+//
+
+#ifndef GLES2JNI_GL_RENDER_THREAD_H
+#define GLES2JNI_GL_RENDER_THREAD_H
+
+#include <stdint.h>
+#include <EGL/egl.h>
+#include "gl_yuv.h"
+
+typedef struct {
+    yuv_renderer_t *renderer;    // what to draw, owned by the caller
+    EGLNativeWindowType window;  // 0 - offscreen pbuffer
+    int width;                   // pbuffer size, ignored for windows
+    int height;
+    int pace_us;                 // pbuffer only: fake refresh period, 0 free run
+} render_thread_para_t;
+
+typedef struct {
+    int loops;          // draw + swap iterations
+    int wakeups;        // times the parked loop was woken by a new frame
+    int64_t draw_us;    // total time in yuv_renderFrame
+    int64_t swap_us;    // total time in eglSwapBuffers
+    int64_t wake_us;    // total wakeup -> first draw latency
+} render_thread_stat_t;
+
+typedef struct render_thread render_thread_t;
+
+/*
+ * starts the thread and waits until its EGL setup finished
+ * @return NULL if EGL setup failed
+ */
+render_thread_t *render_thread_create(const render_thread_para_t *para);
+
+void render_thread_destroy(render_thread_t *rt);
+
+void render_thread_get_stat(render_thread_t *rt, render_thread_stat_t *stat);
+
+#endif //GLES2JNI_GL_RENDER_THREAD_H
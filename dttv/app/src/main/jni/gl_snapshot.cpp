@@ -0,0 +1,313 @@
+//
+// gl_snapshot - grab the frame on screen without stalling the render loop.
+//
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_log.h"
+#include "gl_util.h"
+#include "gl_snapshot.h"
+#include "dt_lock.h"
+
+#define TAG "GL-SNAPSHOT"
+
+// draws to wait for the fence before mapping anyway, the map then blocks
+#define SNAPSHOT_MAX_POLLS 4
+
+// away from the planes (0..2): the FBO texture must not be bound to a
+// sampler the snapshot draw reads from
+#define SNAPSHOT_TEXTURE_UNIT 3
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+// GLES3 entry points, looked up at run time so we keep linking GLESv2 only
+typedef void *(*map_buffer_range_t)(GLenum target, GLintptr offset, GLsizeiptr length,
+                                    GLbitfield access);
+typedef GLboolean (*unmap_buffer_t)(GLenum target);
+typedef void *(*fence_sync_t)(GLenum condition, GLbitfield flags);
+typedef GLenum (*client_wait_sync_t)(void *sync, GLbitfield flags, uint64_t timeout);
+typedef void (*delete_sync_t)(void *sync);
+
+typedef struct {
+    snapshot_cb_t cb;
+    void *opaque;
+    int width;          // as requested
+    int height;
+} snapshot_req_t;
+
+struct snapshot {
+    // any thread -> GL thread
+    dt_lock_t lock;
+    snapshot_req_t pending;
+    int hasPending;
+
+    // GL thread
+    snapshot_req_t flight;
+    int inFlight;
+    int width;          // of the readback
+    int height;
+    int64_t pts;
+    int polls;
+
+    int glReady;
+    int hasPbo;
+    map_buffer_range_t mapBufferRange;
+    unmap_buffer_t unmapBuffer;
+    fence_sync_t fenceSync;
+    client_wait_sync_t clientWaitSync;
+    delete_sync_t deleteSync;
+
+    GLuint fbo;
+    GLuint texture;
+    int fboWidth;
+    int fboHeight;
+    GLint maxSize;
+    GLuint pbo;
+    int pboSize;
+    void *fence;
+    uint8_t *pixels;    // GLES2 readback
+    int pixelsSize;
+};
+
+snapshot_t *snapshot_create() {
+    snapshot_t *s = (snapshot_t *) malloc(sizeof(snapshot_t));
+    if (!s) {
+        return NULL;
+    }
+    memset(s, 0, sizeof(snapshot_t));
+    dt_lock_init(&s->lock, NULL);
+    return s;
+}
+
+void snapshot_destroy(snapshot_t *s) {
+    if (!s) {
+        return;
+    }
+    if (s->hasPending && s->pending.cb) {
+        s->pending.cb(s->pending.opaque, NULL, 0, 0, -1);
+    }
+    if (s->inFlight && s->flight.cb) {
+        s->flight.cb(s->flight.opaque, NULL, 0, 0, -1);
+    }
+    free(s->pixels);
+    free(s);
+}
+
+int snapshot_request(snapshot_t *s, int width, int height, snapshot_cb_t cb, void *opaque) {
+    if (!cb || width < 0 || height < 0) {
+        return -1;
+    }
+    dt_lock(&s->lock);
+    if (s->hasPending) {
+        dt_unlock(&s->lock);
+        return -1;
+    }
+    s->pending.cb = cb;
+    s->pending.opaque = opaque;
+    s->pending.width = width;
+    s->pending.height = height;
+    s->hasPending = 1;
+    dt_unlock(&s->lock);
+    return 0;
+}
+
+void snapshot_reset_gl(snapshot_t *s) {
+    if (s->inFlight && s->flight.cb) {
+        s->flight.cb(s->flight.opaque, NULL, 0, 0, -1);
+    }
+    s->inFlight = 0;
+    // names and the fence died with the old context
+    s->fbo = s->texture = s->pbo = 0;
+    s->fboWidth = s->fboHeight = s->pboSize = 0;
+    s->fence = NULL;
+    s->glReady = 0;
+}
+
+static void setupGL(snapshot_t *s) {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    s->hasPbo = 0;
+    if (version && strstr(version, "OpenGL ES 3.") != NULL) {
+        s->mapBufferRange = (map_buffer_range_t) eglGetProcAddress("glMapBufferRange");
+        s->unmapBuffer = (unmap_buffer_t) eglGetProcAddress("glUnmapBuffer");
+        s->fenceSync = (fence_sync_t) eglGetProcAddress("glFenceSync");
+        s->clientWaitSync = (client_wait_sync_t) eglGetProcAddress("glClientWaitSync");
+        s->deleteSync = (delete_sync_t) eglGetProcAddress("glDeleteSync");
+        s->hasPbo = s->mapBufferRange && s->unmapBuffer && s->fenceSync && s->clientWaitSync &&
+                    s->deleteSync;
+    }
+    GLint maxTexture = 0, maxRenderbuffer = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    s->maxSize = maxTexture < maxRenderbuffer ? maxTexture : maxRenderbuffer;
+    s->glReady = 1;
+    LOGV("snapshot readback through %s \n", s->hasPbo ? "pack buffer" : "deferred glReadPixels");
+}
+
+static int setupTarget(snapshot_t *s, gl_state_t *gl, int width, int height) {
+    if (s->fbo && s->fboWidth == width && s->fboHeight == height) {
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        return 0;
+    }
+    if (!s->fbo) {
+        glGenFramebuffers(1, &s->fbo);
+        glGenTextures(1, &s->texture);
+    }
+    gl_bind_texture(gl, SNAPSHOT_TEXTURE_UNIT, s->texture);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s->texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOGV("snapshot fbo %dx%d incomplete \n", width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        s->fboWidth = s->fboHeight = 0;
+        return -1;
+    }
+    s->fboWidth = width;
+    s->fboHeight = height;
+    checkGlError("snapshot setupTarget");
+    return 0;
+}
+
+static void deliver(snapshot_t *s, const uint8_t *rgba) {
+    s->inFlight = 0;
+    s->flight.cb(s->flight.opaque, rgba, rgba ? s->width : 0, rgba ? s->height : 0, s->pts);
+}
+
+void snapshot_poll(snapshot_t *s) {
+    if (!s->inFlight) {
+        return;
+    }
+    if (!s->hasPbo) {
+        // rendered at least one draw (and swap) ago, the GPU is done with it
+        int size = s->width * s->height * 4;
+        if (size > s->pixelsSize) {
+            free(s->pixels);
+            s->pixels = (uint8_t *) malloc(size);
+            s->pixelsSize = s->pixels ? size : 0;
+        }
+        if (!s->pixels) {
+            deliver(s, NULL);
+            return;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        glReadPixels(0, 0, s->width, s->height, GL_RGBA, GL_UNSIGNED_BYTE, s->pixels);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        checkGlError("snapshot readback");
+        deliver(s, s->pixels);
+        return;
+    }
+
+    GLenum ret = s->clientWaitSync(s->fence, 0, 0);
+    if (ret != GL_ALREADY_SIGNALED && ret != GL_CONDITION_SATISFIED &&
+        ++s->polls < SNAPSHOT_MAX_POLLS) {
+        return;
+    }
+    s->deleteSync(s->fence);
+    s->fence = NULL;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+    const uint8_t *rgba = (const uint8_t *) s->mapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                              s->width * s->height * 4,
+                                                              GL_MAP_READ_BIT);
+    deliver(s, rgba);
+    if (rgba) {
+        s->unmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    checkGlError("snapshot map");
+}
+
+int snapshot_begin(snapshot_t *s, gl_state_t *gl, int frameWidth, int frameHeight) {
+    if (s->inFlight || frameWidth <= 0 || frameHeight <= 0) {
+        return 0;
+    }
+    dt_lock(&s->lock);
+    if (!s->hasPending) {
+        dt_unlock(&s->lock);
+        return 0;
+    }
+    s->flight = s->pending;
+    s->hasPending = 0;
+    dt_unlock(&s->lock);
+
+    if (!s->glReady) {
+        setupGL(s);
+    }
+    int width = s->flight.width;
+    int height = s->flight.height;
+    if (width == 0 && height == 0) {
+        width = frameWidth;
+        height = frameHeight;
+    } else if (width == 0) {
+        width = (int) ((int64_t) height * frameWidth / frameHeight);
+    } else if (height == 0) {
+        height = (int) ((int64_t) width * frameHeight / frameWidth);
+    }
+    if (width > s->maxSize) {
+        width = s->maxSize;
+    }
+    if (height > s->maxSize) {
+        height = s->maxSize;
+    }
+    width = width > 0 ? width : 1;
+    height = height > 0 ? height : 1;
+
+    if (setupTarget(s, gl, width, height) < 0) {
+        s->flight.cb(s->flight.opaque, NULL, 0, 0, -1);
+        return 0;
+    }
+    s->width = width;
+    s->height = height;
+    glViewport(0, 0, width, height);
+    return 1;
+}
+
+void snapshot_end(snapshot_t *s, int64_t pts, int viewportWidth, int viewportHeight) {
+    if (s->hasPbo) {
+        int size = s->width * s->height * 4;
+        if (!s->pbo) {
+            glGenBuffers(1, &s->pbo);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+        if (size > s->pboSize) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            s->pboSize = size;
+        }
+        // with a pack buffer bound this only queues the copy
+        glReadPixels(0, 0, s->width, s->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        s->fence = s->fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        s->polls = 0;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    checkGlError("snapshot end");
+    s->pts = pts;
+    s->inFlight = 1;
+}
+
+int snapshot_busy(snapshot_t *s) {
+    return s->inFlight;
+}
@@ -0,0 +1,67 @@
+//
+// gl_snapshot - grab the frame on screen without stalling the render loop.
+//
+// The frame is drawn again into an FBO at the requested size and read back
+// later: through a pixel pack buffer and a fence on GLES3, with a plain
+// glReadPixels one draw later on GLES2, when the GPU is long done with it.
+// Either way the draw that renders it never waits for the GPU.
+//
+
+#ifndef GLES2JNI_GL_SNAPSHOT_H
+#define GLES2JNI_GL_SNAPSHOT_H
+
+#include <GLES2/gl2.h>
+#include <stdint.h>
+
+#include "gl_util.h"
+
+/*
+ * rgba   - width x height RGBA, rows top down, tightly packed; only valid
+ *          during the call. NULL when the snapshot failed or was dropped.
+ * pts    - of the grabbed frame
+ * called on the GL thread: copy out, encode elsewhere
+ */
+typedef void (*snapshot_cb_t)(void *opaque, const uint8_t *rgba, int width, int height,
+                              int64_t pts);
+
+typedef struct snapshot snapshot_t;
+
+snapshot_t *snapshot_create();
+
+/*
+ * pending/in flight callbacks get NULL, GL objects are left to their context
+ */
+void snapshot_destroy(snapshot_t *s);
+
+/*
+ * any thread; width/height 0 follow the frame aspect ratio, both 0 the
+ * frame size
+ * @return -1 when a request is already pending
+ */
+int snapshot_request(snapshot_t *s, int width, int height, snapshot_cb_t cb, void *opaque);
+
+/*
+ * new GL context, an in flight readback is reported failed
+ */
+void snapshot_reset_gl(snapshot_t *s);
+
+/*
+ * GL thread, after the frame was drawn:
+ * poll  - finish a readback started on an earlier draw, cheap if none
+ * begin - 1 when a request waits: the FBO is bound at the target size and
+ *         the caller draws the frame, full texture, rows top down; binds
+ *         go through gl, see gl_util.h
+ * end   - start the readback, restores the default framebuffer
+ */
+void snapshot_poll(snapshot_t *s);
+
+int snapshot_begin(snapshot_t *s, gl_state_t *gl, int frameWidth, int frameHeight);
+
+void snapshot_end(snapshot_t *s, int64_t pts, int viewportWidth, int viewportHeight);
+
+/*
+ * readback in flight, the render loop must not park before it is done
+ */
+int snapshot_busy(snapshot_t *s);
+
+#endif //GLES2JNI_GL_SNAPSHOT_H
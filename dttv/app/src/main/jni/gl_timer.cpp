@@ -0,0 +1,134 @@
+//
+// gl_timer - GPU time of render loop stages through EXT_disjoint_timer_query.
+//
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+
+#include <string.h>
+
+#include "native_log.h"
+#include "gl_util.h"
+#include "gl_timer.h"
+
+#define TAG "GL-TIMER"
+
+// no stage of one frame takes a second; some drivers return junk for a
+// query spanning a program link
+#define GL_TIMER_MAX_NS 1000000000LL
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+#define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+void gl_timer_setup(gl_timer_t *t) {
+    // names of a previous context are not ours to delete
+    memset(t, 0, sizeof(gl_timer_t));
+    t->active = -1;
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (!extensions || strstr(extensions, "GL_EXT_disjoint_timer_query") == NULL) {
+        LOGV("no GPU timer queries \n");
+        return;
+    }
+    t->genQueries = (gl_timer_gen_t) eglGetProcAddress("glGenQueriesEXT");
+    t->beginQuery = (gl_timer_begin_t) eglGetProcAddress("glBeginQueryEXT");
+    t->endQuery = (gl_timer_end_t) eglGetProcAddress("glEndQueryEXT");
+    t->getQueryObjectuiv = (gl_timer_getuiv_t) eglGetProcAddress("glGetQueryObjectuivEXT");
+    t->getQueryObjectui64v = (gl_timer_getui64v_t) eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (!t->genQueries || !t->beginQuery || !t->endQuery ||
+        !t->getQueryObjectuiv || !t->getQueryObjectui64v) {
+        LOGV("GPU timer query entry points missing \n");
+        return;
+    }
+    t->genQueries(GL_TIMER_FRAMES * GL_TIMER_STAGES, &t->queries[0][0]);
+    // reading it clears a disjoint event from before we started
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    t->supported = 1;
+    LOGV("GPU timer queries ready \n");
+}
+
+void gl_timer_begin(gl_timer_t *t, int stage) {
+    if (!t->supported || t->pending[t->frame] || t->active >= 0) {
+        return;
+    }
+    t->beginQuery(GL_TIME_ELAPSED_EXT, t->queries[t->frame][stage]);
+    t->issued[t->frame][stage] = 1;
+    t->active = stage;
+}
+
+void gl_timer_end(gl_timer_t *t) {
+    if (t->active < 0) {
+        return;
+    }
+    t->endQuery(GL_TIME_ELAPSED_EXT);
+    t->active = -1;
+}
+
+static int collect(gl_timer_t *t, int frame, void (*cb)(void *opaque, int stage, int64_t ns),
+                   void *opaque, int disjoint) {
+    for (int i = 0; i < GL_TIMER_STAGES; i++) {
+        if (!t->issued[frame][i]) {
+            continue;
+        }
+        GLuint available = 0;
+        t->getQueryObjectuiv(t->queries[frame][i], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < GL_TIMER_STAGES; i++) {
+        if (!t->issued[frame][i]) {
+            continue;
+        }
+        uint64_t ns = 0;
+        t->getQueryObjectui64v(t->queries[frame][i], GL_QUERY_RESULT_EXT, &ns);
+        if (!disjoint && ns < (uint64_t) GL_TIMER_MAX_NS) {
+            cb(opaque, i, (int64_t) ns);
+        }
+        t->issued[frame][i] = 0;
+    }
+    return 1;
+}
+
+void gl_timer_next_frame(gl_timer_t *t, void (*cb)(void *opaque, int stage, int64_t ns),
+                         void *opaque) {
+    if (!t->supported) {
+        return;
+    }
+    gl_timer_end(t);
+    int recorded = 0;
+    for (int i = 0; i < GL_TIMER_STAGES; i++) {
+        recorded |= t->issued[t->frame][i];
+    }
+    if (t->pending[t->frame]) {
+        t->skipped++;
+    } else if (recorded) {
+        t->pending[t->frame] = 1;
+    }
+
+    // frequency change or context switch on the GPU: results are garbage
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    for (int k = 1; k <= GL_TIMER_FRAMES; k++) {
+        // oldest first, a frame only completes after the ones before it
+        int frame = (t->frame + k) % GL_TIMER_FRAMES;
+        if (!t->pending[frame]) {
+            continue;
+        }
+        if (!collect(t, frame, cb, opaque, disjoint)) {
+            break;
+        }
+        t->pending[frame] = 0;
+    }
+    t->frame = (t->frame + 1) % GL_TIMER_FRAMES;
+}
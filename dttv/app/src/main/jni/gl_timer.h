@@ -0,0 +1,60 @@
+//
+// gl_timer - GPU time of render loop stages through EXT_disjoint_timer_query.
+//
+// Queries of a frame are read back a few frames later, when the GPU has
+// long finished them; the render loop never waits for a result. A frame
+// whose queries are still pending when its slot comes round again simply
+// goes untimed.
+//
+
+#ifndef GLES2JNI_GL_TIMER_H
+#define GLES2JNI_GL_TIMER_H
+
+#include <GLES2/gl2.h>
+#include <stdint.h>
+
+#define GL_TIMER_FRAMES 4       // frames in flight
+#define GL_TIMER_STAGES 2
+
+typedef void (GL_APIENTRY *gl_timer_gen_t)(GLsizei n, GLuint *ids);
+typedef void (GL_APIENTRY *gl_timer_begin_t)(GLenum target, GLuint id);
+typedef void (GL_APIENTRY *gl_timer_end_t)(GLenum target);
+typedef void (GL_APIENTRY *gl_timer_getuiv_t)(GLuint id, GLenum pname, GLuint *params);
+typedef void (GL_APIENTRY *gl_timer_getui64v_t)(GLuint id, GLenum pname, uint64_t *params);
+
+typedef struct {
+    int supported;          // extension and entry points found
+    gl_timer_gen_t genQueries;
+    gl_timer_begin_t beginQuery;
+    gl_timer_end_t endQuery;
+    gl_timer_getuiv_t getQueryObjectuiv;
+    gl_timer_getui64v_t getQueryObjectui64v;
+
+    GLuint queries[GL_TIMER_FRAMES][GL_TIMER_STAGES];
+    int issued[GL_TIMER_FRAMES][GL_TIMER_STAGES];
+    int pending[GL_TIMER_FRAMES];   // slot waits for its results
+    int frame;                      // slot being recorded
+    int active;                     // stage between begin and end, -1 none
+    int skipped;                    // frames not timed, their slot was still busy
+} gl_timer_t;
+
+/*
+ * current context; also after a new one was made current, the old
+ * queries died with it
+ */
+void gl_timer_setup(gl_timer_t *t);
+
+/*
+ * one stage at a time, GL allows a single elapsed time query
+ */
+void gl_timer_begin(gl_timer_t *t, int stage);
+
+void gl_timer_end(gl_timer_t *t);
+
+/*
+ * close the frame, hand finished stages of earlier ones to cb in ns
+ */
+void gl_timer_next_frame(gl_timer_t *t, void (*cb)(void *opaque, int stage, int64_t ns),
+                         void *opaque);
+
+#endif //GLES2JNI_GL_TIMER_H
@@ -8,15 +8,95 @@
 #define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
 #define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
 
+#include <string.h>
+#include <EGL/egl.h>
+
 #include "gl_util.h"
 
+#ifdef ENABLE_GL_DEBUG
+
+#ifndef GL_DEBUG_OUTPUT_KHR
+#define GL_DEBUG_OUTPUT_KHR 0x92E0
+#endif
+#ifndef GL_DEBUG_TYPE_ERROR_KHR
+#define GL_DEBUG_TYPE_ERROR_KHR 0x824C
+#endif
+#ifndef GL_DEBUG_SEVERITY_NOTIFICATION_KHR
+#define GL_DEBUG_SEVERITY_NOTIFICATION_KHR 0x826B
+#endif
+
+typedef void (GL_APIENTRY *debug_proc_t)(GLenum source, GLenum type, GLuint id,
+                                         GLenum severity, GLsizei length,
+                                         const GLchar *message, const void *userParam);
+typedef void (GL_APIENTRY *debug_message_callback_t)(debug_proc_t callback,
+                                                     const void *userParam);
+
+// KHR_debug delivers errors with the driver's own description
+static int g_debugOutput = 0;
+
+static void GL_APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                     GLsizei length, const GLchar *message,
+                                     const void *userParam) {
+    if (severity == GL_DEBUG_SEVERITY_NOTIFICATION_KHR) {
+        return;
+    }
+    if (type == GL_DEBUG_TYPE_ERROR_KHR) {
+        LOGE("gl debug error 0x%x: %s\n", id, message);
+    } else {
+        LOGI("gl debug 0x%x type 0x%x: %s\n", id, type, message);
+    }
+}
+
+void gl_debug_setup() {
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    debug_message_callback_t callback = NULL;
+    if (extensions && strstr(extensions, "GL_KHR_debug") != NULL) {
+        callback = (debug_message_callback_t) eglGetProcAddress("glDebugMessageCallbackKHR");
+    }
+    if (!callback) {
+        g_debugOutput = 0;
+        LOGI("no KHR_debug, errors polled with glGetError\n");
+        return;
+    }
+    callback(debugMessage, NULL);
+    glEnable(GL_DEBUG_OUTPUT_KHR);
+    g_debugOutput = 1;
+    LOGI("gl errors reported through KHR_debug\n");
+}
+
 void checkGlError(const char *op) {
+    if (g_debugOutput) {
+        return;
+    }
     for (GLint error = glGetError(); error; error
                                                     = glGetError()) {
         LOGI("after %s() glError (0x%x)\n", op, error);
     }
 }
 
+#else
+
+void gl_debug_setup() {
+}
+
+#endif
+
+void gl_state_reset(gl_state_t *st) {
+    memset(st, 0xFF, sizeof(gl_state_t));
+    st->attribSource = NULL;
+}
+
+void gl_delete_textures(gl_state_t *st, int count, const GLuint *textures) {
+    for (int i = 0; i < count; i++) {
+        for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+            if (st->textures[unit] == textures[i]) {
+                st->textures[unit] = 0;
+            }
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
 GLuint loadShader(GLenum shaderType, const char *pSource) {
     GLuint shader = glCreateShader(shaderType);
     if (shader) {
@@ -12,7 +12,94 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+/*
+ * glGetError after every call stalls on drivers that run GL on a thread of
+ * their own, so error checks only exist in ENABLE_GL_DEBUG builds. There
+ * gl_debug_setup routes errors through KHR_debug when the driver has it and
+ * checkGlError stays quiet; without it checkGlError polls like it always did.
+ */
+#ifdef ENABLE_GL_DEBUG
 void checkGlError(const char *op);
+#else
+#define checkGlError(op) ((void) 0)
+#endif
+
+/*
+ * current context, after it was created; no-op without ENABLE_GL_DEBUG
+ */
+void gl_debug_setup();
+
+/*
+ * Binds of one context as last issued through the helpers below, so the per
+ * frame path can skip the ones the driver would check and revalidate for
+ * nothing. Every user of the context goes through it; GL_STATE_UNKNOWN
+ * after gl_state_reset forces the first bind of each kind.
+ */
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+#define GL_STATE_TEXTURE_UNITS 8
+
+typedef struct {
+    GLuint program;
+    GLuint activeUnit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    // who set the vertex attribute pointers last, see gl_state_attribs
+    GLuint attribProgram;
+    GLuint attribBuffer;
+    const void *attribSource;
+} gl_state_t;
+
+/*
+ * new context, or GL calls that bypassed the cache
+ */
+void gl_state_reset(gl_state_t *st);
+
+static inline void gl_use_program(gl_state_t *st, GLuint program) {
+    if (st->program != program) {
+        glUseProgram(program);
+        st->program = program;
+    }
+}
+
+static inline void gl_bind_texture(gl_state_t *st, int unit, GLuint texture) {
+    if (st->activeUnit != (GLuint) unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        st->activeUnit = (GLuint) unit;
+    }
+    if (st->textures[unit] != texture) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        st->textures[unit] = texture;
+    }
+}
+
+static inline void gl_bind_buffer(gl_state_t *st, GLenum target, GLuint buffer) {
+    GLuint *bound = (target == GL_ARRAY_BUFFER) ? &st->arrayBuffer : &st->elementBuffer;
+    if (*bound != buffer) {
+        glBindBuffer(target, buffer);
+        *bound = buffer;
+    }
+}
+
+/*
+ * 1 when program's attribute pointers have to be set: the program, the
+ * bound array buffer or the source (offset or client pointer) changed
+ */
+static inline int gl_state_attribs(gl_state_t *st, GLuint program, const void *source) {
+    if (st->attribProgram == program && st->attribBuffer == st->arrayBuffer &&
+        st->attribSource == source) {
+        return 0;
+    }
+    st->attribProgram = program;
+    st->attribBuffer = st->arrayBuffer;
+    st->attribSource = source;
+    return 1;
+}
+
+/*
+ * glDeleteTextures unbinds them, a recycled name must not look bound
+ */
+void gl_delete_textures(gl_state_t *st, int count, const GLuint *textures);
 
 GLuint loadShader(GLenum shaderType, const char *pSource);
 
@@ -5,6 +5,7 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 
 #include <android/log.h>
 #include "native_log.h"
@@ -18,9 +19,19 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "gl_util.h"
+#include "gl_program_cache.h"
 #include "gl_yuv.h"
+#include "frame_mailbox.h"
+#include "frame_scheduler.h"
+#include "native_atomic.h"
+#include "dt_lock.h"
+#include "frame_downscale.h"
+#include "gl_snapshot.h"
+#include "gl_timer.h"
+#include "render_stats.h"
 #include "../../../../3rd/libdtp/include/dt_av.h"
 #include "android_dtplayer.h"
 
@@ -41,44 +52,188 @@ const char gVertextShader[] = {
                 "}\n"
 };
 
-// The fragment shader.
-// Do YUV to RGB565 conversion.
-static const char gFragmentShader[] = {
-        "precision mediump float;\n"
-                "uniform sampler2D Ytex;\n"
-                "uniform sampler2D Utex,Vtex;\n"
-                "varying vec2 vTextureCoord;\n"
-                "void main(void) {\n"
-                "  float nx,ny,r,g,b,y,u,v;\n"
-                "  mediump vec4 txl,ux,vx;"
-                "  nx=vTextureCoord[0];\n"
-                "  ny=vTextureCoord[1];\n"
-                "  y=texture2D(Ytex,vec2(nx,ny)).r;\n"
-                "  u=texture2D(Utex,vec2(nx,ny)).r;\n"
-                "  v=texture2D(Vtex,vec2(nx,ny)).r;\n"
-
-                //"  y = v;\n"+
-                "  y=1.1643*(y-0.0625);\n"
-                "  u=u-0.5;\n"
-                "  v=v-0.5;\n"
-
-                "  r=y+1.5958*v;\n"
-                "  g=y-0.39173*u-0.81290*v;\n"
-                "  b=y+2.017*u;\n"
-                "  gl_FragColor=vec4(r,g,b,1.0);\n"
-                "}\n"
+// Fragment shader variants, one per sampling layout and color matrix.
+// Everything is spelled out by the preprocessor so each variant is a plain
+// string constant with its coefficients folded in, nothing is chosen at
+// run time inside the shader.
+
+// Luma fetch, plain bilinear or bicubic for upscaling. The bicubic one is
+// the 4 tap B-spline: each tap is a bilinear fetch at an offset weighted so
+// the hardware filter does the inner sums. Chroma stays bilinear, there is
+// little detail to gain there for 3x the fetches.
+#define YUV_HEAD_LINEAR ""
+#define YUV_LUMA_LINEAR "texture2D(Ytex,vTextureCoord).r"
+#define YUV_HEAD_BICUBIC \
+        "#ifdef GL_FRAGMENT_PRECISION_HIGH\n" \
+        "precision highp float;\n" \
+        "#endif\n" \
+        "uniform vec2 texSize;\n" \
+        "vec4 cubic(float v) {\n" \
+        "  vec4 n=vec4(1.0,2.0,3.0,4.0)-v;\n" \
+        "  vec4 s=n*n*n;\n" \
+        "  float x=s.x;\n" \
+        "  float y=s.y-4.0*s.x;\n" \
+        "  float z=s.z-4.0*s.y+6.0*s.x;\n" \
+        "  return vec4(x,y,z,6.0-x-y-z)*(1.0/6.0);\n" \
+        "}\n" \
+        "float bicubic(sampler2D tex,vec2 coord) {\n" \
+        "  coord=coord*texSize-0.5;\n" \
+        "  vec2 f=fract(coord);\n" \
+        "  coord-=f;\n" \
+        "  vec4 xc=cubic(f.x);\n" \
+        "  vec4 yc=cubic(f.y);\n" \
+        "  vec4 s=vec4(xc.xz+xc.yw,yc.xz+yc.yw);\n" \
+        "  vec4 o=(coord.xxyy+vec4(-0.5,1.5,-0.5,1.5)+vec4(xc.yw,yc.yw)/s)/texSize.xxyy;\n" \
+        "  float sx=s.x/(s.x+s.y);\n" \
+        "  float sy=s.z/(s.z+s.w);\n" \
+        "  return mix(mix(texture2D(tex,o.yw).r,texture2D(tex,o.xw).r,sx),\n" \
+        "             mix(texture2D(tex,o.yz).r,texture2D(tex,o.xz).r,sx),sy);\n" \
+        "}\n"
+#define YUV_LUMA_BICUBIC "bicubic(Ytex,vTextureCoord)"
+
+// planar 4:2:0/4:2:2/4:4:4 share one layout, chroma size only lives in the
+// texture dimensions
+#define YUV_SAMPLE_PLANAR(HEAD, LUMA) \
+        "uniform sampler2D Ytex;\n" \
+        "uniform sampler2D Utex,Vtex;\n" \
+        "varying vec2 vTextureCoord;\n" \
+        HEAD \
+        "void main(void) {\n" \
+        "  float r,g,b,y,u,v;\n" \
+        "  y=" LUMA ";\n" \
+        "  u=texture2D(Utex,vTextureCoord).r;\n" \
+        "  v=texture2D(Vtex,vTextureCoord).r;\n"
+
+// Semi-planar NV12/NV21: Y as luminance, interleaved chroma as one
+// luminance-alpha texture (first byte -> .r, second byte -> .a).
+// No CPU side deinterleave needed.
+#define YUV_SAMPLE_NV(HEAD, LUMA, U, V) \
+        "uniform sampler2D Ytex;\n" \
+        "uniform sampler2D UVtex;\n" \
+        "varying vec2 vTextureCoord;\n" \
+        HEAD \
+        "void main(void) {\n" \
+        "  float r,g,b,y,u,v;\n" \
+        "  vec4 uv=texture2D(UVtex,vTextureCoord);\n" \
+        "  y=" LUMA ";\n" \
+        "  u=uv." U ";\n" \
+        "  v=uv." V ";\n"
+
+// 9 to 16 bit planar: little-endian words as luminance-alpha, low byte in
+// .r, high byte in .a. The textures are NEAREST and the bilinear blend is
+// done here on the recombined value, a filtered high byte is only as
+// precise as the GPU filter and would band wherever it carries. depthScale
+// brings samples to the 8-bit scale the matrices expect. No bicubic variant,
+// it would cost 16 fetches for luma alone.
+#define YUV_SAMPLE_PLANAR16 \
+        "#ifdef GL_FRAGMENT_PRECISION_HIGH\n" \
+        "precision highp float;\n" \
+        "#endif\n" \
+        "uniform sampler2D Ytex;\n" \
+        "uniform sampler2D Utex,Vtex;\n" \
+        "uniform vec2 texSize,chromaSize;\n" \
+        "uniform vec2 depthScale;\n" \
+        "varying vec2 vTextureCoord;\n" \
+        "float fetch16(sampler2D tex,vec2 size,vec2 coord) {\n" \
+        "  coord=coord*size-0.5;\n" \
+        "  vec2 f=fract(coord);\n" \
+        "  vec2 d=1.0/size;\n" \
+        "  vec2 c=(coord-f+0.5)*d;\n" \
+        "  float t0=dot(texture2D(tex,c).ra,depthScale);\n" \
+        "  float t1=dot(texture2D(tex,c+vec2(d.x,0.0)).ra,depthScale);\n" \
+        "  float t2=dot(texture2D(tex,c+vec2(0.0,d.y)).ra,depthScale);\n" \
+        "  float t3=dot(texture2D(tex,c+d).ra,depthScale);\n" \
+        "  return mix(mix(t0,t1,f.x),mix(t2,t3,f.x),f.y);\n" \
+        "}\n" \
+        "void main(void) {\n" \
+        "  float r,g,b,y,u,v;\n" \
+        "  y=fetch16(Ytex,texSize,vTextureCoord);\n" \
+        "  u=fetch16(Utex,chromaSize,vTextureCoord);\n" \
+        "  v=fetch16(Vtex,chromaSize,vTextureCoord);\n"
+
+// y expression, chroma scale, then r.v g.u g.v b.u
+// limited range: y in [16,235], chroma in [16,240]
+#define YUV_MATRIX_BT601_LIMITED \
+        "1.1644*(y-0.0625)", "1.1384", "1.4020", "0.3441", "0.7141", "1.7720"
+#define YUV_MATRIX_BT709_LIMITED \
+        "1.1644*(y-0.0625)", "1.1384", "1.5748", "0.1873", "0.4681", "1.8556"
+#define YUV_MATRIX_BT601_FULL \
+        "y", "1.0", "1.4020", "0.3441", "0.7141", "1.7720"
+#define YUV_MATRIX_BT709_FULL \
+        "y", "1.0", "1.5748", "0.1873", "0.4681", "1.8556"
+
+#define YUV_FRAGMENT_(SAMPLE, Y, C, RV, GU, GV, BU) \
+        "precision mediump float;\n" \
+        SAMPLE \
+        "  y=" Y ";\n" \
+        "  u=" C "*(u-0.5);\n" \
+        "  v=" C "*(v-0.5);\n" \
+        "  r=y+" RV "*v;\n" \
+        "  g=y-" GU "*u-" GV "*v;\n" \
+        "  b=y+" BU "*u;\n" \
+        "  gl_FragColor=vec4(r,g,b,1.0);\n" \
+        "}\n"
+// extra level so the matrix macro expands into its arguments first
+#define YUV_FRAGMENT(SAMPLE, MATRIX) YUV_FRAGMENT_(SAMPLE, MATRIX)
+
+// order follows YUV_MATRIX_* below
+#define YUV_FRAGMENT_VARIANTS(SAMPLE) \
+        YUV_FRAGMENT(SAMPLE, YUV_MATRIX_BT601_LIMITED), \
+        YUV_FRAGMENT(SAMPLE, YUV_MATRIX_BT709_LIMITED), \
+        YUV_FRAGMENT(SAMPLE, YUV_MATRIX_BT601_FULL), \
+        YUV_FRAGMENT(SAMPLE, YUV_MATRIX_BT709_FULL)
+
+enum {
+    YUV_MATRIX_BT601 = 0,
+    YUV_MATRIX_BT709 = 1,
+    YUV_MATRIX_FULL_RANGE = 2,  // flag, added to the matrix
+    YUV_MATRIX_NB = 4,
 };
 
-static GLuint gProgram;
-static GLuint positionHandle;
-static GLuint textureHandle;
+// variant = filter * YUV_FORMAT_VARIANTS + layout * YUV_MATRIX_NB + matrix
+#define YUV_FORMAT_VARIANTS (YUV_LAYOUT_NB * YUV_MATRIX_NB)
+#define YUV_VARIANT_NB (YUV_UPSCALE_FILTER_NB * YUV_FORMAT_VARIANTS)
+
+static const char *const gFragmentShaders[YUV_VARIANT_NB] = {
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_PLANAR(YUV_HEAD_LINEAR, YUV_LUMA_LINEAR)),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_NV(YUV_HEAD_LINEAR, YUV_LUMA_LINEAR, "r", "a")),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_NV(YUV_HEAD_LINEAR, YUV_LUMA_LINEAR, "a", "r")),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_PLANAR16),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_PLANAR(YUV_HEAD_BICUBIC, YUV_LUMA_BICUBIC)),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_NV(YUV_HEAD_BICUBIC, YUV_LUMA_BICUBIC, "r", "a")),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_NV(YUV_HEAD_BICUBIC, YUV_LUMA_BICUBIC, "a", "r")),
+        YUV_FRAGMENT_VARIANTS(YUV_SAMPLE_PLANAR16),
+};
+
+typedef struct {
+    GLuint program;
+    GLint positionHandle;
+    GLint textureHandle;
+    GLint texSizeHandle;    // bicubic and 16-bit only, -1 otherwise
+    GLint chromaSizeHandle; // 16-bit only
+    GLint depthScaleHandle; // 16-bit only
+} yuv_program_t;
+
+// upload cost per layout, logged every UPLOAD_STAT_FRAMES frames
+#define UPLOAD_STAT_FRAMES 300
+
+// Texture set matching the geometry of the frames being shown. Storage is
+// allocated once per geometry/format, frames only go through sub-image
+// uploads until the next switch.
+typedef struct {
+    int count;              // 0 - nothing allocated
+    GLuint ids[3];
+    int width[3];
+    int height[3];
+    GLenum format[3];
+} yuv_textures_t;
 
-static GLuint g_textureIds[3];
-static GLuint g_textureWidth = 0;
-static GLuint g_textureHeight = 0;
+// sets uploads rotate through, see yuv_set_texture_sets
+#define YUV_MAX_TEXTURE_SETS 3
 
-static GLuint g_windowWidth = 0;
-static GLuint g_windowHeight = 0;
+// gl_timer stages
+#define YUV_TIMER_UPLOAD 0
+#define YUV_TIMER_DRAW   1
 
 const char g_indices[] = {0, 3, 2, 0, 2, 1};
 
@@ -90,153 +245,701 @@ const GLfloat g_vertices[20] = {
         -1, 1, 0, 0, 0
 }; //Top Left
 
-void setupTextures(uint8_t *data, GLsizei width, GLsizei height) {
-    glGenTextures(3, g_textureIds); //Generate  the Y, U and V texture
+// snapshots: whole picture, no bars or zoom crop, upside down so the FBO
+// reads back top row first
+const GLfloat g_snapshotVertices[20] = {
+        -1, -1, 0, 0, 0,
+        1, -1, 0, 1, 0,
+        1, 1, 0, 1, 1,
+        -1, 1, 0, 0, 1
+};
 
-    GLuint currentTextureId = g_textureIds[0]; // Y
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
+// both quads live in one vertex buffer, the screen one is rewritten on
+// geometry changes only
+#define YUV_VBO_QUAD     ((const void *) 0)
+#define YUV_VBO_SNAPSHOT ((const void *) sizeof(g_vertices))
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// display aspect ratios of the fixed aspect modes
+#define YUV_ASPECT_4_3  (4.0f / 3.0f)
+#define YUV_ASPECT_16_9 (16.0f / 9.0f)
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2 // GLES3 / GL_EXT_unpack_subimage
+#endif
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0,
-                 GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                 (const GLvoid *) data);
+// band size used to restride rows when GL_UNPACK_ROW_LENGTH is missing,
+// small enough to stay in cache while the driver copies it out
+#define UPLOAD_STAGING_SIZE (128 * 1024)
 
-    currentTextureId = g_textureIds[1]; // U
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
+// One per player. Everything GL in here belongs to the context the
+// renderer was last initialised on (yuv_dttv_init), so players on their own
+// views or render threads never touch each other's objects.
+struct yuv_renderer {
+    // GL thread side
+    yuv_program_t programs[YUV_VARIANT_NB];  // compiled on first use, see useProgram
+    yuv_textures_t sets[YUV_MAX_TEXTURE_SETS];
+    yuv_textures_t *textures;                // the set draws sample, one of sets
+    EGLSyncKHR fences[YUV_MAX_TEXTURE_SETS]; // after the last draw that sampled the set
+    EGLDisplay fenceDisplay;
+    PFNEGLCREATESYNCKHRPROC createSync;      // NULL without EGL_KHR_fence_sync
+    PFNEGLCLIENTWAITSYNCKHRPROC clientWaitSync;
+    PFNEGLDESTROYSYNCKHRPROC destroySync;
+    int textureSets;                         // wanted, any thread
+    gl_timer_t timer;
+    int timerReady;                          // timer set up on this context
+    int64_t lastDraw;                        // start of the previous draw, 0 after parking
+    render_stats_t stats;                    // GL thread writes, getInfo reads
+    int busyUploads;                         // set still read by the GPU when its upload came
+    int64_t busyWaitTime;                    // spent waiting for those, several sets only
+    int texReallocs;
+    PFNGLTEXSTORAGE2DEXTPROC texStorage2D;
+    int hasUnpackRowLength;
+    uint8_t *uploadStaging;                  // UPLOAD_STAGING_SIZE, allocated on first need
+    int64_t uploadTime[YUV_LAYOUT_NB];
+    int uploadFrames[YUV_LAYOUT_NB];
+    GLuint windowWidth;
+    GLuint windowHeight;
+    int shownVariant;                        // format variant of the frame in the textures
+    dt_av_frame_t lastFrame;                 // the one in the textures, uploaded again into a new context
+    int shownDepth;                          // bits per sample of the frame in the textures
+    int frameWidth;                          // size of the frame in the textures
+    int frameHeight;
+    int shownScale;                          // the frame in the textures is 1/n of its size
+    int64_t shownPts;                        // of the frame in the textures, reported with snapshots
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // quad for the current mode/window/frame, rebuilt in updateGeometry
+    GLfloat vertices[20];
+    GLuint vbo;                              // quad and snapshot quad
+    GLuint ibo;                              // g_indices
+    gl_state_t gl;                           // binds of this context, shared with the snapshot
+    int geometryMode;                        // videoMode the quad was built for
+    int geometryDirty;
+    int upscale;                             // quad is larger than the frame
+    int uploadScale;                         // 1, 2 or 4, frame texels per screen pixel allow it
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // any thread
+    int videoMode;                           // DT_SCREEN_MODE_*
+    int upscaleFilter;                       // YUV_UPSCALE_FILTER_*
+    int downscale;                           // shrink uploads to uploadScale
 
-    uint8_t *uComponent = data + width * height;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width / 2, height / 2, 0,
-                 GL_LUMINANCE, GL_UNSIGNED_BYTE, (const GLvoid *) uComponent);
+    // vo side -> GL side
+    frame_mailbox_t mailbox;
+    snapshot_t *snapshot;                    // any thread -> GL side
+    frame_scheduler_t scheduler;
+    int inited;
+    int idle;                                // render loop parked, next frame has to wake it
+    uint32_t work;                           // bumped by every producer before it wakes the loop
+    uint32_t workSeen;                       // GL side, work when the loop last looked
+    android::DTPlayer *dtp;
+    void (*wakeup)(void *opaque);
+    void *wakeupOpaque;
+    dt_lock_t wakeupLock;
+};
 
-    currentTextureId = g_textureIds[2]; // V
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
+void yuv_get_format(int pixfmt, yuv_format_t *fmt) {
+    fmt->layout = YUV_LAYOUT_PLANAR;
+    fmt->chromaShiftW = 1;
+    fmt->chromaShiftH = 1;
+    fmt->fullRange = 0;
+    fmt->depth = 8;
+    switch (pixfmt) {
+        case DTAV_PIX_FMT_NV12:
+            fmt->layout = YUV_LAYOUT_NV12;
+            break;
+        case DTAV_PIX_FMT_NV21:
+            fmt->layout = YUV_LAYOUT_NV21;
+            break;
+        case DTAV_PIX_FMT_YUVJ420P:
+            fmt->fullRange = 1;
+            break;
+        case DTAV_PIX_FMT_YUVJ422P:
+            fmt->fullRange = 1;
+            // fall through
+        case DTAV_PIX_FMT_YUV422P:
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUVJ444P:
+            fmt->fullRange = 1;
+            // fall through
+        case DTAV_PIX_FMT_YUV444P:
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        // high bit depth as decoders output it, little-endian words; big
+        // endian would need the byte roles swapped and nothing produces it
+        case DTAV_PIX_FMT_YUV420P9LE:
+            fmt->depth = 9;
+            break;
+        case DTAV_PIX_FMT_YUV420P10LE:
+            fmt->depth = 10;
+            break;
+        case DTAV_PIX_FMT_YUV420P12LE:
+            fmt->depth = 12;
+            break;
+        case DTAV_PIX_FMT_YUV420P14LE:
+            fmt->depth = 14;
+            break;
+        case DTAV_PIX_FMT_YUV420P16LE:
+            fmt->depth = 16;
+            break;
+        case DTAV_PIX_FMT_YUV422P9LE:
+            fmt->depth = 9;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV422P10LE:
+            fmt->depth = 10;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV422P12LE:
+            fmt->depth = 12;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV422P14LE:
+            fmt->depth = 14;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV422P16LE:
+            fmt->depth = 16;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV444P9LE:
+            fmt->depth = 9;
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV444P10LE:
+            fmt->depth = 10;
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV444P12LE:
+            fmt->depth = 12;
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV444P14LE:
+            fmt->depth = 14;
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        case DTAV_PIX_FMT_YUV444P16LE:
+            fmt->depth = 16;
+            fmt->chromaShiftW = 0;
+            fmt->chromaShiftH = 0;
+            break;
+        default:
+            // YUV420P, and what we always assumed for unknown formats
+            break;
+    }
+    if (fmt->depth > 8) {
+        fmt->layout = YUV_LAYOUT_PLANAR16;
+    }
+}
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+static int getVariant(dt_av_frame_t *frame, yuv_format_t *fmt) {
+    int matrix = (frame->height >= YUV_HD_HEIGHT) ? YUV_MATRIX_BT709 : YUV_MATRIX_BT601;
+    if (fmt->fullRange) {
+        matrix += YUV_MATRIX_FULL_RANGE;
+    }
+    return fmt->layout * YUV_MATRIX_NB + matrix;
+}
 
-    uint8_t *vComponent = uComponent + (width * height) / 4;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width / 2, height / 2, 0,
-                 GL_LUMINANCE, GL_UNSIGNED_BYTE, (const GLvoid *) vComponent);
-    checkGlError("SetupTextures");
+void yuv_get_planes(dt_av_frame_t *frame, yuv_format_t *fmt, yuv_planes_t *planes) {
+    int width = frame->width;
+    int height = frame->height;
+    int cw = (width + (1 << fmt->chromaShiftW) - 1) >> fmt->chromaShiftW;
+    int ch = (height + (1 << fmt->chromaShiftH) - 1) >> fmt->chromaShiftH;
+    int planar = (fmt->layout == YUV_LAYOUT_PLANAR || fmt->layout == YUV_LAYOUT_PLANAR16);
+    int sampleBytes = (fmt->depth > 8) ? 2 : 1;
+    int i;
 
-    LOGV("setupTextures ok");
+    planes->count = planar ? 3 : 2;
+    planes->width[0] = width;
+    planes->height[0] = height;
+    planes->bpp[0] = sampleBytes;
+    for (i = 1; i < planes->count; i++) {
+        planes->width[i] = cw;
+        planes->height[i] = ch;
+        planes->bpp[i] = planar ? sampleBytes : 2;
+    }
+    // two bytes per texel, either a 16-bit sample or an interleaved pair
+    for (i = 0; i < planes->count; i++) {
+        planes->format[i] = (planes->bpp[i] == 2) ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+    }
+
+    planes->data[0] = frame->data[0];
+    planes->linesize[0] = frame->linesize[0] > 0 ? frame->linesize[0] : width;
+    if (frame->data[1] && (planes->count == 2 || frame->data[2])) {
+        for (i = 1; i < planes->count; i++) {
+            planes->data[i] = frame->data[i];
+            planes->linesize[i] = frame->linesize[i] > 0 ? frame->linesize[i] : cw * planes->bpp[i];
+        }
+    } else if (planes->count == 2) {
+        planes->linesize[1] = planes->linesize[0];
+        planes->data[1] = planes->data[0] + planes->linesize[0] * height;
+    } else {
+        planes->linesize[1] = planes->linesize[2] = planes->linesize[0] >> fmt->chromaShiftW;
+        planes->data[1] = planes->data[0] + planes->linesize[0] * height;
+        planes->data[2] = planes->data[1] + planes->linesize[1] * ch;
+    }
 }
 
+/*
+ * Upload one plane straight from its own pointer and stride.
+ * Tightly packed planes go in one call, padded ones use GL_UNPACK_ROW_LENGTH
+ * when the driver has it, otherwise rows are restrided in small bands.
+ */
+static void uploadPlane(yuv_renderer_t *r, const uint8_t *data, int linesize, int width, int height,
+                        int bpp, GLenum format) {
+    int rowBytes = width * bpp;
+    if (linesize == rowBytes) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+        return;
+    }
 
-void UpdateTextures(uint8_t *data, GLsizei width, GLsizei height) {
-    GLuint currentTextureId = g_textureIds[0]; // Y
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
-    checkGlError("UpdateTextures Y Bind");
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_LUMINANCE,
-                    GL_UNSIGNED_BYTE, (const GLvoid *) data);
-    checkGlError("UpdateTextures Y");
-    currentTextureId = g_textureIds[1]; // U
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
-    checkGlError("UpdateTextures U Bind");
-    uint8_t *uComponent = data + width * height;
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2,
-                    GL_LUMINANCE, GL_UNSIGNED_BYTE, (const GLvoid *) uComponent);
-    checkGlError("UpdateTextures U");
+    if (r->hasUnpackRowLength && linesize % bpp == 0) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / bpp);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
 
-    currentTextureId = g_textureIds[2]; // V
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, currentTextureId);
-    checkGlError("UpdateTextures V Bind");
-    uint8_t *vComponent = uComponent + (width * height) / 4;
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2,
-                    GL_LUMINANCE, GL_UNSIGNED_BYTE, (const GLvoid *) vComponent);
-    checkGlError("UpdateTextures V");
-    checkGlError("UpdateTextures");
+    int bandRows = UPLOAD_STAGING_SIZE / rowBytes;
+    if (bandRows == 0) {
+        // row wider than the staging area, rows are contiguous on their own
+        for (int y = 0; y < height; y++) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, 1, format, GL_UNSIGNED_BYTE,
+                            data + y * linesize);
+        }
+        return;
+    }
+    if (!r->uploadStaging) {
+        r->uploadStaging = (uint8_t *) malloc(UPLOAD_STAGING_SIZE);
+        if (!r->uploadStaging) {
+            return;
+        }
+    }
+    for (int y = 0; y < height; y += bandRows) {
+        int rows = (height - y < bandRows) ? height - y : bandRows;
+        for (int i = 0; i < rows; i++) {
+            memcpy(r->uploadStaging + i * rowBytes, data + (y + i) * linesize, rowBytes);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, format, GL_UNSIGNED_BYTE,
+                        r->uploadStaging);
+    }
 }
 
-bool yuv_setupGraphics(int w, int h) {
-    printGLString("Version", GL_VERSION);
-    printGLString("Vendor", GL_VENDOR);
-    printGLString("Renderer", GL_RENDERER);
-    printGLString("Extensions", GL_EXTENSIONS);
+static int planeKind(yuv_planes_t *planes, int i, yuv_format_t *fmt) {
+    if (planes->bpp[i] == 1) {
+        return DOWNSCALE_BYTES;
+    }
+    return (fmt->depth > 8) ? DOWNSCALE_WORDS : DOWNSCALE_PAIRS;
+}
 
-    g_windowWidth = (GLuint) w;
-    g_windowHeight = (GLuint) h;
-    LOGV("setupGraphics(%d, %d)", w, h);
+/*
+ * scale if a shrunk row of every plane and its scratch fit the staging
+ * area, 1 otherwise
+ */
+static int fitScale(yuv_renderer_t *r, yuv_planes_t *planes, yuv_format_t *fmt, int scale) {
+    if (scale == 1) {
+        return 1;
+    }
+    for (int i = 0; i < planes->count; i++) {
+        int need = downscale_size(planes->width[i], scale) * planes->bpp[i] +
+                   downscale_scratch_size(planes->width[i], planeKind(planes, i, fmt), scale);
+        if (need > UPLOAD_STAGING_SIZE) {
+            return 1;
+        }
+    }
+    if (!r->uploadStaging) {
+        r->uploadStaging = (uint8_t *) malloc(UPLOAD_STAGING_SIZE);
+        if (!r->uploadStaging) {
+            return 1;
+        }
+    }
+    return scale;
+}
 
-    int maxTextureImageUnits[2];
-    int maxTextureSize[2];
-    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, maxTextureImageUnits);
-    glGetIntegerv(GL_MAX_TEXTURE_SIZE, maxTextureSize);
-    LOGV("%s: number of textures %d, size %d", __FUNCTION__, (int) maxTextureImageUnits[0],
-         (int) maxTextureSize[0]);
+/*
+ * Upload plane i of src shrunk by scale, see frame_downscale.h. Bands of
+ * shrunk rows go through the staging area and on to the driver while they
+ * are still in cache; the frame is read once and nothing frame sized is
+ * written on the CPU side.
+ */
+static void uploadPlaneScaled(yuv_renderer_t *r, yuv_planes_t *src, int i, int kind, int scale) {
+    int width = downscale_size(src->width[i], scale);
+    int height = downscale_size(src->height[i], scale);
+    int rowBytes = width * src->bpp[i];
+    // 4x halves twice through scratch rows in front of the band
+    int scratch = downscale_scratch_size(src->width[i], kind, scale);
+    uint8_t *band = r->uploadStaging + scratch;
+    int bandRows = (UPLOAD_STAGING_SIZE - scratch) / rowBytes;
+    for (int y = 0; y < height; y += bandRows) {
+        int rows = (height - y < bandRows) ? height - y : bandRows;
+        int srcRow = y * scale;
+        int srcRows = (src->height[i] - srcRow < rows * scale) ? src->height[i] - srcRow :
+                      rows * scale;
+        downscale_plane(src->data[i] + srcRow * src->linesize[i], src->linesize[i],
+                        src->width[i], srcRows, kind, scale, band, rowBytes, r->uploadStaging);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, src->format[i], GL_UNSIGNED_BYTE,
+                        band);
+    }
+}
 
-    gProgram = createProgram(gVertextShader, gFragmentShader);
-    if (!gProgram) {
-        LOGV("Could not create program.");
+static bool texturesMatch(yuv_textures_t *t, yuv_planes_t *planes) {
+    if (t->count != planes->count) {
         return false;
     }
+    for (int i = 0; i < planes->count; i++) {
+        if (t->width[i] != planes->width[i] || t->height[i] != planes->height[i] ||
+            t->format[i] != planes->format[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void releaseTextures(yuv_renderer_t *r, yuv_textures_t *t) {
+    if (t->count) {
+        gl_delete_textures(&r->gl, t->count, t->ids);
+    }
+    memset(t, 0, sizeof(yuv_textures_t));
+}
+
+/*
+ * (Re)allocate storage for the planes geometry, old textures are deleted.
+ * Immutable storage lets the driver skip mip/format validation on every
+ * later sub-image update.
+ */
+static void allocTextures(yuv_renderer_t *r, yuv_textures_t *t, yuv_planes_t *planes,
+                          GLint filter) {
+    releaseTextures(r, t);
+    glGenTextures(planes->count, t->ids);
+
+    for (int i = 0; i < planes->count; i++) {
+        gl_bind_texture(&r->gl, i, t->ids[i]);
+
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        if (r->texStorage2D) {
+            GLenum internal = (planes->format[i] == GL_LUMINANCE_ALPHA) ?
+                              GL_LUMINANCE8_ALPHA8_EXT : GL_LUMINANCE8_EXT;
+            r->texStorage2D(GL_TEXTURE_2D, 1, internal, planes->width[i], planes->height[i]);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, planes->format[i], planes->width[i], planes->height[i],
+                         0, planes->format[i], GL_UNSIGNED_BYTE, NULL);
+        }
+        t->width[i] = planes->width[i];
+        t->height[i] = planes->height[i];
+        t->format[i] = planes->format[i];
+    }
+    t->count = planes->count;
+    r->texReallocs++;
+    checkGlError("allocTextures");
+
+    LOGV("textures allocated %dx%d, planes:%d reallocs:%d", planes->width[0], planes->height[0],
+         planes->count, r->texReallocs);
+}
+
+static void dropFence(yuv_renderer_t *r, int set) {
+    if (r->fences[set] != EGL_NO_SYNC_KHR) {
+        r->destroySync(r->fenceDisplay, r->fences[set]);
+        r->fences[set] = EGL_NO_SYNC_KHR;
+    }
+}
+
+/*
+ * after a draw sampled the current set: the next upload into it knows when
+ * the GPU is done
+ */
+static void fenceTextures(yuv_renderer_t *r) {
+    if (!r->createSync) {
+        return;
+    }
+    int set = (int) (r->textures - r->sets);
+    dropFence(r, set);
+    r->fences[set] = r->createSync(r->fenceDisplay, EGL_SYNC_FENCE_KHR, NULL);
+}
 
-    positionHandle = glGetAttribLocation(gProgram, "aPosition");
+/*
+ * Set the next frame goes into. Writing a texture an earlier draw still
+ * samples makes the driver stall or shadow copy it; with several sets the
+ * one up next was drawn two or three frames ago and is normally free, the
+ * fence says for sure. With one set the fence is only looked at, to count
+ * how often the driver had to sort it out.
+ */
+static yuv_textures_t *nextTextureSet(yuv_renderer_t *r) {
+    int sets = dt_atomic_load_relaxed(&r->textureSets);
+    for (int i = sets; i < YUV_MAX_TEXTURE_SETS; i++) {
+        // fewer sets wanted than before
+        dropFence(r, i);
+        releaseTextures(r, &r->sets[i]);
+    }
+    int next = (int) (r->textures - r->sets + 1) % sets;
+    if (r->fences[next] == EGL_NO_SYNC_KHR) {
+        return &r->sets[next];
+    }
+    EGLint status = r->clientWaitSync(r->fenceDisplay, r->fences[next], 0, 0);
+    if (status == EGL_TIMEOUT_EXPIRED_KHR) {
+        r->busyUploads++;
+        if (sets > 1) {
+            int64_t start = dt_gettime();
+            r->clientWaitSync(r->fenceDisplay, r->fences[next], EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+                              EGL_FOREVER_KHR);
+            r->busyWaitTime += dt_gettime() - start;
+        }
+    }
+    dropFence(r, next);
+    return &r->sets[next];
+}
+
+static void updateTextures(yuv_renderer_t *r, dt_av_frame_t *frame, yuv_format_t *fmt, int scale) {
+    yuv_planes_t planes;
+    yuv_get_planes(frame, fmt, &planes);
+    scale = fitScale(r, &planes, fmt, scale);
+    r->shownScale = scale;
+    // texture geometry, draws only see the shrink in texSize/chromaSize
+    yuv_planes_t shrunk = planes;
+    for (int i = 0; i < planes.count; i++) {
+        shrunk.width[i] = downscale_size(planes.width[i], scale);
+        shrunk.height[i] = downscale_size(planes.height[i], scale);
+    }
+    yuv_textures_t *t = nextTextureSet(r);
+    if (!texturesMatch(t, &shrunk)) {
+        // first frame or resolution/format switch; 16-bit samples are
+        // filtered in the shader, see YUV_SAMPLE_PLANAR16
+        allocTextures(r, t, &shrunk, (fmt->depth > 8) ? GL_NEAREST : GL_LINEAR);
+    }
+
+    for (int i = 0; i < planes.count; i++) {
+        gl_bind_texture(&r->gl, i, t->ids[i]);
+        if (scale > 1) {
+            uploadPlaneScaled(r, &planes, i, planeKind(&planes, i, fmt), scale);
+        } else {
+            uploadPlane(r, planes.data[i], planes.linesize[i], planes.width[i], planes.height[i],
+                        planes.bpp[i], planes.format[i]);
+        }
+    }
+    // units 0..2 now hold t, what the following draws sample
+    r->textures = t;
+    checkGlError("updateTextures");
+}
+
+static bool setupProgram(yuv_renderer_t *r, int variant) {
+    yuv_program_t *p = &r->programs[variant];
+    p->program = createCachedProgram(gVertextShader, gFragmentShaders[variant]);
+    if (!p->program) {
+        LOGV("Could not create program, variant:%d", variant);
+        return false;
+    }
+
+    p->positionHandle = glGetAttribLocation(p->program, "aPosition");
     checkGlError("glGetAttribLocation");
-    if (positionHandle == -1) {
+    if (p->positionHandle == -1) {
         LOGV("%s: Could not get aPosition handle", __FUNCTION__);
-        return -1;
+        return false;
     }
 
-    textureHandle = glGetAttribLocation(gProgram, "aTextureCoord");
+    p->textureHandle = glGetAttribLocation(p->program, "aTextureCoord");
     checkGlError("glGetAttribLocation");
-    if (textureHandle == -1) {
+    if (p->textureHandle == -1) {
         LOGV("%s: Could not get aTextureCoord handle", __FUNCTION__);
-        return -1;
+        return false;
     }
 
+    p->texSizeHandle = glGetUniformLocation(p->program, "texSize");
+    p->chromaSizeHandle = glGetUniformLocation(p->program, "chromaSize");
+    p->depthScaleHandle = glGetUniformLocation(p->program, "depthScale");
+
+    gl_use_program(&r->gl, p->program);
+    int layout = variant % YUV_FORMAT_VARIANTS / YUV_MATRIX_NB;
+    if (layout == YUV_LAYOUT_PLANAR || layout == YUV_LAYOUT_PLANAR16) {
+        glUniform1i(glGetUniformLocation(p->program, "Ytex"), 0); /* Bind Ytex to texture unit 0 */
+        glUniform1i(glGetUniformLocation(p->program, "Utex"), 1); /* Bind Utex to texture unit 1 */
+        glUniform1i(glGetUniformLocation(p->program, "Vtex"), 2); /* Bind Vtex to texture unit 2 */
+    } else {
+        glUniform1i(glGetUniformLocation(p->program, "Ytex"), 0);
+        glUniform1i(glGetUniformLocation(p->program, "UVtex"), 1);
+    }
+    checkGlError("glUniform1i");
+    LOGV("program for variant %d ready", variant);
+    return true;
+}
+
+/*
+ * quad - YUV_VBO_QUAD or YUV_VBO_SNAPSHOT
+ */
+static void setupBuffers(yuv_renderer_t *r) {
+    glGenBuffers(1, &r->vbo);
+    gl_bind_buffer(&r->gl, GL_ARRAY_BUFFER, r->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertices) + sizeof(g_snapshotVertices), NULL,
+                 GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(r->vertices), r->vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(g_vertices), sizeof(g_snapshotVertices),
+                    g_snapshotVertices);
+    glGenBuffers(1, &r->ibo);
+    gl_bind_buffer(&r->gl, GL_ELEMENT_ARRAY_BUFFER, r->ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(g_indices), g_indices, GL_STATIC_DRAW);
+    checkGlError("setupBuffers");
+}
+
+static bool useProgram(yuv_renderer_t *r, int variant, const void *quad) {
+    yuv_program_t *p = &r->programs[variant];
+    if (!p->program && !setupProgram(r, variant)) {
+        return false;
+    }
+    gl_use_program(&r->gl, p->program);
+    checkGlError("glUseProgram");
+
     // set the vertices array in the shader
-    // _vertices contains 4 vertices with 5 coordinates.
+    // vertices contains 4 vertices with 5 coordinates.
     // 3 for (xyz) for the vertices and 2 for the texture
-    glVertexAttribPointer(positionHandle, 3, GL_FLOAT, false, 5 * sizeof(GLfloat), g_vertices);
-    checkGlError("glVertexAttribPointer aPosition");
+    gl_bind_buffer(&r->gl, GL_ARRAY_BUFFER, r->vbo);
+    if (gl_state_attribs(&r->gl, p->program, quad)) {
+        const GLubyte *uv = (const GLubyte *) quad + 3 * sizeof(GLfloat);
+        glVertexAttribPointer(p->positionHandle, 3, GL_FLOAT, false, 5 * sizeof(GLfloat), quad);
+        glEnableVertexAttribArray(p->positionHandle);
+        glVertexAttribPointer(p->textureHandle, 2, GL_FLOAT, false, 5 * sizeof(GLfloat), uv);
+        glEnableVertexAttribArray(p->textureHandle);
+    }
+    if (p->texSizeHandle != -1) {
+        glUniform2f(p->texSizeHandle, (GLfloat) r->textures->width[0], (GLfloat) r->textures->height[0]);
+    }
+    if (p->chromaSizeHandle != -1) {
+        glUniform2f(p->chromaSizeHandle, (GLfloat) r->textures->width[1], (GLfloat) r->textures->height[1]);
+    }
+    if (p->depthScaleHandle != -1) {
+        // low + 256 * high over 2^(depth - 8): limited range 10-bit 64..940
+        // lands exactly on 8-bit 16..235, what the matrices are made for
+        GLfloat scale = 1.0f / (GLfloat) (1 << (r->shownDepth - 8));
+        glUniform2f(p->depthScaleHandle, scale, 256.0f * scale);
+    }
+    checkGlError("glVertexAttribPointer");
+    return true;
+}
 
-    glEnableVertexAttribArray(positionHandle);
-    checkGlError("glEnableVertexAttribArray positionHandle");
+/*
+ * Aspect mode as quad size and texture window, the decoder keeps its
+ * native output size whatever the mode.
+ * NORMAL/4_3/16_9 fit the picture at its (forced) aspect ratio and leave
+ * bars, FULL stretches to the window, ZOOM fills the window and crops.
+ */
+static void updateGeometry(yuv_renderer_t *r) {
+    int mode = dt_atomic_load_relaxed(&r->videoMode);
+    GLfloat sx = 1.0f, sy = 1.0f;    // quad half size in NDC
+    GLfloat tx = 1.0f, ty = 1.0f;    // visible part of the texture
+    if (r->windowWidth > 0 && r->windowHeight > 0 && r->frameWidth > 0 && r->frameHeight > 0) {
+        GLfloat window = (GLfloat) r->windowWidth / r->windowHeight;
+        GLfloat aspect = (GLfloat) r->frameWidth / r->frameHeight;
+        if (mode == DT_SCREEN_MODE_4_3) {
+            aspect = YUV_ASPECT_4_3;
+        } else if (mode == DT_SCREEN_MODE_16_9) {
+            aspect = YUV_ASPECT_16_9;
+        } else if (mode == DT_SCREEN_MODE_FULL) {
+            aspect = window;
+        }
+        if (mode == DT_SCREEN_MODE_ZOOM) {
+            if (aspect > window) {
+                tx = window / aspect;
+            } else {
+                ty = aspect / window;
+            }
+        } else if (aspect > window) {
+            sy = window / aspect;
+        } else {
+            sx = aspect / window;
+        }
+    }
 
-    // set the texture coordinate array in the shader
-    // _vertices contains 4 vertices with 5 coordinates.
-    // 3 for (xyz) for the vertices and 2 for the texture
-    glVertexAttribPointer(textureHandle, 2, GL_FLOAT, false, 5 * sizeof(GLfloat), &g_vertices[3]);
-    checkGlError("glVertexAttribPointer maTextureHandle");
-    glEnableVertexAttribArray(textureHandle);
-    checkGlError("glEnableVertexAttribArray textureHandle");
-
-
-    glUseProgram(gProgram);
-    int i = glGetUniformLocation(gProgram, "Ytex");
-    checkGlError("glGetUniformLocation");
-    glUniform1i(i, 0); /* Bind Ytex to texture unit 0 */
-    checkGlError("glUniform1i Ytex");
-
-    i = glGetUniformLocation(gProgram, "Utex");
-    checkGlError("glGetUniformLocation Utex");
-    glUniform1i(i, 1); /* Bind Utex to texture unit 1 */
-    checkGlError("glUniform1i Utex");
-
-    i = glGetUniformLocation(gProgram, "Vtex");
-    checkGlError("glGetUniformLocation");
-    glUniform1i(i, 2); /* Bind Vtex to texture unit 2 */
-    checkGlError("glUniform1i");
+    GLfloat u0 = 0.5f - tx / 2, u1 = 0.5f + tx / 2;
+    GLfloat v0 = 0.5f - ty / 2, v1 = 0.5f + ty / 2;
+    GLfloat vertices[20] = {
+            // X, Y, Z, U, V
+            -sx, -sy, 0, u0, v1, // Bottom Left
+            sx, -sy, 0, u1, v1, //Bottom Right
+            sx, sy, 0, u1, v0, //Top Right
+            -sx, sy, 0, u0, v0 //Top Left
+    };
+    memcpy(r->vertices, vertices, sizeof(vertices));
+    if (r->vbo) {
+        gl_bind_buffer(&r->gl, GL_ARRAY_BUFFER, r->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+    }
+
+    // on screen pixels per source pixel, bicubic only pays off above 1
+    r->upscale = (sx * r->windowWidth > tx * r->frameWidth + 0.5f) ||
+                 (sy * r->windowHeight > ty * r->frameHeight + 0.5f);
+    // the other way round: at 2 or 4 source pixels per screen pixel on both
+    // axes a texture that much smaller still has one texel per pixel
+    r->uploadScale = 1;
+    if (r->windowWidth > 0 && r->windowHeight > 0 && r->frameWidth > 0 && r->frameHeight > 0) {
+        GLfloat ratioX = tx * r->frameWidth / (sx * r->windowWidth);
+        GLfloat ratioY = ty * r->frameHeight / (sy * r->windowHeight);
+        GLfloat ratio = (ratioX < ratioY) ? ratioX : ratioY;
+        r->uploadScale = (ratio >= 4.0f) ? 4 : (ratio >= 2.0f) ? 2 : 1;
+    }
+    r->geometryMode = mode;
+    r->geometryDirty = 0;
+    LOGV("geometry mode:%d window %dx%d frame %dx%d quad %.3fx%.3f tex %.3fx%.3f upscale:%d "
+         "uploadScale:%d", mode, r->windowWidth, r->windowHeight, r->frameWidth, r->frameHeight,
+         sx, sy, tx, ty, r->upscale, r->uploadScale);
+}
+
+bool yuv_setupGraphics(yuv_renderer_t *r, int w, int h) {
+    printGLString("Version", GL_VERSION);
+    printGLString("Vendor", GL_VENDOR);
+    printGLString("Renderer", GL_RENDERER);
+    printGLString("Extensions", GL_EXTENSIONS);
+
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    r->hasUnpackRowLength = (version && strstr(version, "OpenGL ES 3.") != NULL) ||
+                                (extensions && strstr(extensions, "GL_EXT_unpack_subimage") != NULL);
+    LOGV("unpack row length %s", r->hasUnpackRowLength ? "supported" : "not supported");
+    // sized luminance formats only exist through the extension, GLES3 core
+    // TexStorage would need R8/RG8 and different swizzles in the shaders
+    r->texStorage2D = NULL;
+    if (extensions && strstr(extensions, "GL_EXT_texture_storage") != NULL) {
+        r->texStorage2D = (PFNGLTEXSTORAGE2DEXTPROC) eglGetProcAddress("glTexStorage2DEXT");
+    }
+    LOGV("texture storage %s", r->texStorage2D ? "immutable" : "mutable");
+    // fences tell when the GPU is done with a texture set, see nextTextureSet
+    EGLDisplay display = eglGetCurrentDisplay();
+    const char *eglExtensions = (display != EGL_NO_DISPLAY) ?
+                                eglQueryString(display, EGL_EXTENSIONS) : NULL;
+    r->createSync = NULL;
+    if (eglExtensions && strstr(eglExtensions, "EGL_KHR_fence_sync") != NULL) {
+        r->createSync = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+        r->clientWaitSync = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+        r->destroySync = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+        if (!r->clientWaitSync || !r->destroySync) {
+            r->createSync = NULL;
+        }
+    }
+    r->fenceDisplay = display;
+    LOGV("fence sync %s", r->createSync ? "supported" : "not supported");
+    gl_debug_setup();
+    // odd widths and chroma planes are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    r->windowWidth = (GLuint) w;
+    r->windowHeight = (GLuint) h;
+    r->geometryDirty = 1;
+    LOGV("setupGraphics(%d, %d)", w, h);
+
+    int maxTextureImageUnits[2];
+    int maxTextureSize[2];
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, maxTextureImageUnits);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, maxTextureSize);
+    LOGV("%s: number of textures %d, size %d", __FUNCTION__, (int) maxTextureImageUnits[0],
+         (int) maxTextureSize[0]);
+
+    // programs survive a surface change on the same context, they are only
+    // built when a frame first needs them
+    setupProgramCache();
 
     glViewport(0, 0, w, h);
     checkGlError("glViewport");
@@ -245,34 +948,161 @@ bool yuv_setupGraphics(int w, int h) {
     return true;
 }
 
-static dt_av_frame_t g_frame;
-static dt_lock_t mutex;
-static int frame_valid = 0;
-static int g_inited = 0;
-static android::DTPlayer *g_dtp;
+yuv_renderer_t *yuv_renderer_create() {
+    yuv_renderer_t *r = (yuv_renderer_t *) malloc(sizeof(yuv_renderer_t));
+    if (!r) {
+        return NULL;
+    }
+    memset(r, 0, sizeof(yuv_renderer_t));
+    r->snapshot = snapshot_create();
+    if (!r->snapshot) {
+        free(r);
+        return NULL;
+    }
+    r->idle = 1;
+    r->shownVariant = -1;
+    r->shownPts = -1;
+    r->videoMode = DT_SCREEN_MODE_NORMAL;
+    r->upscaleFilter = YUV_UPSCALE_FILTER_BICUBIC;
+    r->downscale = 1;
+    r->uploadScale = 1;
+    memcpy(r->vertices, g_vertices, sizeof(g_vertices));
+    r->textures = &r->sets[0];
+    r->textureSets = 1;
+    gl_state_reset(&r->gl);
+    r->geometryDirty = 1;
+    dt_lock_init(&r->wakeupLock, NULL);
+    // pictures are allocated inside libdtp and stolen by the vo, freed here
+    mailbox_init(&r->mailbox, NULL);
+    scheduler_init(&r->scheduler, &r->mailbox, NULL);
+    LOGV("yuv renderer %p created\n", r);
+    return r;
+}
 
-void yuv_dttv_init() {
-    dt_lock_init(&mutex, NULL);
-    memset(&g_frame, 0, sizeof(dt_av_frame_t));
-    frame_valid = 0;
-    g_inited = 1;
-    g_dtp = NULL;
+void yuv_set_master_clock(yuv_renderer_t *r, int64_t (*master)(void *opaque), void *opaque) {
+    sched_clock_t clock = {NULL, master, opaque};
+    scheduler_init(&r->scheduler, &r->mailbox, &clock);
+}
+
+void yuv_renderer_destroy(yuv_renderer_t *r) {
+    if (!r) {
+        return;
+    }
+    // GL names die with their context, only frames and memory are ours
+    scheduler_flush(&r->scheduler);
+    scheduler_release(&r->scheduler, &r->lastFrame);
+    for (int i = 0; i < YUV_MAX_TEXTURE_SETS; i++) {
+        // display level objects, fine from any thread
+        dropFence(r, i);
+    }
+    snapshot_destroy(r->snapshot);
+    free(r->uploadStaging);
+    LOGV("yuv renderer %p destroyed\n", r);
+    free(r);
+}
+
+void yuv_dttv_init(yuv_renderer_t *r) {
+    if (r->inited) {
+        mailbox_stat_t stat;
+        mailbox_get_stat(&r->mailbox, &stat);
+        LOGV("mailbox stat: pushed:%d overwritten:%d late:%d \n", stat.pushed, stat.overwritten,
+             stat.late);
+    }
+    // the mailbox lives as long as the renderer, the vo thread may be
+    // pushing into it right now; only drain what the old context missed
+    scheduler_flush(&r->scheduler);
+    dt_atomic_store(&r->inited, 1);
+    dt_atomic_store(&r->idle, 1);
+    // called from onSurfaceCreated: new context, old program names are gone
+    memset(r->programs, 0, sizeof(r->programs));
+    for (int i = 0; i < YUV_MAX_TEXTURE_SETS; i++) {
+        dropFence(r, i);
+    }
+    memset(r->sets, 0, sizeof(r->sets));
+    r->textures = &r->sets[0];
+    r->vbo = r->ibo = 0;
+    r->timerReady = 0;
+    r->lastDraw = 0;
+    gl_state_reset(&r->gl);
+    // lastFrame stays: the first draw puts it back, rotation or resume while
+    // paused shows the picture again without the decoder
+    r->shownVariant = -1;
+    r->shownPts = -1;
+    r->frameWidth = r->frameHeight = 0;
+    r->geometryDirty = 1;
+    snapshot_reset_gl(r->snapshot);
 
     // Fixme -
-    g_windowWidth = g_windowHeight = 0;
-    g_textureHeight = g_textureWidth = 0;
+    r->windowWidth = r->windowHeight = 0;
 
     LOGV("yuv dttv init\n");
 }
 
-void yuv_reg_player(void *mp) {
-    g_dtp = (android::DTPlayer *) mp;
+void yuv_reg_player(yuv_renderer_t *r, void *mp) {
+    r->dtp = (android::DTPlayer *) mp;
     LOGV("register dtplayer to glesv2\n");
 }
 
-int yuv_update_frame(dt_av_frame_t *frame) {
-    int ret = 0;
-    if (g_inited == 0) {
+void yuv_set_wakeup(yuv_renderer_t *r, void (*wakeup)(void *opaque), void *opaque) {
+    dt_lock(&r->wakeupLock);
+    r->wakeup = wakeup;
+    r->wakeupOpaque = opaque;
+    dt_unlock(&r->wakeupLock);
+}
+
+void yuv_set_video_mode(yuv_renderer_t *r, int mode) {
+    // picked up by the next draw, nothing on the decoder side changes
+    dt_atomic_store(&r->videoMode, mode);
+}
+
+void yuv_set_upscale_filter(yuv_renderer_t *r, int filter) {
+    if (filter < 0 || filter >= YUV_UPSCALE_FILTER_NB) {
+        return;
+    }
+    dt_atomic_store(&r->upscaleFilter, filter);
+}
+
+void yuv_set_downscale(yuv_renderer_t *r, int enable) {
+    // next draw, it uploads the shown frame again at the new size
+    dt_atomic_store(&r->downscale, enable ? 1 : 0);
+}
+
+int yuv_set_texture_sets(yuv_renderer_t *r, int sets) {
+    if (sets < 1 || sets > YUV_MAX_TEXTURE_SETS) {
+        return -1;
+    }
+    // next upload rotates over the new count
+    dt_atomic_store(&r->textureSets, sets);
+    return 0;
+}
+
+static void wakeRenderLoop(yuv_renderer_t *r) {
+    // counted before the idle check: a loop parking right now sees it in
+    // yuv_park, whatever the work was (frame, snapshot)
+    dt_atomic_inc(&r->work);
+    // while the render loop runs every vsync it picks frames up by itself,
+    // only a parked loop needs the round trip through java
+    if (!dt_atomic_cas(&r->idle, 1, 0)) {
+        return;
+    }
+    dt_lock(&r->wakeupLock);
+    if (r->wakeup) {
+        // native render thread, no JVM involved
+        r->wakeup(r->wakeupOpaque);
+        dt_unlock(&r->wakeupLock);
+        return;
+    }
+    dt_unlock(&r->wakeupLock);
+    if (!r->dtp) {
+        LOGV("mp null \n");
+        return;
+    }
+    r->dtp->Notify(MEDIA_FRESH_VIDEO);
+    LOGV("Wake render loop");
+}
+
+int yuv_update_frame(yuv_renderer_t *r, dt_av_frame_t *frame) {
+    if (!dt_atomic_load(&r->inited)) {
         if (frame->data[0]) {
             free(frame->data[0]);
         }
@@ -280,52 +1110,193 @@ int yuv_update_frame(dt_av_frame_t *frame) {
         return 0;
     }
 
-    dt_lock(&mutex);
-    // check frame not displayed
-    if (frame_valid == 1 && g_frame.data) {
-        free(g_frame.data[0]);
-    }
-    memcpy(&g_frame, frame, sizeof(dt_av_frame_t));
-    frame_valid = 1;
-    dt_unlock(&mutex);
+    // never blocks: an undisplayed frame gets replaced instead
+    scheduler_push(&r->scheduler, frame);
+    wakeRenderLoop(r);
+    return 0;
+}
 
-    if (!g_dtp) {
-        LOGV("mp null \n");
-        return 0;
+int yuv_request_snapshot(yuv_renderer_t *r, int width, int height, snapshot_cb_t cb,
+                         void *opaque) {
+    if (snapshot_request(r->snapshot, width, height, cb, opaque) < 0) {
+        return -1;
     }
-    g_dtp->Notify(MEDIA_FRESH_VIDEO);
-    LOGV("Refresh one frame");
+    // paused: the loop has to come round once more to draw it
+    wakeRenderLoop(r);
     return 0;
 }
 
+static void checkGeometry(yuv_renderer_t *r) {
+    if (r->geometryDirty || r->geometryMode != dt_atomic_load_relaxed(&r->videoMode)) {
+        updateGeometry(r);
+    }
+}
+
+// 1/n the next upload shrinks the frame to
+static int wantedScale(yuv_renderer_t *r) {
+    return dt_atomic_load_relaxed(&r->downscale) ? r->uploadScale : 1;
+}
 
-void yuv_renderFrame() {
-    if (frame_valid != 1) {
-        return;
+static void uploadFrame(yuv_renderer_t *r, dt_av_frame_t *frame) {
+    yuv_format_t fmt;
+    yuv_get_format(frame->pixfmt, &fmt);
+    int variant = getVariant(frame, &fmt);
+    int layout = fmt.layout;
+    if (r->frameWidth != frame->width || r->frameHeight != frame->height) {
+        r->frameWidth = frame->width;
+        r->frameHeight = frame->height;
+        r->geometryDirty = 1;
     }
-    dt_lock(&mutex);
-    uint8_t *data = (uint8_t *) (g_frame.data[0]);
-    int width = g_frame.width;
-    int height = g_frame.height;
+    // how much the upload may shrink follows from the quad of this frame
+    checkGeometry(r);
 
-    glUseProgram(gProgram);
-    checkGlError("glUseProgram");
-    if (g_textureWidth != g_windowWidth ||
-        g_textureHeight != g_windowHeight) {
-        LOGV("TEXTREUE w:%d h:%d . [%d:%d] \n", (int) g_textureWidth, (int) g_textureHeight,
-             (int) g_windowWidth, (int) g_windowHeight);
-        setupTextures(data, width, height);
-        g_textureWidth = g_windowWidth;
-        g_textureHeight = g_windowHeight;
-    } else {
-        UpdateTextures(data, width, height);
+    int64_t start = dt_gettime();
+    updateTextures(r, frame, &fmt, wantedScale(r));
+    r->uploadTime[layout] += dt_gettime() - start;
+    if (++r->uploadFrames[layout] == UPLOAD_STAT_FRAMES) {
+        LOGV("upload layout:%d avg %lld us/frame, scale:1/%d sets:%d busy:%d waited:%lld us \n",
+             layout, (long long) (r->uploadTime[layout] / UPLOAD_STAT_FRAMES), r->shownScale,
+             r->textureSets, r->busyUploads, (long long) r->busyWaitTime);
+        r->uploadTime[layout] = 0;
+        r->uploadFrames[layout] = 0;
+        r->busyUploads = 0;
+        r->busyWaitTime = 0;
     }
+    r->shownVariant = variant;
+    r->shownDepth = fmt.depth;
+    r->shownPts = frame->pts;
+}
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, g_indices);
+static void drawFrame(yuv_renderer_t *r) {
+    // bars of the fit modes, and swaps may leave the back buffer undefined
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (r->shownVariant < 0) {
+        return;
+    }
+    checkGeometry(r);
+    int filter = r->upscale ? dt_atomic_load_relaxed(&r->upscaleFilter) : YUV_UPSCALE_FILTER_BILINEAR;
+    if (!r->vbo) {
+        setupBuffers(r);
+    }
+    if (!useProgram(r, filter * YUV_FORMAT_VARIANTS + r->shownVariant, YUV_VBO_QUAD)) {
+        return;
+    }
+    gl_bind_buffer(&r->gl, GL_ELEMENT_ARRAY_BUFFER, r->ibo);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
     checkGlError("glDrawArrays");
-    free(data);
-    frame_valid = 0;
-    memset(&g_frame, 0, sizeof(dt_av_frame_t));
-    dt_unlock(&mutex);
-    LOGV("Draw one frame");
-}
\ No newline at end of file
+    fenceTextures(r);
+}
+
+static void drawSnapshot(yuv_renderer_t *r) {
+    // readback of an earlier draw first, its FBO is reused
+    snapshot_poll(r->snapshot);
+    if (r->shownVariant < 0 || !r->vbo ||
+        !snapshot_begin(r->snapshot, &r->gl, r->frameWidth, r->frameHeight)) {
+        return;
+    }
+    // bilinear is plenty for a downscale
+    if (useProgram(r, YUV_UPSCALE_FILTER_BILINEAR * YUV_FORMAT_VARIANTS + r->shownVariant,
+                   YUV_VBO_SNAPSHOT)) {
+        gl_bind_buffer(&r->gl, GL_ELEMENT_ARRAY_BUFFER, r->ibo);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
+        fenceTextures(r);
+    }
+    snapshot_end(r->snapshot, r->shownPts, r->windowWidth, r->windowHeight);
+}
+
+dt_av_frame_t *yuv_acquire_frame(yuv_renderer_t *r, int *idle) {
+    *idle = 0;
+    r->workSeen = dt_atomic_load(&r->work);
+    return scheduler_on_vsync(&r->scheduler, idle);
+}
+
+void yuv_release_frame(yuv_renderer_t *r, dt_av_frame_t *frame) {
+    scheduler_release(&r->scheduler, frame);
+}
+
+int yuv_park(yuv_renderer_t *r, int idle) {
+    if (!idle) {
+        // running loop picks frames up itself, keep producers from waking it
+        if (dt_atomic_load_relaxed(&r->idle)) {
+            dt_atomic_store(&r->idle, 0);
+        }
+        return 0;
+    }
+    // park, unless work came in after this loop looked: its producer may
+    // have found idle still clear and not woken us. From here on producers
+    // see idle set and wake us through MEDIA_FRESH_VIDEO
+    dt_atomic_store(&r->idle, 1);
+    dt_atomic_fence();
+    if (dt_atomic_load(&r->work) != r->workSeen && dt_atomic_cas(&r->idle, 1, 0)) {
+        return 0;
+    }
+    return 1;
+}
+
+static void addGpuTime(void *opaque, int stage, int64_t ns) {
+    yuv_renderer_t *r = (yuv_renderer_t *) opaque;
+    stats_add(&r->stats, (stage == YUV_TIMER_UPLOAD) ? STATS_UPLOAD_GPU : STATS_DRAW_GPU,
+              ns / 1000);
+}
+
+int yuv_renderFrame(yuv_renderer_t *r) {
+    if (!r->timerReady) {
+        gl_timer_setup(&r->timer);
+        dt_atomic_store(&r->stats.gpuTimer, r->timer.supported);
+        r->timerReady = 1;
+    }
+    // upload + draw run without holding anything the decoder side waits on
+    int idle = 0;
+    dt_av_frame_t *frame = yuv_acquire_frame(r, &idle);
+    int64_t start = dt_gettime();
+    if (frame) {
+        gl_timer_begin(&r->timer, YUV_TIMER_UPLOAD);
+        uploadFrame(r, frame);
+        gl_timer_end(&r->timer);
+        stats_add(&r->stats, STATS_UPLOAD_CPU, dt_gettime() - start);
+        // keep it instead of the previous one: the picture libdtp malloc'd and
+        // the vo stole, held until the next frame replaces it
+        yuv_release_frame(r, &r->lastFrame);
+        memcpy(&r->lastFrame, frame, sizeof(dt_av_frame_t));
+        memset(frame, 0, sizeof(dt_av_frame_t));
+    } else if (r->lastFrame.data[0]) {
+        checkGeometry(r);
+        // textures went with the old context, or the surface or mode changed
+        // what size they should have
+        if (r->shownVariant < 0 || r->shownScale != wantedScale(r)) {
+            uploadFrame(r, &r->lastFrame);
+        }
+    }
+
+    // draws of a running loop are one refresh apart, or it missed some
+    int64_t drawStart = dt_gettime();
+    if (r->lastDraw) {
+        int64_t interval = drawStart - r->lastDraw;
+        stats_add(&r->stats, STATS_INTERVAL, interval);
+        int period = r->scheduler.stat.vsync_period;
+        if (period > 0 && interval > period * 3 / 2) {
+            stats_add_jank(&r->stats);
+        }
+    }
+    r->lastDraw = drawStart;
+    gl_timer_begin(&r->timer, YUV_TIMER_DRAW);
+    // without a new frame this repeats what is in the textures
+    drawFrame(r);
+    drawSnapshot(r);
+    gl_timer_end(&r->timer);
+    stats_add(&r->stats, STATS_DRAW_CPU, dt_gettime() - drawStart);
+    gl_timer_next_frame(&r->timer, addGpuTime, r);
+
+    // a readback in flight finishes on a later draw
+    if (!yuv_park(r, idle && !snapshot_busy(r->snapshot))) {
+        return 0;
+    }
+    // the gap until something wakes us is no frame interval
+    r->lastDraw = 0;
+    LOGV("render loop idle");
+    return 1;
+}
+
+render_stats_t *yuv_get_stats(yuv_renderer_t *r) {
+    return &r->stats;
+}
@@ -5,16 +5,159 @@
 #ifndef GLES2JNI_GL_YUV_H
 #define GLES2JNI_GL_YUV_H
 
+#include <GLES2/gl2.h>
+#include <stdint.h>
+
+extern "C" {
 #include "../../../../3rd/libdtp/include/dt_av.h"
+}
+
+#include "gl_snapshot.h"
+#include "render_stats.h"
+
+// not in libdtp: fill the window keeping the aspect ratio, crop the rest
+#define DT_SCREEN_MODE_ZOOM (DT_SCREEN_MODE_16_9 + 1)
+
+enum {
+    YUV_UPSCALE_FILTER_BILINEAR = 0,
+    YUV_UPSCALE_FILTER_BICUBIC,     // luma only, used when the picture is enlarged
+    YUV_UPSCALE_FILTER_NB,
+};
+
+// streams at least this tall are taken as BT.709, libdtp does not
+// forward the colorspace signalled in the bitstream
+#define YUV_HD_HEIGHT 720
+
+enum {
+    YUV_LAYOUT_PLANAR = 0,  // I420/I422/I444, 3 luminance textures
+    YUV_LAYOUT_NV12,        // Y + interleaved UV
+    YUV_LAYOUT_NV21,        // Y + interleaved VU
+    YUV_LAYOUT_PLANAR16,    // 9 to 16 bit planar in little-endian words, 3 luminance-alpha textures
+    YUV_LAYOUT_NB,
+};
+
+typedef struct {
+    int layout;
+    int chromaShiftW;
+    int chromaShiftH;
+    int fullRange;
+    int depth;              // bits per sample, above 8 samples are 16-bit words
+} yuv_format_t;
+
+typedef struct {
+    int count;
+    const uint8_t *data[3];
+    int linesize[3];
+    int width[3];
+    int height[3];
+    int bpp[3];
+    GLenum format[3];
+} yuv_planes_t;
+
+void yuv_get_format(int pixfmt, yuv_format_t *fmt);
+
+/*
+ * Resolve plane pointers/strides of a frame.
+ * Pictures that only set data[0] are the legacy contiguous layout.
+ */
+void yuv_get_planes(dt_av_frame_t *frame, yuv_format_t *fmt, yuv_planes_t *planes);
+
+/*
+ * GL renderer state of one player: programs, textures and the frame queue
+ * between its vo and its GL thread. Players never share one, so several
+ * can render at the same time (PiP, preview tiles, A/B comparisons).
+ */
+typedef struct yuv_renderer yuv_renderer_t;
+
+yuv_renderer_t *yuv_renderer_create();
+
+/*
+ * media clock frames are picked against, see sched_clock_t.master; without
+ * one the clock is recovered from frame arrival
+ * before r gets its first frame or draw
+ */
+void yuv_set_master_clock(yuv_renderer_t *r, int64_t (*master)(void *opaque), void *opaque);
+
+/*
+ * frees queued frames, GL objects are left to their context
+ * the vo and the GL thread must be done with r
+ */
+void yuv_renderer_destroy(yuv_renderer_t *r);
+
+/*
+ * new GL context (onSurfaceCreated / render thread start)
+ */
+void yuv_dttv_init(yuv_renderer_t *r);
+
+void yuv_reg_player(yuv_renderer_t *r, void *mp);
+
+/*
+ * wake a parked render loop without going through java, replaces the
+ * MEDIA_FRESH_VIDEO notify while set; NULL restores it
+ */
+void yuv_set_wakeup(yuv_renderer_t *r, void (*wakeup)(void *opaque), void *opaque);
+
+/*
+ * aspect mode DT_SCREEN_MODE_* / DT_SCREEN_MODE_ZOOM, any thread, applied
+ * on the GL side through the quad and its texture coordinates
+ */
+void yuv_set_video_mode(yuv_renderer_t *r, int mode);
+
+/*
+ * YUV_UPSCALE_FILTER_*, default bicubic
+ */
+void yuv_set_upscale_filter(yuv_renderer_t *r, int filter);
+
+/*
+ * frames with 2 or 4 times the pixels of the surface area showing them
+ * are shrunk as much on the CPU before upload, default on
+ */
+void yuv_set_downscale(yuv_renderer_t *r, int enable);
+
+/*
+ * texture sets uploads rotate through, 1..3, default 1; with more the
+ * upload of a frame does not have to wait for the GPU to finish the draws
+ * of the previous one, at the cost of that much more texture memory
+ * @return -1 out of range
+ */
+int yuv_set_texture_sets(yuv_renderer_t *r, int sets);
+
+int yuv_update_frame(yuv_renderer_t *r, dt_av_frame_t *frame);
+
+/*
+ * grab the next drawn frame at width x height, see gl_snapshot.h; cb runs
+ * on the GL thread a draw or two later
+ * @return -1 when one is already pending
+ */
+int yuv_request_snapshot(yuv_renderer_t *r, int width, int height, snapshot_cb_t cb,
+                         void *opaque);
+
+bool yuv_setupGraphics(yuv_renderer_t *r, int w, int h);
 
-void yuv_dttv_init();
+/*
+ * draw callback, meant to run once per vsync
+ * @return 1 when no frame came in for a while and the caller may stop
+ *         calling until MEDIA_FRESH_VIDEO, 0 otherwise
+ */
+int yuv_renderFrame(yuv_renderer_t *r);
 
-void yuv_reg_player(void *mp);
+/*
+ * timing of yuv_renderFrame, any thread, see render_stats.h
+ */
+render_stats_t *yuv_get_stats(yuv_renderer_t *r);
 
-int yuv_update_frame(dt_av_frame_t *frame);
+/*
+ * pieces of yuv_renderFrame for GL code that draws r's frames itself
+ * (mosaic), call once per vsync in this order:
+ * acquire - frame due at this refresh or NULL, *idle as scheduler_on_vsync
+ * release - hand the frame back once uploaded
+ * park    - idle result of the whole loop, 1 when parked and the next frame
+ *           wakes it; pass 0 to keep r's producer from waking a running loop
+ */
+dt_av_frame_t *yuv_acquire_frame(yuv_renderer_t *r, int *idle);
 
-bool yuv_setupGraphics(int w, int h);
+void yuv_release_frame(yuv_renderer_t *r, dt_av_frame_t *frame);
 
-void yuv_renderFrame();
+int yuv_park(yuv_renderer_t *r, int idle);
 
 #endif //GLES2JNI_GL_YUV_H
@@ -0,0 +1,23 @@
+/*
+ * native_atomic.h
+ *
+ * Thin wrappers over the gcc/clang __atomic builtins, shared by the
+ * C (plugin/) and C++ parts of the jni layer. Same spirit as dt_lock.h.
+ */
+
+#ifndef NATIVE_ATOMIC_H
+#define NATIVE_ATOMIC_H
+
+#define dt_atomic_load(x)          __atomic_load_n(x, __ATOMIC_ACQUIRE)
+#define dt_atomic_load_relaxed(x)  __atomic_load_n(x, __ATOMIC_RELAXED)
+#define dt_atomic_store(x, v)      __atomic_store_n(x, v, __ATOMIC_RELEASE)
+#define dt_atomic_store_relaxed(x, v) __atomic_store_n(x, v, __ATOMIC_RELAXED)
+#define dt_atomic_cas(x, o, n)     __sync_bool_compare_and_swap(x, o, n)
+#define dt_atomic_add(x, v)        __atomic_add_fetch(x, v, __ATOMIC_ACQ_REL)
+#define dt_atomic_inc(x)           dt_atomic_add(x, 1)
+#define dt_atomic_dec(x)           dt_atomic_add(x, -1)
+#define dt_atomic_fence_acquire()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define dt_atomic_fence_release()  __atomic_thread_fence(__ATOMIC_RELEASE)
+#define dt_atomic_fence()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
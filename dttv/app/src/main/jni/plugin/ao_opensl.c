@@ -6,24 +6,60 @@
  *****************************************************************************/
 
 #include "../dtaudio_android.h"
-#include "dt_buffer.h"
+#include "../native_atomic.h"
 #include "dt_lock.h"
+#include "pcm_ring.h"
+#include "audio_clock.h"
+#include "ao_opensl.h"
+#include "resample.h"
+#include "sample_conv.h"
 
 #include <assert.h>
 #include <dlfcn.h>
 #include <math.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <android/log.h>
+#include <sys/system_properties.h>
 
 // For native audio
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
 
-#define OPENSLES_BUFFERS 255 /* maximum number of buffers */
+#ifndef SL_ANDROID_DATAFORMAT_PCM_EX
+/* from the API 21 headers, the build targets 19 */
+#define SL_ANDROID_DATAFORMAT_PCM_EX            ((SLuint32) 0x00000004)
+#define SL_ANDROID_PCM_REPRESENTATION_FLOAT     ((SLuint32) 0x00000003)
+
+typedef struct SLAndroidDataFormat_PCM_EX_ {
+    SLuint32 formatType;
+    SLuint32 numChannels;
+    SLuint32 sampleRate;
+    SLuint32 bitsPerSample;
+    SLuint32 containerSize;
+    SLuint32 channelMask;
+    SLuint32 endianness;
+    SLuint32 representation;
+} SLAndroidDataFormat_PCM_EX;
+#endif
+
+#define OPENSLES_BUFFERS 4    /* periods queued on the device */
 #define OPENSLES_BUFLEN  10   /* ms */
+#define OPENSLES_RING    200  /* ms of pcm waiting for the callback */
+#define OPENSLES_BURST   5000 /* us, when the device burst is unknown */
+#define OPENSLES_MIN_BUFFERS 2
+#define OPENSLES_MAX_BUFFERS 8    /* adaptive */
+#define OPENSLES_STABLE  30   /* s without underruns before the adaptive queue shallows */
+#define OPENSLES_POWER_BUFLEN 100 /* ms */
+#define OPENSLES_POWER_RING   500 /* ms */
+#define OPENSLES_RATE    48000    /* device rate when unknown */
+#define OPENSLES_FLOAT_SDK 21     /* first release taking float pcm */
 /*
- * 10ms of precision when mesasuring latency should be enough,
- * with 255 buffers we can buffer 2.55s of audio.
+ * 10ms of precision when mesasuring latency should be enough. The writer
+ * only fills the ring, the buffer queue callback moves one period from the
+ * ring to the device for each period played, so the device queue stays
+ * at 40ms whether or not the writer thread gets scheduled in time. The
+ * other profiles in ao_opensl.h change period and depth.
  */
 
 #define CHECK_OPENSL_ERROR(msg)                \
@@ -48,6 +84,7 @@ typedef SLresult (*slCreateEngine_t)(
 #define Clear(a) (*a)->Clear(a)
 #define GetState(a, b) (*a)->GetState(a, b)
 #define SetPositionUpdatePeriod(a, b) (*a)->SetPositionUpdatePeriod(a, b)
+#define GetPosition(a, b) (*a)->GetPosition(a, b)
 #define SetVolumeLevel(a, b) (*a)->SetVolumeLevel(a, b)
 #define SetMute(a, b) (*a)->SetMute(a, b)
 
@@ -84,17 +121,36 @@ typedef struct aout_sys_t {
     SLInterfaceID SL_IID_VOLUME;
     SLInterfaceID SL_IID_PLAY;
 
-    /* audio buffered through opensles */
+    /* audio buffered through opensles, callback only once playing */
     uint8_t *buf;
     int samples_per_buf;
+    int buffers;        /* allocated and the device queue size */
+    int depth;          /* periods kept queued, <= buffers */
     int next_buf;
+    int stable;         /* periods played since the last underrun */
+    int stable_periods; /* adaptive shallows after that many */
+
+    int profile;        /* AO_OPENSL_PROFILE_* taken at Open */
 
-    int rate;
+    int rate;           /* device side, pcm is resampled to it */
+    resampler_t *resampler;
+    int16_t *scratch;   /* writer only, resampled pcm */
+    int scratch_frames;
+
+    int format;         /* SAMPLE_* on the device, s16 ahead of the resampler */
+    int frame_bytes;    /* device side */
+    int in_bytes;       /* input frame */
+    int convert;        /* input is not in the device format */
+    sample_conv_t conv; /* writer only, input -> format */
+    uint8_t *conv_buf;
+    int conv_frames;
 
     /* if we can measure latency already */
     int started;
-    int samples;
-    dt_buffer_t dbt;
+    pcm_ring_t ring;    /* writer -> callback */
+    audio_clock_t clock;    /* callback -> any reader */
+    int clocked;            /* counted in g_clock */
+    int64_t last_latency;   /* pts units, ao_opensl_get_latency's last good one */
     dt_lock_t lock;
 } aout_sys_t;
 
@@ -117,43 +173,138 @@ typedef struct{
 
 #define TAG "AO-OPENSL"
 
+/* process wide, the player library registers a single audio output */
+static struct {
+    int profile;
+    int burst_us;
+    int device_rate;
+    int resample;
+    /* AO_OPENSL_STAT_*, written by the callback */
+    int underruns;
+    int silent;
+    int depth;
+    int period_us;
+} g_opensl = {AO_OPENSL_PROFILE_DEFAULT, 0, 0, RESAMPLE_MEDIUM, 0, 0, 0, 0};
+
+/* the stream ao_opensl_clock reads, NULL unless exactly one is playing */
+static struct {
+    dt_lock_t lock;     /* attach and detach only */
+    aout_sys_t *sys;    /* published for the lock free readers */
+    int readers;        /* in ao_opensl_clock, a detach waits them out */
+    int streams;
+} g_clock = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+int ao_opensl_set_profile(int profile) {
+    if (profile < AO_OPENSL_PROFILE_DEFAULT || profile > AO_OPENSL_PROFILE_ADAPTIVE)
+        return -1;
+    dt_atomic_store(&g_opensl.profile, profile);
+    return 0;
+}
+
+void ao_opensl_set_burst(int burst_us) {
+    dt_atomic_store(&g_opensl.burst_us, (burst_us > 0) ? burst_us : 0);
+}
+
+void ao_opensl_set_device_rate(int rate) {
+    dt_atomic_store(&g_opensl.device_rate, (rate > 0) ? rate : 0);
+}
+
+int ao_opensl_set_resample(int quality) {
+    if (quality < AO_OPENSL_RESAMPLE_OFF || quality > RESAMPLE_BEST)
+        return -1;
+    dt_atomic_store(&g_opensl.resample, quality);
+    return 0;
+}
+
+int ao_opensl_get_stat(int stat) {
+    switch (stat) {
+        case AO_OPENSL_STAT_UNDERRUNS:
+            return dt_atomic_load(&g_opensl.underruns);
+        case AO_OPENSL_STAT_SILENT:
+            return dt_atomic_load(&g_opensl.silent);
+        case AO_OPENSL_STAT_DEPTH:
+            return dt_atomic_load(&g_opensl.depth);
+        case AO_OPENSL_STAT_PERIOD:
+            return dt_atomic_load(&g_opensl.period_us);
+        default:
+            return -1;
+    }
+}
+
+void ao_opensl_reset_stats(void) {
+    dt_atomic_store(&g_opensl.underruns, 0);
+    dt_atomic_store(&g_opensl.silent, 0);
+}
+
+/*
+ * polled by the video scheduler every frame, takes no lock; audio_clock
+ * reads are lock free and the stream stays alive while counted in readers
+ */
+int ao_opensl_clock(int64_t *pts, int64_t *systime) {
+    int64_t played, at;
+    int ret = -1;
+    dt_atomic_inc(&g_clock.readers);
+    /* pairs with the fence in ClockDetach: it either sees this reader or
+     * this reader sees the stream gone */
+    dt_atomic_fence();
+    aout_sys_t *sys = dt_atomic_load(&g_clock.sys);
+    if (sys && audio_clock_read(&sys->clock, &played, &at) == 0) {
+        *systime = audio_clock_systime();
+        *pts = audio_clock_pts(&sys->clock, *systime);
+        ret = 0;
+    }
+    dt_atomic_dec(&g_clock.readers);
+    return ret;
+}
+
+static void ClockAttach(aout_sys_t *sys) {
+    dt_lock(&g_clock.lock);
+    /* with two streams playing there is no telling whose clock a reader wants */
+    dt_atomic_store(&g_clock.sys, (g_clock.streams++ == 0) ? sys : NULL);
+    sys->clocked = 1;
+    dt_unlock(&g_clock.lock);
+}
+
+static void ClockDetach(aout_sys_t *sys) {
+    if (!sys->clocked)
+        return;
+    dt_lock(&g_clock.lock);
+    g_clock.streams--;
+    if (g_clock.sys == sys)
+        dt_atomic_store(&g_clock.sys, (aout_sys_t *) NULL);
+    /* sys is freed next, a reader that picked it up finishes first */
+    dt_atomic_fence();
+    while (dt_atomic_load(&g_clock.readers))
+        sched_yield();
+    dt_unlock(&g_clock.lock);
+}
+
 /*****************************************************************************
  *
  *****************************************************************************/
 
-static inline int bytesPerSample(dtaudio_output_t *aout) {
-    dtaudio_para_t *para = &aout->para;
-    return para->dst_channels * para->data_width / 8;
-    //return 2 /* S16 */ * 2 /* stereo */;
-}
-
 // get us delay
 //
 static int TimeGet(dtaudio_output_t *aout, int64_t *drift) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
 
-    SLAndroidSimpleBufferQueueState st;
-    SLresult res = GetState(sys->playerBufferQueue, &st);
-    if (unlikely(res != SL_RESULT_SUCCESS)) {
-        LOGV("Could not query buffer queue state in TimeGet (%lu)", (unsigned long) res);
+    if (!dt_atomic_load(&sys->started))
         return -1;
-    }
+    /* the device queue from the audio clock, interpolated to now instead
+     * of whole periods from the queue state */
+    int samples = pcm_ring_level(&sys->ring) / sys->frame_bytes;
+    *drift = audio_clock_latency(&sys->clock, audio_clock_systime())
+             + samples * CLOCK_FREQ / sys->rate;
+    if (sys->resampler)
+        *drift += resampler_delay(sys->resampler);
 
-    dt_lock(&sys->lock);
-    bool started = sys->started;
-    dt_unlock(&sys->lock);
-
-    if (!started)
-        return -1;
-    *drift = (CLOCK_FREQ * OPENSLES_BUFLEN * st.count / 1000)
-             + sys->samples * CLOCK_FREQ / sys->rate;
-
-    //__android_log_print(ANDROID_LOG_DEBUG, TAG, "latency %lld ms, %d/%d buffers, samples:%d", *drift / 1000,
-    //        (int)st.count, OPENSLES_BUFFERS, sys->samples);
+    //__android_log_print(ANDROID_LOG_DEBUG, TAG, "latency %lld ms, samples:%d", *drift / 1000, samples);
 
     return 0;
 }
 
+static void PrimeQueue(dtaudio_output_t *aout);
+
 static void Flush(dtaudio_output_t *aout, bool drain) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
 
@@ -164,10 +315,15 @@ static void Flush(dtaudio_output_t *aout, bool drain) {
     } else {
         SetPlayState(sys->playerPlay, SL_PLAYSTATE_STOPPED);
         Clear(sys->playerBufferQueue);
-        SetPlayState(sys->playerPlay, SL_PLAYSTATE_PLAYING);
 
-        sys->samples = 0;
-        sys->started = 0;
+        pcm_ring_reset(&sys->ring);
+        if (sys->resampler)
+            resampler_reset(sys->resampler);
+        dt_atomic_store(&sys->started, 0);
+        /* the device position restarts at 0 with the stop */
+        audio_clock_reset(&sys->clock);
+        PrimeQueue(aout);
+        SetPlayState(sys->playerPlay, SL_PLAYSTATE_PLAYING);
     }
 }
 
@@ -206,53 +362,67 @@ static void Pause(dtaudio_output_t *aout, bool pause) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
     SetPlayState(sys->playerPlay,
                  pause ? SL_PLAYSTATE_PAUSED : SL_PLAYSTATE_PLAYING);
+    if (pause)
+        audio_clock_pause(&sys->clock, audio_clock_systime());
+    else
+        audio_clock_resume(&sys->clock, audio_clock_systime());
 }
 
-static int WriteBuffer(dtaudio_output_t *aout) {
+/*
+ * Move the next period from the ring to the device. Only the buffer queue
+ * callback calls it once the queue is primed, the writer never enqueues.
+ */
+static int EnqueueNext(dtaudio_output_t *aout) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
-    const int unit_size = sys->samples_per_buf * bytesPerSample(aout);
-
-    /* Check if we can fill at least one buffer unit by chaining blocks */
-    if (sys->dbt.level < unit_size) {
-        return false;
+    const int unit_size = sys->samples_per_buf * sys->frame_bytes;
+    uint8_t *unit = &sys->buf[unit_size * sys->next_buf];
+
+    int got = pcm_ring_read(&sys->ring, unit, unit_size);
+    if (got < unit_size) {
+        /* late writer or end of stream: pad with silence, an empty queue
+         * would stop the callbacks for good */
+        memset(unit + got, 0, unit_size - got);
+        /* the priming periods are silent by design */
+        if (dt_atomic_load_relaxed(&sys->started))
+            dt_atomic_inc(&g_opensl.silent);
     }
+    audio_clock_queued(&sys->clock, got / sys->frame_bytes);
 
-    SLAndroidSimpleBufferQueueState st;
-    SLresult res = GetState(sys->playerBufferQueue, &st);
-    if (unlikely(res != SL_RESULT_SUCCESS)) {
-        return false;
-    }
-
-    if (st.count == OPENSLES_BUFFERS)
-        return false;
-
-    int done = 0;
-    while (done < unit_size) {
-        int cur = buf_level(&sys->dbt);
-        if (cur > unit_size - done)
-            cur = unit_size - done;
+    SLresult r = Enqueue(sys->playerBufferQueue, unit, unit_size);
+    /* periods are played in order, the one just played is reused next */
+    if (++sys->next_buf == sys->buffers)
+        sys->next_buf = 0;
+    return (r == SL_RESULT_SUCCESS) ? true : false;
+}
 
-        //memcpy(&sys->buf[unit_size * sys->next_buf + done], b->p_buffer, cur);
-        buf_get(&sys->dbt, &sys->buf[unit_size * sys->next_buf + done], cur);
-        done += cur;
+/*
+ * fill the device queue with silence, the callbacks keep it full from then
+ */
+static void PrimeQueue(dtaudio_output_t *aout) {
+    aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
+    sys->next_buf = 0;
+    for (int i = 0; i < sys->depth; i++)
+        EnqueueNext(aout);
+}
 
-        if (done == unit_size)
-            break;
+/*
+ * adaptive profile: one period deeper after each underrun, one shallower
+ * after OPENSLES_STABLE seconds without
+ */
+static void Adapt(aout_sys_t *sys, bool underrun) {
+    int depth = sys->depth;
+    if (underrun) {
+        sys->stable = 0;
+        if (depth < sys->buffers)
+            depth++;
+    } else if (++sys->stable >= sys->stable_periods && depth > OPENSLES_MIN_BUFFERS) {
+        sys->stable = 0;
+        depth--;
     }
-
-    SLresult r = Enqueue(sys->playerBufferQueue,
-                         &sys->buf[unit_size * sys->next_buf], unit_size);
-
-    sys->samples -= sys->samples_per_buf;
-    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "minus sampels, %d minus %d \n",sys->samples, sys->samples_per_buf);
-
-    if (r == SL_RESULT_SUCCESS) {
-        if (++sys->next_buf == OPENSLES_BUFFERS)
-            sys->next_buf = 0;
-        return true;
-    } else {
-        /* XXX : if writing fails, we don't retry */
-        return false;
+    if (depth != sys->depth) {
+        LOGV("opensl queue %d -> %d periods\n", sys->depth, depth);
+        sys->depth = depth;
+        dt_atomic_store(&g_opensl.depth, depth);
     }
 }
 
@@ -261,17 +431,46 @@ static int WriteBuffer(dtaudio_output_t *aout) {
  *****************************************************************************/
 static int Play(dtaudio_output_t *aout, uint8_t *buf, int size) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
-    int ret = 0;
-    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "space:%d level:%d  size:%d  \n",buf_space(&sys->dbt), buf_level(&sys->dbt), size);
-    if (buf_space(&sys->dbt) > size) {
-        ret = buf_put(&sys->dbt, buf, size);
+    const int frames = size / sys->in_bytes;
+    const int fb = sys->frame_bytes;
+
+    /* all or nothing, the caller comes back with what did not fit; the
+     * resampler keeps state, check for the most it can return first */
+    int max = sys->resampler ? resampler_max_out(sys->resampler, frames) : frames;
+    if (pcm_ring_space(&sys->ring) < max * fb)
+        return 0;
+
+    /* the only conversion on the way to the device */
+    uint8_t *pcm = buf;
+    if (sys->convert) {
+        if (frames > sys->conv_frames) {
+            uint8_t *conv_buf = realloc(sys->conv_buf, frames * fb);
+            if (!conv_buf)
+                return 0;
+            sys->conv_buf = conv_buf;
+            sys->conv_frames = frames;
+        }
+        const void *src = buf;
+        sample_conv_run(&sys->conv, sys->conv_buf, &src, frames);
+        pcm = sys->conv_buf;
+    }
+    if (!sys->resampler) {
+        pcm_ring_write(&sys->ring, pcm, frames * fb);
+        return frames * sys->in_bytes;
     }
-    sys->samples += ret / bytesPerSample(aout);
-    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "add sampels, %d add %d \n",sys->samples, ret / bytesPerSample(aout));
 
-    /* Fill OpenSL buffer */
-    WriteBuffer(aout); // will read data in callback
-    return ret;
+    if (max > sys->scratch_frames) {
+        int16_t *scratch = realloc(sys->scratch, max * fb);
+        if (!scratch)
+            return 0;
+        sys->scratch = scratch;
+        sys->scratch_frames = max;
+    }
+    int out = resampler_process(sys->resampler, (const int16_t *) pcm, frames, sys->scratch);
+    if (out < 0)
+        return 0;
+    pcm_ring_write(&sys->ring, (uint8_t *) sys->scratch, out * fb);
+    return frames * sys->in_bytes;
 }
 
 static void PlayedCallback(SLAndroidSimpleBufferQueueItf caller, void *pContext) {
@@ -280,9 +479,29 @@ static void PlayedCallback(SLAndroidSimpleBufferQueueItf caller, void *pContext)
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
 
     assert (caller == sys->playerBufferQueue);
-    sys->started = 1;
-    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "opensl callback called \n");
-
+    /* GetPosition counts ms played since the last stop */
+    SLmillisecond ms;
+    int64_t pos = -1;
+    if (GetPosition(sys->playerPlay, &ms) == SL_RESULT_SUCCESS)
+        pos = (int64_t) ms * sys->rate / 1000;
+    audio_clock_played(&sys->clock, pos, audio_clock_systime());
+
+    /* the played period is off the queue already; none left means the
+     * device ran dry before this callback came */
+    SLAndroidSimpleBufferQueueState st;
+    int queued = sys->depth - 1;
+    if (GetState(sys->playerBufferQueue, &st) == SL_RESULT_SUCCESS)
+        queued = st.count;
+    bool underrun = (queued == 0 && dt_atomic_load_relaxed(&sys->started));
+    if (underrun)
+        dt_atomic_inc(&g_opensl.underruns);
+    if (sys->profile == AO_OPENSL_PROFILE_ADAPTIVE)
+        Adapt(sys, underrun);
+    dt_atomic_store(&sys->started, 1);
+
+    /* up to depth: refills after an underrun, skips to shallow */
+    for (; queued < sys->depth; queued++)
+        EnqueueNext(aout);
 }
 
 /*****************************************************************************
@@ -321,16 +540,99 @@ static SLuint32 convertSampleRate(SLuint32 sr) {
     return -1;
 }
 
+/*
+ * the device's own rate unless resampling is off, then the stream's if
+ * OpenSL takes it
+ */
+static int DeviceRate(int rate) {
+    int device = dt_atomic_load(&g_opensl.device_rate);
+    if (device > 0 && device != rate && dt_atomic_load(&g_opensl.resample) != AO_OPENSL_RESAMPLE_OFF)
+        return device;
+    if ((int) convertSampleRate(rate) != -1)
+        return rate;
+    return (device > 0 && (int) convertSampleRate(device) != -1) ? device : OPENSLES_RATE;
+}
+
+/*
+ * float when the input is wider than s16 and the resampler does not narrow
+ * it first, so effects headroom and 24 bit sources reach the mixer
+ */
+static int DeviceFormat(aout_sys_t *sys, int in_fmt) {
+    if (in_fmt == SAMPLE_S16 || sys->resampler)
+        return SAMPLE_S16;
+    char sdk[PROP_VALUE_MAX] = "";
+    __system_property_get("ro.build.version.sdk", sdk);
+    return (atoi(sdk) >= OPENSLES_FLOAT_SDK) ? SAMPLE_FLT : SAMPLE_S16;
+}
+
+/*
+ * what the writer and the callback use, sized for sys->format; all of it
+ * exists before the player does, the callback may run as soon as it plays
+ */
+static int Alloc(dtaudio_output_t *aout, int in_fmt, int period_us) {
+    aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
+    dtaudio_para_t *para = &aout->para;
+
+    /* XXX: rounding shouldn't affect us at normal sampling rate */
+    sys->samples_per_buf = (int) ((int64_t) period_us * sys->rate / 1000000);
+    if (sys->samples_per_buf < 1)
+        sys->samples_per_buf = 1;
+    sys->frame_bytes = para->dst_channels * sample_bytes(sys->format);
+    sys->convert = (in_fmt != sys->format);
+    /* dithered when narrowing to s16 */
+    if (sample_conv_init(&sys->conv, in_fmt, 0, sys->format, para->dst_channels, 1) < 0)
+        return -1;
+    int ring_ms = (sys->profile == AO_OPENSL_PROFILE_POWER_SAVING) ? OPENSLES_POWER_RING
+                                                                   : OPENSLES_RING;
+    if (pcm_ring_init(&sys->ring, sys->rate * sys->frame_bytes / 1000 * ring_ms) < 0)
+        return -1;
+    sys->buf = malloc(sys->buffers * sys->samples_per_buf * sys->frame_bytes);
+    if (!sys->buf) {
+        pcm_ring_release(&sys->ring);
+        return -1;
+    }
+    return 0;
+}
+
+static void Free(aout_sys_t *sys) {
+    free(sys->buf);
+    sys->buf = NULL;
+    pcm_ring_release(&sys->ring);
+}
+
 static int Start(dtaudio_output_t *aout) {
     SLresult result;
 
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
     dtaudio_para_t *para = &aout->para;
+    int in_fmt = sample_fmt_of_width(para->data_width);
+    sys->format = DeviceFormat(sys, in_fmt);
+
+    /* period and queue depth of the profile */
+    int period_us = OPENSLES_BUFLEN * 1000;
+    int burst_us = dt_atomic_load(&g_opensl.burst_us);
+    sys->buffers = OPENSLES_BUFFERS;
+    sys->depth = OPENSLES_BUFFERS;
+    switch (sys->profile) {
+        case AO_OPENSL_PROFILE_LOW_LATENCY:
+            period_us = burst_us ? burst_us : OPENSLES_BURST;
+            sys->buffers = OPENSLES_MIN_BUFFERS;
+            sys->depth = OPENSLES_MIN_BUFFERS;
+            break;
+        case AO_OPENSL_PROFILE_POWER_SAVING:
+            period_us = OPENSLES_POWER_BUFLEN * 1000;
+            break;
+        case AO_OPENSL_PROFILE_ADAPTIVE:
+            period_us = burst_us ? burst_us : OPENSLES_BURST;
+            sys->buffers = OPENSLES_MAX_BUFFERS;
+            sys->depth = OPENSLES_MIN_BUFFERS;
+            break;
+    }
 
     // configure audio source - this defines the number of samples you can enqueue.
     SLDataLocator_AndroidSimpleBufferQueue loc_bufq = {
             SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE,
-            OPENSLES_BUFFERS
+            sys->buffers
     };
 
     int mask;
@@ -345,13 +647,25 @@ static int Start(dtaudio_output_t *aout) {
     format_pcm.formatType = SL_DATAFORMAT_PCM;
     format_pcm.numChannels = para->dst_channels;
     //format_pcm.samplesPerSec    = ((SLuint32) para->dst_samplerate * 1000) ;
-    format_pcm.samplesPerSec = ((SLuint32) convertSampleRate(para->dst_samplerate));
+    format_pcm.samplesPerSec = ((SLuint32) convertSampleRate(sys->rate));
     format_pcm.bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_16;
     format_pcm.containerSize = SL_PCMSAMPLEFORMAT_FIXED_16;
     format_pcm.channelMask = mask;
     format_pcm.endianness = SL_BYTEORDER_LITTLEENDIAN;
 
+    SLAndroidDataFormat_PCM_EX format_ex;
+    format_ex.formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
+    format_ex.numChannels = format_pcm.numChannels;
+    format_ex.sampleRate = format_pcm.samplesPerSec;
+    format_ex.bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_32;
+    format_ex.containerSize = SL_PCMSAMPLEFORMAT_FIXED_32;
+    format_ex.channelMask = mask;
+    format_ex.endianness = SL_BYTEORDER_LITTLEENDIAN;
+    format_ex.representation = SL_ANDROID_PCM_REPRESENTATION_FLOAT;
+
     SLDataSource audioSrc = {&loc_bufq, &format_pcm};
+    if (sys->format == SAMPLE_FLT)
+        audioSrc.pFormat = &format_ex;
 
     // configure audio sink
     SLDataLocator_OutputMix loc_outmix = {
@@ -360,14 +674,29 @@ static int Start(dtaudio_output_t *aout) {
     };
     SLDataSink audioSnk = {&loc_outmix, NULL};
 
+    if (Alloc(aout, in_fmt, period_us) < 0)
+        return -1;
+
     //create audio player
     const SLInterfaceID ids2[] = {sys->SL_IID_ANDROIDSIMPLEBUFFERQUEUE, sys->SL_IID_VOLUME};
     static const SLboolean req2[] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
     result = CreateAudioPlayer(sys->engineEngine, &sys->playerObject, &audioSrc,
                                &audioSnk, sizeof(ids2) / sizeof(*ids2),
                                ids2, req2);
+    if (result != SL_RESULT_SUCCESS && sys->format == SAMPLE_FLT) {
+        LOGV("opensl refused float pcm, s16 instead\n");
+        sys->format = SAMPLE_S16;
+        audioSrc.pFormat = &format_pcm;
+        Free(sys);
+        if (Alloc(aout, in_fmt, period_us) < 0)
+            return -1;
+        result = CreateAudioPlayer(sys->engineEngine, &sys->playerObject, &audioSrc,
+                                   &audioSnk, sizeof(ids2) / sizeof(*ids2),
+                                   ids2, req2);
+    }
     if (unlikely(result != SL_RESULT_SUCCESS)) { // error
-        return -1;
+        sys->playerObject = NULL;
+        goto error;
         /* Try again with a more sensible samplerate */
 #if 0
         fmt->i_rate = 44100;
@@ -396,30 +725,39 @@ static int Start(dtaudio_output_t *aout) {
                               (void *) aout);
     CHECK_OPENSL_ERROR("Failed to register buff queue callback.");
 
-    // set the player's state to playing
+    sys->stable = 0;
+    sys->stable_periods = OPENSLES_STABLE * 1000000 / period_us;
+
+    sys->started = 0;
+    sys->last_latency = -1;
+    audio_clock_init(&sys->clock, sys->rate, sys->samples_per_buf);
+    PrimeQueue(aout);
+
+    // set the player's state to playing, last: the callbacks start here
     result = SetPlayState(sys->playerPlay, SL_PLAYSTATE_PLAYING);
     CHECK_OPENSL_ERROR("Failed to switch to playing state");
 
-    /* XXX: rounding shouldn't affect us at normal sampling rate */
-    sys->rate = para->dst_samplerate;
-    sys->samples_per_buf = OPENSLES_BUFLEN * para->dst_samplerate / 1000;
-    sys->buf = malloc(OPENSLES_BUFFERS * sys->samples_per_buf * bytesPerSample(aout));
-    if (!sys->buf)
-        goto error;
+    ClockAttach(sys);
+    ao_opensl_reset_stats();
+    dt_atomic_store(&g_opensl.depth, sys->depth);
+    dt_atomic_store(&g_opensl.period_us, period_us);
+    LOGV("opensl profile %d, %d periods of %d us, %d deep, %d -> %d Hz, %d bit -> %s\n",
+         sys->profile, sys->buffers, period_us, sys->depth, para->dst_samplerate, sys->rate,
+         para->data_width, (sys->format == SAMPLE_FLT) ? "float" : "s16");
 
-    sys->started = 0;
-    sys->next_buf = 0;
-
-    sys->samples = 0;
     SetPositionUpdatePeriod(sys->playerPlay, AOUT_MIN_PREPARE_TIME * 1000 / CLOCK_FREQ);
     return 0;
 
     error:
+    /* no callback runs past Destroy */
     if (sys->playerObject) {
         Destroy(sys->playerObject);
         sys->playerObject = NULL;
     }
-
+    sys->playerPlay = NULL;
+    sys->playerBufferQueue = NULL;
+    sys->volumeItf = NULL;
+    Free(sys);
     return -1;
 }
 
@@ -430,10 +768,18 @@ static void Stop(dtaudio_output_t *aout) {
     //Flush remaining buffers if any.
     Clear(sys->playerBufferQueue);
 
-    free(sys->buf);
-
+    /* no callback runs past Destroy, no reader past the detach */
     Destroy(sys->playerObject);
     sys->playerObject = NULL;
+    ClockDetach(sys);
+    LOGV("opensl stopped, %d underruns, %d periods padded with silence\n",
+         dt_atomic_load(&g_opensl.underruns), dt_atomic_load(&g_opensl.silent));
+
+    free(sys->buf);
+    pcm_ring_release(&sys->ring);
+    resampler_destroy(sys->resampler);
+    free(sys->scratch);
+    free(sys->conv_buf);
     free(sys);
     sys = NULL;
 }
@@ -448,7 +794,9 @@ static void Close(dtaudio_output_t *aout) {
     Destroy(sys->engineObject);
     dlclose(sys->p_so_handle);
     //vlc_mutex_destroy(&sys->lock);
+    resampler_destroy(sys->resampler);
     free(sys);
+    aout->ao_priv = NULL;
 }
 
 static int Open(dtaudio_output_t *aout) {
@@ -459,6 +807,7 @@ static int Open(dtaudio_output_t *aout) {
     sys = (aout_sys_t *) malloc(sizeof(*sys));
     if (unlikely(sys == NULL))
         return -1;
+    memset(sys, 0, sizeof(*sys));
 
     sys->p_so_handle = dlopen("libOpenSLES.so", RTLD_NOW);
     if (sys->p_so_handle == NULL) {
@@ -510,8 +859,24 @@ static int Open(dtaudio_output_t *aout) {
 
     dt_lock_init(&sys->lock, NULL);
 
-    if (buf_init(&sys->dbt, para->dst_samplerate * 4 / 10) < 0) // 100ms
-        return -1;
+    int in_fmt = sample_fmt_of_width(para->data_width);
+    if (in_fmt < 0) {
+        LOGV("opensl: %d bit pcm unsupported\n", para->data_width);
+        goto error;
+    }
+    sys->in_bytes = para->dst_channels * sample_bytes(in_fmt);
+
+    sys->profile = dt_atomic_load(&g_opensl.profile);
+    sys->rate = DeviceRate(para->dst_samplerate);
+    if (sys->rate != para->dst_samplerate) {
+        /* off means only rates OpenSL refuses are converted */
+        int quality = dt_atomic_load(&g_opensl.resample);
+        sys->resampler = resampler_create(para->dst_channels, para->dst_samplerate, sys->rate,
+                                          (quality == AO_OPENSL_RESAMPLE_OFF) ? RESAMPLE_MEDIUM
+                                                                              : quality);
+        if (!sys->resampler)
+            goto error;
+    }
     aout->ao_priv = (void *) sys;
     return 0;
 
@@ -543,7 +908,11 @@ int dtap_change_effect(ao_wrapper_t *wrapper, int id)
 static int ao_opensl_init(dtaudio_output_t *aout, dtaudio_para_t *para) {
     if (Open(aout) == -1)
         return -1;
-    Start(aout);
+    if (Start(aout) < 0) {
+        LOGV("opensl player failed to start\n");
+        Close(aout);
+        return -1;
+    }
 
 #ifdef ENABLE_DTAP
     ao_wrapper_t *wrapper = aout->wrapper;
@@ -561,7 +930,6 @@ static int ao_opensl_init(dtaudio_output_t *aout, dtaudio_para_t *para) {
 }
 
 static int ao_opensl_write(dtaudio_output_t *aout, uint8_t *buf, int size) {
-    aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
     ao_wrapper_t *wrapper = aout->wrapper;
     int ret = 0;
 
@@ -578,9 +946,9 @@ static int ao_opensl_write(dtaudio_output_t *aout, uint8_t *buf, int size) {
     dt_unlock(&ae->lock);
 #endif
 
-    dt_lock(&sys->lock);
+    /* lock free against the callback, see pcm_ring.h; the effects ran on
+     * the decoder's samples in place, Play converts each one once */
     ret = Play(aout, buf, size);
-    dt_unlock(&sys->lock);
     return ret;
 }
 
@@ -600,23 +968,23 @@ static int ao_opensl_resume(dtaudio_output_t *aout) {
     return 0;
 }
 
+/*
+ * bytes of the caller's pcm, the ring and device hold it converted
+ */
 static int ao_opensl_level(dtaudio_output_t *aout) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
-    dt_lock(&sys->lock);
-    int level = sys->samples * bytesPerSample(aout);
-    const int unit_size = sys->samples_per_buf * bytesPerSample(aout);
+    int64_t frames = pcm_ring_level(&sys->ring) / sys->frame_bytes;
     SLAndroidSimpleBufferQueueState st;
-    if (!sys->started)
+    if (!dt_atomic_load(&sys->started))
         goto END;
     SLresult res = GetState(sys->playerBufferQueue, &st);
     if (unlikely(res != SL_RESULT_SUCCESS)) {
         goto END;
     }
-    level += st.count * unit_size;
-    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "opensl level:%d  st.count:%d sample:%d:%d \n",level, (int)st.count, sys->samples);
+    frames += st.count * sys->samples_per_buf;
+    //__android_log_print(ANDROID_LOG_DEBUG,TAG, "opensl level:%d  st.count:%d \n",level, (int)st.count);
     END:
-    dt_unlock(&sys->lock);
-    return level;
+    return (int) (frames * aout->para.dst_samplerate / sys->rate * sys->in_bytes);
 }
 
 static int64_t ao_opensl_get_latency(dtaudio_output_t *aout) {
@@ -626,17 +994,20 @@ static int64_t ao_opensl_get_latency(dtaudio_output_t *aout) {
     aout_sys_t *sys = (aout_sys_t *) aout->ao_priv;
 
 #if 1
-    TimeGet(aout, &latency);
-    if (latency == -1)
-        return 0;
-    latency = 9 * latency / 100;
+    /* before the first callback or on a failed query the last good value,
+     * -1 until there is one; 0 would place the audio pts a queue early */
+    if (TimeGet(aout, &latency) < 0)
+        return sys->last_latency;
+    /* us to 90kHz pts units; the host places the audio pts with it */
+    latency = latency * 90000 / CLOCK_FREQ;
+    sys->last_latency = latency;
 #else
     dtaudio_para_t *para = &aout->para;
     level = ao_opensl_level(aout);
     int sample_num;
     float pts_ratio = 0.0;
     pts_ratio = (double) 90000 / para->dst_samplerate;
-    sample_num = level / bytesPerSample(aout);
+    sample_num = level / sys->in_bytes;
     latency += (sample_num * pts_ratio);
 #endif
     //__android_log_print(ANDROID_LOG_DEBUG,TAG, "opensl latency, level:%d latency:%lld \n",level, latency);
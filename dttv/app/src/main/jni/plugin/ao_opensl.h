@@ -0,0 +1,75 @@
+/*
+ * ao_opensl.h
+ *
+ * OpenSL ES audio output. How much audio sits in the device queue is a
+ * profile: periods of the device burst for latency, long periods for fewer
+ * wakeups, or a queue that deepens after underruns and shallows again once
+ * playback has been stable. Streams are resampled to the device's native
+ * rate. Sources wider than 16 bit play as float from Android 5.0 on and are
+ * dithered to s16 before that, converted once after the effects. Settings
+ * are process wide like the output registration and apply from the next
+ * stream start.
+ */
+
+#ifndef AO_OPENSL_H
+#define AO_OPENSL_H
+
+#include "ao_wrapper.h"
+
+#define AO_OPENSL_PROFILE_DEFAULT       0   /* 4 periods of 10 ms */
+#define AO_OPENSL_PROFILE_LOW_LATENCY   1   /* 2 periods of the device burst */
+#define AO_OPENSL_PROFILE_POWER_SAVING  2   /* 4 periods of 100 ms */
+#define AO_OPENSL_PROFILE_ADAPTIVE      3   /* burst periods, 2 to 8 deep */
+
+#define AO_OPENSL_RESAMPLE_OFF      -1  /* only rates OpenSL refuses, else RESAMPLE_* */
+
+#define AO_OPENSL_STAT_UNDERRUNS    0   /* callbacks that found the device queue drained */
+#define AO_OPENSL_STAT_SILENT       1   /* periods padded with silence, the writer was late */
+#define AO_OPENSL_STAT_DEPTH        2   /* periods queued on the device now */
+#define AO_OPENSL_STAT_PERIOD       3   /* us per period */
+
+void ao_opensl_setup(ao_wrapper_t *ao);
+
+/*
+ * AO_OPENSL_PROFILE_*
+ * @return -1 unknown profile
+ */
+int ao_opensl_set_profile(int profile);
+
+/*
+ * the device's native burst in us, from AudioManager
+ * PROPERTY_OUTPUT_FRAMES_PER_BUFFER and PROPERTY_OUTPUT_SAMPLE_RATE;
+ * 0 unknown, 5 ms is used
+ */
+void ao_opensl_set_burst(int burst_us);
+
+/*
+ * the device's native rate, from AudioManager PROPERTY_OUTPUT_SAMPLE_RATE.
+ * Streams at other rates are resampled to it in process instead of by the
+ * system mixer; 0 unknown
+ */
+void ao_opensl_set_device_rate(int rate);
+
+/*
+ * AO_OPENSL_RESAMPLE_OFF or RESAMPLE_* of resample.h, RESAMPLE_MEDIUM by
+ * default
+ * @return -1 unknown quality
+ */
+int ao_opensl_set_resample(int quality);
+
+/*
+ * AO_OPENSL_STAT_*, counted from the last stream start or reset
+ */
+int ao_opensl_get_stat(int stat);
+
+void ao_opensl_reset_stats(void);
+
+/*
+ * where the playing stream is, any thread, lock free: pts in us
+ * interpolated to systime (CLOCK_MONOTONIC, us), counted from the first
+ * sample of the stream as in audio_clock.h
+ * @return -1 nothing playing or played yet, or several streams play
+ */
+int ao_opensl_clock(int64_t *pts, int64_t *systime);
+
+#endif
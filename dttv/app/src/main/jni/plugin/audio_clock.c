@@ -0,0 +1,215 @@
+/*
+ * audio_clock.c
+ *
+ * Seqlock with a single writer, the buffer queue callback (and Start
+ * priming the queue before any callback runs). Readers retry while seq is
+ * odd or moved during their copy.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "../native_atomic.h"
+#include "audio_clock.h"
+
+#define US 1000000LL
+
+typedef struct {
+    int64_t systime;
+    int64_t device_pos;
+    int64_t data_pos;
+    int64_t queued;
+    int64_t queued_data;
+    int64_t data_limit;
+} clock_snapshot_t;
+
+int64_t audio_clock_systime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * US + ts.tv_nsec / 1000;
+}
+
+void audio_clock_init(audio_clock_t *c, int rate, int period) {
+    memset(c, 0, sizeof(*c));
+    c->rate = rate;
+    c->period = period;
+    c->systime = -1;
+}
+
+void audio_clock_reset(audio_clock_t *c) {
+    audio_clock_init(c, c->rate, c->period);
+}
+
+static void write_begin(audio_clock_t *c) {
+    dt_atomic_store_relaxed(&c->seq, c->seq + 1);
+    dt_atomic_fence_release();
+}
+
+static void write_end(audio_clock_t *c) {
+    dt_atomic_store(&c->seq, c->seq + 1);
+}
+
+static void load(audio_clock_t *c, clock_snapshot_t *s) {
+    for (;;) {
+        uint32_t seq = dt_atomic_load(&c->seq);
+        if (seq & 1)
+            continue;
+        s->systime = dt_atomic_load_relaxed(&c->systime);
+        s->device_pos = dt_atomic_load_relaxed(&c->device_pos);
+        s->data_pos = dt_atomic_load_relaxed(&c->data_pos);
+        s->queued = dt_atomic_load_relaxed(&c->queued);
+        s->queued_data = dt_atomic_load_relaxed(&c->queued_data);
+        s->data_limit = dt_atomic_load_relaxed(&c->data_limit);
+        dt_atomic_fence_acquire();
+        if (dt_atomic_load_relaxed(&c->seq) == seq)
+            return;
+    }
+}
+
+/*
+ * pcm position at a device position, and in *limit where the pcm run it
+ * is in ends; callback only, reads the period history
+ */
+static int64_t map_device(audio_clock_t *c, int64_t device_pos, int64_t *limit) {
+    int64_t k = device_pos / c->period;
+    if (k >= c->periods || k < c->periods - AUDIO_CLOCK_HISTORY) {
+        /* the whole queue played, or older than the history */
+        *limit = c->queued_data;
+        return (k >= c->periods) ? c->queued_data : c->data_pos;
+    }
+    int offset = (int) (device_pos - k * c->period);
+    int data = c->history[k % AUDIO_CLOCK_HISTORY];
+    int64_t pos = c->history_data[k % AUDIO_CLOCK_HISTORY] + (offset < data ? offset : data);
+    int64_t end = c->history_data[k % AUDIO_CLOCK_HISTORY] + data;
+    /* full periods carry the run into the next one */
+    while (data == c->period && ++k < c->periods) {
+        data = c->history[k % AUDIO_CLOCK_HISTORY];
+        end += data;
+    }
+    *limit = end;
+    return pos;
+}
+
+void audio_clock_queued(audio_clock_t *c, int data) {
+    int slot = (int) (c->periods % AUDIO_CLOCK_HISTORY);
+    int64_t limit;
+    c->history[slot] = data;
+    c->history_data[slot] = c->queued_data;
+    c->periods++;
+
+    write_begin(c);
+    dt_atomic_store_relaxed(&c->queued, c->queued + c->period);
+    dt_atomic_store_relaxed(&c->queued_data, c->queued_data + data);
+    /* a full period may extend the run being played */
+    map_device(c, c->device_pos, &limit);
+    dt_atomic_store_relaxed(&c->data_limit, limit);
+    write_end(c);
+}
+
+void audio_clock_played(audio_clock_t *c, int64_t device_pos, int64_t systime) {
+    int64_t handed = ++c->completed * c->period;
+    int64_t pos = device_pos;
+    /* GetPosition lags the callbacks by what the mixer holds. 0 is not a
+     * lower bound, the pcm may still be on its way to the speaker; reset
+     * under us or implausible, the read is dropped */
+    if (pos <= 0 || pos > handed || pos < handed - (int64_t) AUDIO_CLOCK_HISTORY * c->period) {
+        pos = c->positioned ? -1 : handed;  /* the callbacks are all there is */
+    } else if (!c->positioned) {
+        /* reads of the callbacks are ahead by the output latency */
+        c->positioned = 1;
+        c->offset_count = 0;
+    }
+
+    /* the device stands still while paused, keep it out of playing time */
+    int64_t resume = dt_atomic_load(&c->resume_time);
+    if (resume > c->resume_seen) {
+        c->paused += resume - dt_atomic_load(&c->pause_time);
+        c->resume_seen = resume;
+    }
+    int64_t played = (systime - c->paused) * c->rate / US;
+
+    if (pos >= 0) {
+        c->offsets[c->offset_count++ % AUDIO_CLOCK_WINDOW] = pos - played;
+    }
+    if (!c->offset_count)
+        return;
+    int n = (c->offset_count < AUDIO_CLOCK_WINDOW) ? c->offset_count : AUDIO_CLOCK_WINDOW;
+    int64_t offset = c->offsets[0];
+    for (int i = 1; i < n; i++) {
+        if (c->offsets[i] > offset)
+            offset = c->offsets[i];
+    }
+    pos = played + offset;
+    if (pos > c->queued)
+        pos = c->queued;
+    /* an older best read leaving the window must not take us back */
+    if (pos < c->device_pos)
+        pos = c->device_pos;
+
+    int64_t limit;
+    int64_t data_pos = map_device(c, pos, &limit);
+    write_begin(c);
+    dt_atomic_store_relaxed(&c->systime, systime);
+    dt_atomic_store_relaxed(&c->device_pos, pos);
+    dt_atomic_store_relaxed(&c->data_pos, data_pos);
+    dt_atomic_store_relaxed(&c->data_limit, limit);
+    write_end(c);
+}
+
+void audio_clock_pause(audio_clock_t *c, int64_t systime) {
+    dt_atomic_store(&c->pause_time, systime);
+}
+
+void audio_clock_resume(audio_clock_t *c, int64_t systime) {
+    dt_atomic_store(&c->resume_time, systime);
+}
+
+/*
+ * device frames played since the snapshot, paused time left out
+ */
+static int64_t elapsed(audio_clock_t *c, const clock_snapshot_t *s, int64_t now) {
+    int64_t pause = dt_atomic_load(&c->pause_time);
+    int64_t resume = dt_atomic_load(&c->resume_time);
+    int64_t us = now - s->systime;
+    if (pause > s->systime) {
+        if (resume < pause)
+            us = pause - s->systime;        /* paused right now */
+        else
+            us -= resume - pause;
+    }
+    if (us < 0)
+        return 0;
+    int64_t frames = us * c->rate / US;
+    /* the device can not play what was never queued */
+    return (frames < s->queued - s->device_pos) ? frames : s->queued - s->device_pos;
+}
+
+int audio_clock_read(audio_clock_t *c, int64_t *pts, int64_t *systime) {
+    clock_snapshot_t s;
+    load(c, &s);
+    if (s.systime < 0)
+        return -1;
+    *pts = s.data_pos * US / c->rate;
+    *systime = s.systime;
+    return 0;
+}
+
+int64_t audio_clock_pts(audio_clock_t *c, int64_t now) {
+    clock_snapshot_t s;
+    load(c, &s);
+    if (s.systime < 0)
+        return 0;
+    int64_t pos = s.data_pos + elapsed(c, &s, now);
+    /* stands still over padded silence */
+    if (pos > s.data_limit)
+        pos = s.data_limit;
+    return pos * US / c->rate;
+}
+
+int64_t audio_clock_latency(audio_clock_t *c, int64_t now) {
+    clock_snapshot_t s;
+    load(c, &s);
+    if (s.systime < 0)
+        return s.queued * US / c->rate;     /* nothing played yet */
+    return (s.queued - s.device_pos - elapsed(c, &s, now)) * US / c->rate;
+}
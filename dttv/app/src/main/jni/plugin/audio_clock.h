@@ -0,0 +1,104 @@
+/*
+ * audio_clock.h
+ *
+ * Where the audio output is, measured instead of guessed. The buffer queue
+ * callback reports every period it queues (and how much real pcm it
+ * holds) and, once per played period, the device position from
+ * SLPlayItf::GetPosition with a monotonic timestamp. From those it
+ * publishes a (pts, systime) pair through a seqlock; any thread reads it
+ * without a lock and interpolates to the current time.
+ *
+ * Position reads only ever lag: GetPosition moves in mixer sized steps and
+ * callbacks run late by scheduling jitter. The device plays at a constant
+ * rate, so the offset of position against time is taken as the best
+ * (largest) of the last AUDIO_CLOCK_WINDOW reads, the one taken right after
+ * a step.
+ *
+ * pts is the media time of the pcm at the speaker, counted from the first
+ * sample written after init/reset: ao_write carries no timestamps, the
+ * host adds its own origin. Device frames include the silence padded in
+ * on underruns, pts does not advance over it.
+ */
+
+#ifndef AUDIO_CLOCK_H
+#define AUDIO_CLOCK_H
+
+#include <stdint.h>
+
+#define AUDIO_CLOCK_HISTORY 64  /* queued periods remembered, device -> pcm position */
+#define AUDIO_CLOCK_WINDOW  32  /* position reads the offset is the best of */
+
+typedef struct {
+    int rate;
+    int period;                 /* device frames per period */
+
+    /* published, seq odd while the callback writes */
+    uint32_t seq;
+    int64_t systime;            /* us, monotonic */
+    int64_t device_pos;         /* device frames played at systime */
+    int64_t data_pos;           /* pcm frames played at systime */
+    int64_t queued;             /* device frames ever queued */
+    int64_t queued_data;        /* pcm frames ever queued */
+    int64_t data_limit;         /* pcm position where the next silence starts */
+
+    /* control thread, the interpolation stands still in between */
+    int64_t pause_time;
+    int64_t resume_time;
+
+    /* callback only */
+    int64_t periods;            /* periods ever queued */
+    int history[AUDIO_CLOCK_HISTORY];   /* pcm frames at the start of each period */
+    int64_t history_data[AUDIO_CLOCK_HISTORY];  /* pcm frames queued before it */
+    int64_t completed;          /* periods reported played */
+    int64_t offsets[AUDIO_CLOCK_WINDOW];    /* frames, position - playing time */
+    int offset_count;
+    int positioned;             /* GetPosition worked once, trusted from then */
+    int64_t paused;             /* us spent paused before the last resume */
+    int64_t resume_seen;
+} audio_clock_t;
+
+int64_t audio_clock_systime(void);
+
+void audio_clock_init(audio_clock_t *c, int rate, int period);
+
+/*
+ * back to position 0, neither the callback nor readers may be running
+ */
+void audio_clock_reset(audio_clock_t *c);
+
+/*
+ * callback side: a period went to the device with data frames of pcm at
+ * its start, the rest silence
+ */
+void audio_clock_queued(audio_clock_t *c, int data);
+
+/*
+ * callback side: one more period played; device_pos from GetPosition in
+ * frames, -1 if unavailable
+ */
+void audio_clock_played(audio_clock_t *c, int64_t device_pos, int64_t systime);
+
+/*
+ * control side, around SL_PLAYSTATE_PAUSED
+ */
+void audio_clock_pause(audio_clock_t *c, int64_t systime);
+
+void audio_clock_resume(audio_clock_t *c, int64_t systime);
+
+/*
+ * the published pair, pts in us
+ * @return -1 nothing played yet
+ */
+int audio_clock_read(audio_clock_t *c, int64_t *pts, int64_t *systime);
+
+/*
+ * pts interpolated to now, us
+ */
+int64_t audio_clock_pts(audio_clock_t *c, int64_t now);
+
+/*
+ * us until everything queued to the device so far has been played
+ */
+int64_t audio_clock_latency(audio_clock_t *c, int64_t now);
+
+#endif
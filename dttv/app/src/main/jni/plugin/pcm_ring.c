@@ -0,0 +1,79 @@
+/*
+ * pcm_ring.c
+ *
+ * head and tail only grow, their difference is the level even across
+ * uint32 wrap. The producer publishes head after copying (release), the
+ * consumer publishes tail after copying out, each loads the other's index
+ * with acquire before touching the bytes behind it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../native_atomic.h"
+#include "pcm_ring.h"
+
+int pcm_ring_init(pcm_ring_t *ring, int capacity) {
+    uint32_t size = 1;
+    while (size < (uint32_t) capacity)
+        size <<= 1;
+    ring->data = malloc(size);
+    if (!ring->data)
+        return -1;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    return 0;
+}
+
+void pcm_ring_release(pcm_ring_t *ring) {
+    free(ring->data);
+    ring->data = NULL;
+    ring->size = 0;
+}
+
+void pcm_ring_reset(pcm_ring_t *ring) {
+    dt_atomic_store(&ring->head, 0);
+    dt_atomic_store(&ring->tail, 0);
+}
+
+int pcm_ring_level(pcm_ring_t *ring) {
+    uint32_t tail = dt_atomic_load(&ring->tail);
+    return (int) (dt_atomic_load(&ring->head) - tail);
+}
+
+int pcm_ring_space(pcm_ring_t *ring) {
+    return (int) ring->size - pcm_ring_level(ring);
+}
+
+int pcm_ring_write(pcm_ring_t *ring, const uint8_t *buf, int size) {
+    uint32_t head = dt_atomic_load_relaxed(&ring->head);
+    uint32_t space = ring->size - (head - dt_atomic_load(&ring->tail));
+    uint32_t n = (size > 0 && (uint32_t) size < space) ? (uint32_t) size : space;
+    if (size <= 0 || n == 0)
+        return 0;
+    uint32_t pos = head & (ring->size - 1);
+    uint32_t first = ring->size - pos;
+    if (first > n)
+        first = n;
+    memcpy(ring->data + pos, buf, first);
+    memcpy(ring->data, buf + first, n - first);
+    dt_atomic_store(&ring->head, head + n);
+    return (int) n;
+}
+
+int pcm_ring_read(pcm_ring_t *ring, uint8_t *buf, int size) {
+    uint32_t tail = dt_atomic_load_relaxed(&ring->tail);
+    uint32_t level = dt_atomic_load(&ring->head) - tail;
+    uint32_t n = (size > 0 && (uint32_t) size < level) ? (uint32_t) size : level;
+    if (size <= 0 || n == 0)
+        return 0;
+    uint32_t pos = tail & (ring->size - 1);
+    uint32_t first = ring->size - pos;
+    if (first > n)
+        first = n;
+    memcpy(buf, ring->data + pos, first);
+    memcpy(buf + first, ring->data, n - first);
+    dt_atomic_store(&ring->tail, tail + n);
+    return (int) n;
+}
@@ -0,0 +1,54 @@
+/*
+ * pcm_ring.h
+ *
+ * Lock-free single producer / single consumer byte ring between the
+ * thread writing decoded PCM and the audio device callback reading it.
+ * Neither side ever blocks or takes a lock, so a late writer can not hold
+ * up the callback and the callback can not hold up the writer.
+ */
+
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;      // power of two
+    uint32_t head;      // bytes ever written, producer only
+    uint32_t tail;      // bytes ever read, consumer only
+} pcm_ring_t;
+
+/*
+ * capacity is rounded up to a power of two
+ * @return 0 success, -1 out of memory
+ */
+int pcm_ring_init(pcm_ring_t *ring, int capacity);
+
+void pcm_ring_release(pcm_ring_t *ring);
+
+/*
+ * empty the ring, neither side may be running
+ */
+void pcm_ring_reset(pcm_ring_t *ring);
+
+/*
+ * producer side
+ * @return bytes copied in, at most pcm_ring_space
+ */
+int pcm_ring_write(pcm_ring_t *ring, const uint8_t *buf, int size);
+
+int pcm_ring_space(pcm_ring_t *ring);
+
+/*
+ * consumer side
+ * @return bytes copied out, at most pcm_ring_level
+ */
+int pcm_ring_read(pcm_ring_t *ring, uint8_t *buf, int size);
+
+/*
+ * either side; the other one may move it right after
+ */
+int pcm_ring_level(pcm_ring_t *ring);
+
+#endif
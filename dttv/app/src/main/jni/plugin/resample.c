@@ -0,0 +1,245 @@
+/*
+ * resample.c
+ *
+ * Input is kept planar per channel. Output n sits at input time
+ * n * in_rate / out_rate = idx + taps/2 - 1 + frac/L; its taps are the
+ * samples [idx, idx + taps) weighted by the phase of frac.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resample.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define RESAMPLE_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLE_SSE2
+#endif
+
+#define COEF_SHIFT 14   /* sum |coef| stays well below 4.0, s16 * Q14 sums fit int32 */
+
+typedef struct {
+    int taps;           /* multiple of 8 */
+    double rolloff;     /* passband edge, fraction of the lower nyquist */
+    double beta;        /* kaiser window */
+} resample_preset_t;
+
+static const resample_preset_t g_presets[] = {
+        {8,  0.80, 5.0},
+        {16, 0.88, 7.0},
+        {32, 0.93, 8.6},
+        {64, 0.96, 10.0},
+};
+
+struct resampler {
+    int channels;
+    int in_rate;
+    int taps;
+    int64_t L;          /* out_rate / gcd */
+    int64_t M;          /* in_rate / gcd */
+    int phases;         /* L, or RESAMPLE_PHASES when L is larger */
+    int16_t *coefs;     /* phases x taps */
+
+    int16_t *buf;       /* channels planes of cap frames */
+    int cap;
+    int len;            /* frames in each plane */
+    int idx;            /* first tap of the next output */
+    int64_t frac;       /* [0, L) */
+};
+
+static int64_t gcd(int64_t a, int64_t b) {
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+/*
+ * every phase normalised to unity gain, rounding error carried along so
+ * the Q14 taps sum exactly to 1 << COEF_SHIFT
+ */
+static void designFilter(resampler_t *r, const resample_preset_t *p, int in_rate, int out_rate) {
+    const int half = p->taps / 2;
+    double fc = (out_rate < in_rate) ? (double) out_rate / in_rate : 1.0;
+    fc *= p->rolloff;
+    double i0beta = besselI0(p->beta);
+    double h[64];
+
+    for (int ph = 0; ph < r->phases; ph++) {
+        double sum = 0;
+        for (int k = 0; k < p->taps; k++) {
+            double t = (half - 1 - k) + (double) ph / r->phases;
+            double x = t / half;
+            double w = (x > -1.0 && x < 1.0) ? besselI0(p->beta * sqrt(1.0 - x * x)) / i0beta : 0;
+            double s = (t == 0) ? 1.0 : sin(M_PI * fc * t) / (M_PI * fc * t);
+            h[k] = fc * s * w;
+            sum += h[k];
+        }
+        int16_t *c = r->coefs + ph * p->taps;
+        double err = 0;
+        for (int k = 0; k < p->taps; k++) {
+            double v = h[k] / sum * (1 << COEF_SHIFT) + err;
+            c[k] = (int16_t) lrint(v);
+            err = v - c[k];
+        }
+    }
+}
+
+resampler_t *resampler_create(int channels, int in_rate, int out_rate, int quality) {
+    if (channels <= 0 || in_rate <= 0 || out_rate <= 0 || quality < RESAMPLE_FAST
+        || quality > RESAMPLE_BEST)
+        return NULL;
+    resampler_t *r = (resampler_t *) malloc(sizeof(resampler_t));
+    if (!r)
+        return NULL;
+    memset(r, 0, sizeof(resampler_t));
+    const resample_preset_t *p = &g_presets[quality];
+    int64_t g = gcd(in_rate, out_rate);
+    r->channels = channels;
+    r->in_rate = in_rate;
+    r->taps = p->taps;
+    r->L = out_rate / g;
+    r->M = in_rate / g;
+    r->phases = (r->L < RESAMPLE_PHASES) ? (int) r->L : RESAMPLE_PHASES;
+    r->coefs = (int16_t *) malloc(sizeof(int16_t) * r->phases * r->taps);
+    if (!r->coefs) {
+        free(r);
+        return NULL;
+    }
+    designFilter(r, p, in_rate, out_rate);
+    resampler_reset(r);
+    return r;
+}
+
+void resampler_destroy(resampler_t *r) {
+    if (!r)
+        return;
+    free(r->coefs);
+    free(r->buf);
+    free(r);
+}
+
+void resampler_reset(resampler_t *r) {
+    /* the first output is centred on the first input sample */
+    r->len = r->taps / 2 - 1;
+    r->idx = 0;
+    r->frac = 0;
+    if (r->buf)
+        memset(r->buf, 0, sizeof(int16_t) * r->channels * r->cap);
+}
+
+int resampler_max_out(resampler_t *r, int in_frames) {
+    return (int) ((int64_t) (r->len + in_frames) * r->L / r->M) + 2;
+}
+
+int resampler_delay(resampler_t *r) {
+    /* inputs past the centre tap of the next output */
+    int frames = r->len - r->idx - (r->taps / 2 - 1);
+    return (frames > 0) ? (int) ((int64_t) frames * 1000000 / r->in_rate) : 0;
+}
+
+static int reserve(resampler_t *r, int frames) {
+    if (frames <= r->cap)
+        return 0;
+    int cap = frames + frames / 2;
+    int16_t *buf = (int16_t *) malloc(sizeof(int16_t) * r->channels * cap);
+    if (!buf)
+        return -1;
+    memset(buf, 0, sizeof(int16_t) * r->channels * cap);
+    for (int ch = 0; ch < r->channels && r->buf; ch++)
+        memcpy(buf + ch * cap, r->buf + ch * r->cap, sizeof(int16_t) * r->len);
+    free(r->buf);
+    r->buf = buf;
+    r->cap = cap;
+    return 0;
+}
+
+static inline int32_t dot(const int16_t *x, const int16_t *h, int taps) {
+#if defined(RESAMPLE_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (int k = 0; k < taps; k += 8) {
+        int16x8_t a = vld1q_s16(x + k);
+        int16x8_t b = vld1q_s16(h + k);
+        acc = vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b));
+        acc = vmlal_s16(acc, vget_high_s16(a), vget_high_s16(b));
+    }
+    int32x2_t s = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    s = vpadd_s32(s, s);
+    return vget_lane_s32(s, 0);
+#elif defined(RESAMPLE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (int k = 0; k < taps; k += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (x + k));
+        __m128i b = _mm_loadu_si128((const __m128i *) (h + k));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t acc = 0;
+    for (int k = 0; k < taps; k++)
+        acc += x[k] * h[k];
+    return acc;
+#endif
+}
+
+static inline int16_t clip16(int32_t acc) {
+    acc = (acc + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT;
+    return (int16_t) (acc < -32768 ? -32768 : (acc > 32767 ? 32767 : acc));
+}
+
+int resampler_process(resampler_t *r, const int16_t *in, int in_frames, int16_t *out) {
+    const int channels = r->channels;
+    const int taps = r->taps;
+    if (reserve(r, r->len + in_frames) < 0)
+        return -1;
+    for (int ch = 0; ch < channels; ch++) {
+        int16_t *plane = r->buf + ch * r->cap + r->len;
+        for (int i = 0; i < in_frames; i++)
+            plane[i] = in[i * channels + ch];
+    }
+    r->len += in_frames;
+
+    int n = 0;
+    while (r->idx + taps <= r->len) {
+        int phase = (int) ((r->phases == r->L) ? r->frac : r->frac * r->phases / r->L);
+        const int16_t *h = r->coefs + phase * taps;
+        for (int ch = 0; ch < channels; ch++)
+            *out++ = clip16(dot(r->buf + ch * r->cap + r->idx, h, taps));
+        n++;
+        r->frac += r->M;
+        r->idx += (int) (r->frac / r->L);
+        r->frac %= r->L;
+    }
+
+    /* keep what the next outputs still read; downsampling may step past
+     * the end */
+    int drop = (r->idx < r->len) ? r->idx : r->len;
+    if (drop) {
+        for (int ch = 0; ch < channels; ch++) {
+            int16_t *plane = r->buf + ch * r->cap;
+            memmove(plane, plane + drop, sizeof(int16_t) * (r->len - drop));
+        }
+        r->len -= drop;
+        r->idx -= drop;
+    }
+    return n;
+}
@@ -0,0 +1,53 @@
+/*
+ * resample.h
+ *
+ * Polyphase windowed-sinc sample rate converter for interleaved S16. The
+ * ratio is kept exact as in_rate/out_rate reduced, so the output never
+ * drifts against the input; the filter bank holds up to RESAMPLE_PHASES
+ * phases and ratios needing more use the nearest one. Coefficients are
+ * Q14, the dot products run on NEON or SSE2 where the build has them.
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+
+#define RESAMPLE_FAST   0   /* 8 taps */
+#define RESAMPLE_MEDIUM 1   /* 16 taps */
+#define RESAMPLE_HIGH   2   /* 32 taps */
+#define RESAMPLE_BEST   3   /* 64 taps */
+
+#define RESAMPLE_PHASES 1024
+
+typedef struct resampler resampler_t;
+
+/*
+ * @return NULL on bad parameters or out of memory
+ */
+resampler_t *resampler_create(int channels, int in_rate, int out_rate, int quality);
+
+void resampler_destroy(resampler_t *r);
+
+/*
+ * drop the history, the next input starts a new stream
+ */
+void resampler_reset(resampler_t *r);
+
+/*
+ * most frames resampler_process can return for in_frames
+ */
+int resampler_max_out(resampler_t *r, int in_frames);
+
+/*
+ * consumes all of in; out must hold resampler_max_out(in_frames) frames
+ * @return frames written, -1 out of memory
+ */
+int resampler_process(resampler_t *r, const int16_t *in, int in_frames, int16_t *out);
+
+/*
+ * us of input held back for the filter's look-ahead
+ */
+int resampler_delay(resampler_t *r);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * sample_conv.c
+ *
+ * The vector and scalar paths give identical output: s16 is rounded as
+ * trunc(y + 32768.5) - 32768 after clipping, s32 truncates, and the
+ * dither generators advance the same way in both.
+ */
+
+#include <string.h>
+
+#include "sample_conv.h"
+
+#if defined(SAMPLE_CONV_NO_SIMD)
+/* scalar only, test_sample_conv checks the vector paths against it */
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define SAMPLE_CONV_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SAMPLE_CONV_SSE2
+#endif
+
+#define BLOCK 256       /* frames per pass through float */
+
+#define S16_SCALE 32768.0f
+#define S24_SCALE 8388608.0f
+#define S32_SCALE 2147483648.0f
+#define S32_MAX   2147483520.0f     /* largest float below 2^31 */
+
+int sample_bytes(int fmt) {
+    switch (fmt) {
+        case SAMPLE_S16:
+            return 2;
+        case SAMPLE_S24:
+            return 3;
+        case SAMPLE_S32:
+        case SAMPLE_FLT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+int sample_fmt_of_width(int bits) {
+    switch (bits) {
+        case 16:
+            return SAMPLE_S16;
+        case 24:
+            return SAMPLE_S24;
+        case 32:
+            return SAMPLE_S32;
+        default:
+            return -1;
+    }
+}
+
+int sample_conv_init(sample_conv_t *c, int src_fmt, int src_planar, int dst_fmt, int channels,
+                     int dither) {
+    if (!sample_bytes(src_fmt) || !sample_bytes(dst_fmt) || channels <= 0
+        || channels > SAMPLE_CONV_MAX_CHANNELS)
+        return -1;
+    memset(c, 0, sizeof(*c));
+    c->src_fmt = src_fmt;
+    c->src_planar = src_planar;
+    c->dst_fmt = dst_fmt;
+    c->channels = channels;
+    /* s16 into s16 has nothing to dither away */
+    c->dither = dither && dst_fmt == SAMPLE_S16 && src_fmt != SAMPLE_S16;
+    c->seed[0] = 0x9e3779b9;
+    c->seed[1] = 0x7f4a7c15;
+    c->seed[2] = 0x94d049bb;
+    c->seed[3] = 0x2545f491;
+    return 0;
+}
+
+/*
+ * xorshift32, two 16 bit halves summed: triangular in (-1, 1) lsb
+ */
+static inline float ditherNext(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return (float) ((int) (x & 0xffff) + (int) (x >> 16) - 65535) * (1.0f / 65536);
+}
+
+static inline int16_t floatToS16(float y) {
+    y = (y < -S16_SCALE) ? -S16_SCALE : ((y > S16_SCALE - 1) ? S16_SCALE - 1 : y);
+    return (int16_t) ((int) (y + 32768.5f) - 32768);
+}
+
+static inline int32_t floatToS32(float y) {
+    y = (y < -S32_SCALE) ? -S32_SCALE : ((y > S32_MAX) ? S32_MAX : y);
+    return (int32_t) y;
+}
+
+static void toFloat(int fmt, const uint8_t *src, int n, float *dst) {
+    int i = 0;
+    if (fmt == SAMPLE_FLT) {
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+    if (fmt == SAMPLE_S24) {
+        for (; i < n; i++, src += 3) {
+            int32_t v = (int32_t) ((uint32_t) src[0] << 8 | (uint32_t) src[1] << 16
+                                   | (uint32_t) src[2] << 24) >> 8;
+            dst[i] = v * (1.0f / S24_SCALE);
+        }
+        return;
+    }
+    if (fmt == SAMPLE_S16) {
+        const int16_t *s = (const int16_t *) src;
+#if defined(SAMPLE_CONV_NEON)
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t v = vld1q_s16(s + i);
+            vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / S16_SCALE));
+            vst1q_f32(dst + i + 4,
+                      vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / S16_SCALE));
+        }
+#elif defined(SAMPLE_CONV_SSE2)
+        const __m128 k = _mm_set1_ps(1.0f / S16_SCALE);
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+        }
+#endif
+        for (; i < n; i++)
+            dst[i] = s[i] * (1.0f / S16_SCALE);
+        return;
+    }
+    /* SAMPLE_S32 */
+    const int32_t *s = (const int32_t *) src;
+#if defined(SAMPLE_CONV_NEON)
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(s + i)), 1.0f / S32_SCALE));
+#elif defined(SAMPLE_CONV_SSE2)
+    const __m128 k = _mm_set1_ps(1.0f / S32_SCALE);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) (s + i))), k));
+#endif
+    for (; i < n; i++)
+        dst[i] = s[i] * (1.0f / S32_SCALE);
+}
+
+static void toS16(sample_conv_t *c, const float *src, int n, int16_t *dst) {
+    int i = 0;
+#if defined(SAMPLE_CONV_NEON)
+    const float32x4_t lo = vdupq_n_f32(-S16_SCALE), hi = vdupq_n_f32(S16_SCALE - 1);
+    const float32x4_t bias = vdupq_n_f32(32768.5f);
+    const int32x4_t offset = vdupq_n_s32(32768);
+    uint32x4_t seed = vld1q_u32(c->seed);
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t y[2];
+        for (int h = 0; h < 2; h++) {
+            y[h] = vmulq_n_f32(vld1q_f32(src + i + 4 * h), S16_SCALE);
+            if (c->dither) {
+                seed = veorq_u32(seed, vshlq_n_u32(seed, 13));
+                seed = veorq_u32(seed, vshrq_n_u32(seed, 17));
+                seed = veorq_u32(seed, vshlq_n_u32(seed, 5));
+                int32x4_t t = vreinterpretq_s32_u32(vaddq_u32(vandq_u32(seed, vdupq_n_u32(0xffff)),
+                                                              vshrq_n_u32(seed, 16)));
+                t = vsubq_s32(t, vdupq_n_s32(65535));
+                y[h] = vaddq_f32(y[h], vmulq_n_f32(vcvtq_f32_s32(t), 1.0f / 65536));
+            }
+            y[h] = vaddq_f32(vminq_f32(vmaxq_f32(y[h], lo), hi), bias);
+        }
+        int16x4_t a = vmovn_s32(vsubq_s32(vcvtq_s32_f32(y[0]), offset));
+        int16x4_t b = vmovn_s32(vsubq_s32(vcvtq_s32_f32(y[1]), offset));
+        vst1q_s16(dst + i, vcombine_s16(a, b));
+    }
+    vst1q_u32(c->seed, seed);
+#elif defined(SAMPLE_CONV_SSE2)
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    const __m128 lo = _mm_set1_ps(-S16_SCALE), hi = _mm_set1_ps(S16_SCALE - 1);
+    const __m128 bias = _mm_set1_ps(32768.5f);
+    const __m128i offset = _mm_set1_epi32(32768);
+    __m128i seed = _mm_loadu_si128((const __m128i *) c->seed);
+    for (; i + 8 <= n; i += 8) {
+        __m128i q[2];
+        for (int h = 0; h < 2; h++) {
+            __m128 y = _mm_mul_ps(_mm_loadu_ps(src + i + 4 * h), scale);
+            if (c->dither) {
+                seed = _mm_xor_si128(seed, _mm_slli_epi32(seed, 13));
+                seed = _mm_xor_si128(seed, _mm_srli_epi32(seed, 17));
+                seed = _mm_xor_si128(seed, _mm_slli_epi32(seed, 5));
+                __m128i t = _mm_add_epi32(_mm_and_si128(seed, _mm_set1_epi32(0xffff)),
+                                          _mm_srli_epi32(seed, 16));
+                t = _mm_sub_epi32(t, _mm_set1_epi32(65535));
+                y = _mm_add_ps(y, _mm_mul_ps(_mm_cvtepi32_ps(t), _mm_set1_ps(1.0f / 65536)));
+            }
+            y = _mm_add_ps(_mm_min_ps(_mm_max_ps(y, lo), hi), bias);
+            q[h] = _mm_sub_epi32(_mm_cvttps_epi32(y), offset);
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(q[0], q[1]));
+    }
+    _mm_storeu_si128((__m128i *) c->seed, seed);
+#endif
+    for (; i < n; i++) {
+        float y = src[i] * S16_SCALE;
+        if (c->dither)
+            y += ditherNext(&c->seed[i & 3]);
+        dst[i] = floatToS16(y);
+    }
+}
+
+static void fromFloat(sample_conv_t *c, const float *src, int n, uint8_t *dst) {
+    int i = 0;
+    switch (c->dst_fmt) {
+        case SAMPLE_S16:
+            toS16(c, src, n, (int16_t *) dst);
+            break;
+        case SAMPLE_S24:
+            for (; i < n; i++, dst += 3) {
+                float y = src[i] * S24_SCALE;
+                y = (y < -S24_SCALE) ? -S24_SCALE : ((y > S24_SCALE - 1) ? S24_SCALE - 1 : y);
+                int32_t v = (int32_t) (y + 8388608.5f) - 8388608;
+                dst[0] = (uint8_t) v;
+                dst[1] = (uint8_t) (v >> 8);
+                dst[2] = (uint8_t) (v >> 16);
+            }
+            break;
+        case SAMPLE_S32: {
+            int32_t *d = (int32_t *) dst;
+#if defined(SAMPLE_CONV_NEON)
+            const float32x4_t lo = vdupq_n_f32(-S32_SCALE), hi = vdupq_n_f32(S32_MAX);
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t y = vmulq_n_f32(vld1q_f32(src + i), S32_SCALE);
+                vst1q_s32(d + i, vcvtq_s32_f32(vminq_f32(vmaxq_f32(y, lo), hi)));
+            }
+#elif defined(SAMPLE_CONV_SSE2)
+            const __m128 lo = _mm_set1_ps(-S32_SCALE), hi = _mm_set1_ps(S32_MAX);
+            const __m128 scale = _mm_set1_ps(S32_SCALE);
+            for (; i + 4 <= n; i += 4) {
+                __m128 y = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+                _mm_storeu_si128((__m128i *) (d + i),
+                                 _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(y, lo), hi)));
+            }
+#endif
+            for (; i < n; i++)
+                d[i] = floatToS32(src[i] * S32_SCALE);
+            break;
+        }
+        default:
+            memcpy(dst, src, n * sizeof(float));
+            break;
+    }
+}
+
+void sample_conv_run(sample_conv_t *c, void *dst, const void *const *src, int frames) {
+    const int channels = c->channels;
+    const int sb = sample_bytes(c->src_fmt);
+    const int db = sample_bytes(c->dst_fmt);
+    uint8_t *out = (uint8_t *) dst;
+
+    if (!c->src_planar && c->src_fmt == c->dst_fmt) {
+        memcpy(out, src[0], (size_t) frames * channels * sb);
+        return;
+    }
+
+    float block[BLOCK * SAMPLE_CONV_MAX_CHANNELS];
+    float plane[BLOCK];
+    for (int done = 0; done < frames; done += BLOCK) {
+        int k = (frames - done < BLOCK) ? frames - done : BLOCK;
+        if (!c->src_planar) {
+            toFloat(c->src_fmt, (const uint8_t *) src[0] + (size_t) done * channels * sb,
+                    k * channels, block);
+        } else {
+            for (int ch = 0; ch < channels; ch++) {
+                toFloat(c->src_fmt, (const uint8_t *) src[ch] + (size_t) done * sb, k, plane);
+                for (int i = 0; i < k; i++)
+                    block[i * channels + ch] = plane[i];
+            }
+        }
+        fromFloat(c, block, k * channels, out + (size_t) done * channels * db);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * sample_conv.h
+ *
+ * PCM sample format conversion between s16, packed s24, s32 and float,
+ * interleaved or planar, into interleaved output. Everything goes through
+ * float in blocks that stay in cache; the s16/s32/float legs run on NEON
+ * or SSE2 where the build has them. Narrowing to s16 can add TPDF dither.
+ * Float is nominal [-1, 1), integers are clipped on the way out.
+ */
+
+#ifndef SAMPLE_CONV_H
+#define SAMPLE_CONV_H
+
+#include <stdint.h>
+
+#define SAMPLE_S16  0
+#define SAMPLE_S24  1   /* 3 bytes little endian */
+#define SAMPLE_S32  2
+#define SAMPLE_FLT  3
+
+#define SAMPLE_CONV_MAX_CHANNELS 8
+
+typedef struct {
+    int src_fmt;
+    int src_planar;
+    int dst_fmt;
+    int channels;
+    int dither;         /* to s16 from wider formats */
+    uint32_t seed[4];   /* dither noise, one generator per vector lane */
+} sample_conv_t;
+
+int sample_bytes(int fmt);
+
+/*
+ * SAMPLE_* of an integer container width in bits, -1 none
+ */
+int sample_fmt_of_width(int bits);
+
+/*
+ * @return -1 unsupported format or more than SAMPLE_CONV_MAX_CHANNELS
+ */
+int sample_conv_init(sample_conv_t *c, int src_fmt, int src_planar, int dst_fmt, int channels,
+                     int dither);
+
+/*
+ * src - one pointer per channel when planar, else src[0] only
+ * dst - interleaved, frames * channels samples of dst_fmt
+ */
+void sample_conv_run(sample_conv_t *c, void *dst, const void *const *src, int frames);
+
+#endif
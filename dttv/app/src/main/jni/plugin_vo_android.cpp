@@ -7,11 +7,16 @@
 #include <android/log.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
 
 #include "dtvideo_android.h"
 #include "../../../../3rd/libdtp/include/vo_wrapper.h"
 #include "dt_lock.h"
+#include "vo_bind.h"
+#include "native_atomic.h"
 #include "gl_yuv.h"
+#include "plugin_vo_android.h"
 
 static int vo_android_init(dtvideo_output_t *vout);
 
@@ -21,9 +26,21 @@ static int vo_android_stop(dtvideo_output_t *vout);
 
 struct vo_info {
     int dx, dy, dw, dh;
-    dt_lock_t mutex;
+    dtvideo_output_t *vout;         // NULL: slot free
+    yuv_renderer_t *renderer;
+    int rendering;                  // vo_android_render calls on renderer
 };
 
+// libdtp keeps a single registered wrapper per name and hands every player
+// the same one, so per player state can not live in vo_android.handle.
+// Each vout gets a slot of its own instead, looked up without a lock on the
+// render path; slots are never freed, the table only changes in init/stop.
+#define VO_ANDROID_MAX_INSTANCES 8
+
+static struct vo_info g_instances[VO_ANDROID_MAX_INSTANCES];
+static vo_bind_t g_bind = VO_BIND_INITIALIZER;
+static dt_lock_t g_instanceLock = PTHREAD_MUTEX_INITIALIZER;
+
 vo_wrapper_t vo_android = {
         .id = 0x100,//VO_ID_ANDROID,
         .name = "vo android",
@@ -32,53 +49,102 @@ vo_wrapper_t vo_android = {
         .vo_render = vo_android_render,
 };
 
-static void dump_frame(dt_av_frame_t *pFrame, int width, int height, int iFrame) {
-    FILE *pFile;
-    char szFilename[32];
-    int y;
-    // Open file
-    sprintf(szFilename, "/data/frame%d.ppm", iFrame);
-    pFile = fopen(szFilename, "wb");
-    if (pFile == NULL) {
-        return;
+int vo_android_start(yuv_renderer_t *renderer, vo_bind_req_t *req) {
+    req->output = renderer;
+    return vo_bind_start(&g_bind, req);
+}
+
+void vo_android_unbind(yuv_renderer_t *renderer) {
+    // outside the table lock, it may wait for a dtplayer_start bringing a
+    // vo up; a vo_init after it finds nothing pending
+    vo_bind_withdraw(&g_bind, renderer);
+    dt_lock(&g_instanceLock);
+    for (int i = 0; i < VO_ANDROID_MAX_INSTANCES; i++) {
+        struct vo_info *info = &g_instances[i];
+        if (info->vout && info->renderer == renderer) {
+            // vo still running on a renderer going away: frames get dropped
+            dt_atomic_store(&info->renderer, (yuv_renderer_t *) NULL);
+            // pairs with the fence in vo_android_render: it either sees the
+            // renderer gone or is counted here, the renderer is destroyed next
+            dt_atomic_fence();
+            while (dt_atomic_load(&info->rendering)) {
+                sched_yield();
+            }
+        }
     }
-    // Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
-    // Write pixel data
-    for (y = 0; y < height; y++) {
-        fwrite(pFrame->data[0] + y * pFrame->linesize[0], 1, width * 3, pFile);
+    dt_unlock(&g_instanceLock);
+}
+
+// the slot of vout stays put while its output thread renders, only its
+// own vo_android_stop frees it
+static struct vo_info *find_instance(dtvideo_output_t *vout) {
+    for (int i = 0; i < VO_ANDROID_MAX_INSTANCES; i++) {
+        if (dt_atomic_load(&g_instances[i].vout) == vout) {
+            return &g_instances[i];
+        }
     }
-    // Close file
-    fclose(pFile);
+    return NULL;
 }
 
 static int vo_android_init(dtvideo_output_t *vout) {
-    struct vo_info *info = (struct vo_info *) malloc(sizeof(struct vo_info));
-    vo_android.handle = info;
+    dt_lock(&g_instanceLock);
+    struct vo_info *info = NULL;
+    for (int i = 0; i < VO_ANDROID_MAX_INSTANCES; i++) {
+        if (!g_instances[i].vout) {
+            info = &g_instances[i];
+            break;
+        }
+    }
+    if (!info) {
+        dt_unlock(&g_instanceLock);
+        LOGV("too many android vo instances\n");
+        return -1;
+    }
     info->dx = 0;
     info->dy = 0;
     info->dw = vout->para->d_width;
     info->dh = vout->para->d_height;
-    dt_lock_init(&info->mutex, NULL);
-    LOGV("android vo init OK, w:%d h:%d\n", info->dw, info->dh);
+    info->rendering = 0;
+    // the player starting now, see vo_bind.h; taken under the table lock so
+    // an unbind either withdraws it or finds the instance
+    info->renderer = (yuv_renderer_t *) vo_bind_take(&g_bind);
+    dt_atomic_store(&info->vout, vout);
+    dt_unlock(&g_instanceLock);
+
+    LOGV("android vo init OK, w:%d h:%d renderer:%p\n", info->dw, info->dh, info->renderer);
     return 0;
 }
 
 static int vo_android_render(dtvideo_output_t *vout, dt_av_frame_t *frame) {
-    struct vo_info *info = (struct vo_info *) vo_android.handle;
-    int size = info->dw * info->dh * 3 / 2; // yuv 420 size
-
-    dt_lock(&info->mutex);
-    yuv_update_frame(frame);
-    frame->data[0] = NULL;
-    dt_unlock(&info->mutex);
-    return 0;
+    struct vo_info *info = find_instance(vout);
+    if (!info) {
+        return -1;
+    }
+    // an unbind waits for this push before its renderer is destroyed
+    dt_atomic_inc(&info->rendering);
+    dt_atomic_fence();
+    yuv_renderer_t *renderer = dt_atomic_load(&info->renderer);
+    int ret = -1;
+    if (renderer) {
+        // mailbox push never blocks and the renderer is this player's alone,
+        // nothing to serialize against other players
+        yuv_update_frame(renderer, frame);
+        frame->data[0] = NULL;
+        ret = 0;
+    }
+    dt_atomic_dec(&info->rendering);
+    return ret;
 }
 
 static int vo_android_stop(dtvideo_output_t *vout) {
-    struct vo_info *info = (struct vo_info *) vo_android.handle;
-    free(info);
-    vo_android.handle = NULL;
+    // libdtp joins the output thread before vo_stop, no render in flight
+    dt_lock(&g_instanceLock);
+    struct vo_info *info = find_instance(vout);
+    if (info) {
+        info->renderer = NULL;
+        dt_atomic_store(&info->vout, (dtvideo_output_t *) NULL);
+    }
+    dt_unlock(&g_instanceLock);
     LOGV("stop vo android\n");
     return 0;
 }
@@ -0,0 +1,31 @@
+//
+// plugin_vo_android - video output feeding the per player GL renderer.
+//
+
+#ifndef GLES2JNI_PLUGIN_VO_ANDROID_H
+#define GLES2JNI_PLUGIN_VO_ANDROID_H
+
+#include "gl_yuv.h"
+#include "vo_bind.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/vo_wrapper.h"
+}
+
+void vo_android_setup(vo_wrapper_t **vo);
+
+/*
+ * start a player whose frames go to renderer: req->start, dtplayer_start,
+ * runs now or, while another player's vo is still coming up, later on the
+ * bind thread; hands the renderer to the vo it brings up. See vo_bind.h.
+ * @return the start's result, 0 when queued
+ */
+int vo_android_start(yuv_renderer_t *renderer, vo_bind_req_t *req);
+
+/*
+ * forget the renderer: drops a queued start, a vo still running on it
+ * drops its frames; returns once no push into the renderer is in flight
+ */
+void vo_android_unbind(yuv_renderer_t *renderer);
+
+#endif //GLES2JNI_PLUGIN_VO_ANDROID_H
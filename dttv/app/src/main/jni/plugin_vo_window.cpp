@@ -0,0 +1,141 @@
+#include "native_log.h"
+
+#define TAG "VO-WINDOW"
+
+#include <jni.h>
+#include <string.h>
+#include <android/log.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "dtvideo_android.h"
+#include "../../../../3rd/libdtp/include/vo_wrapper.h"
+#include "dt_lock.h"
+#include "vo_bind.h"
+#include "native_atomic.h"
+#include "window_output.h"
+#include "plugin_vo_window.h"
+
+static int vo_window_init(dtvideo_output_t *vout);
+
+static int vo_window_render(dtvideo_output_t *vout, dt_av_frame_t *frame);
+
+static int vo_window_stop(dtvideo_output_t *vout);
+
+struct vo_info {
+    int dx, dy, dw, dh;
+    dtvideo_output_t *vout;         // NULL: slot free
+    window_output_t *output;
+    int rendering;                  // vo_window_render calls on output
+};
+
+// same instance table and bind gate as plugin_vo_android, with a window
+// output in place of the GL renderer
+#define VO_WINDOW_MAX_INSTANCES 8
+
+static struct vo_info g_instances[VO_WINDOW_MAX_INSTANCES];
+static vo_bind_t g_bind = VO_BIND_INITIALIZER;
+static dt_lock_t g_instanceLock = PTHREAD_MUTEX_INITIALIZER;
+
+vo_wrapper_t vo_window = {
+        .id = 0x100,//VO_ID_ANDROID, registered in place of vo_android
+        .name = "vo window",
+        .vo_init = vo_window_init,
+        .vo_stop = vo_window_stop,
+        .vo_render = vo_window_render,
+};
+
+int vo_window_start(window_output_t *output, vo_bind_req_t *req) {
+    req->output = output;
+    return vo_bind_start(&g_bind, req);
+}
+
+void vo_window_unbind(window_output_t *output) {
+    vo_bind_withdraw(&g_bind, output);
+    dt_lock(&g_instanceLock);
+    for (int i = 0; i < VO_WINDOW_MAX_INSTANCES; i++) {
+        struct vo_info *info = &g_instances[i];
+        if (info->vout && info->output == output) {
+            // vo still running on an output going away: frames get dropped,
+            // one being converted finishes first
+            dt_atomic_store(&info->output, (window_output_t *) NULL);
+            dt_atomic_fence();
+            while (dt_atomic_load(&info->rendering)) {
+                sched_yield();
+            }
+        }
+    }
+    dt_unlock(&g_instanceLock);
+}
+
+static struct vo_info *find_instance(dtvideo_output_t *vout) {
+    for (int i = 0; i < VO_WINDOW_MAX_INSTANCES; i++) {
+        if (dt_atomic_load(&g_instances[i].vout) == vout) {
+            return &g_instances[i];
+        }
+    }
+    return NULL;
+}
+
+static int vo_window_init(dtvideo_output_t *vout) {
+    dt_lock(&g_instanceLock);
+    struct vo_info *info = NULL;
+    for (int i = 0; i < VO_WINDOW_MAX_INSTANCES; i++) {
+        if (!g_instances[i].vout) {
+            info = &g_instances[i];
+            break;
+        }
+    }
+    if (!info) {
+        dt_unlock(&g_instanceLock);
+        LOGV("too many window vo instances\n");
+        return -1;
+    }
+    info->dx = 0;
+    info->dy = 0;
+    info->dw = vout->para->d_width;
+    info->dh = vout->para->d_height;
+    info->rendering = 0;
+    // the player starting now, see vo_bind.h; taken under the table lock so
+    // an unbind either withdraws it or finds the instance
+    info->output = (window_output_t *) vo_bind_take(&g_bind);
+    dt_atomic_store(&info->vout, vout);
+    dt_unlock(&g_instanceLock);
+
+    LOGV("window vo init OK, w:%d h:%d output:%p\n", info->dw, info->dh, info->output);
+    return 0;
+}
+
+static int vo_window_render(dtvideo_output_t *vout, dt_av_frame_t *frame) {
+    struct vo_info *info = find_instance(vout);
+    if (!info) {
+        return -1;
+    }
+    dt_atomic_inc(&info->rendering);
+    dt_atomic_fence();
+    window_output_t *output = dt_atomic_load(&info->output);
+    // converted before returning, the frame stays libdtp's
+    int ret = output ? window_output_render(output, frame) : -1;
+    dt_atomic_dec(&info->rendering);
+    return ret;
+}
+
+static int vo_window_stop(dtvideo_output_t *vout) {
+    // libdtp joins the output thread before vo_stop, no render in flight
+    dt_lock(&g_instanceLock);
+    struct vo_info *info = find_instance(vout);
+    if (info) {
+        info->output = NULL;
+        dt_atomic_store(&info->vout, (dtvideo_output_t *) NULL);
+    }
+    dt_unlock(&g_instanceLock);
+    LOGV("stop vo window\n");
+    return 0;
+}
+
+void vo_window_setup(vo_wrapper_t **vo) {
+    *vo = &vo_window;
+    return;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+//
+// plugin_vo_window - video output converting into a window on the CPU.
+//
+
+#ifndef GLES2JNI_PLUGIN_VO_WINDOW_H
+#define GLES2JNI_PLUGIN_VO_WINDOW_H
+
+#include "window_output.h"
+#include "vo_bind.h"
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/vo_wrapper.h"
+}
+
+/*
+ * libdtp takes one external vo: register either this or vo_android,
+ * players of one process share the choice
+ */
+void vo_window_setup(vo_wrapper_t **vo);
+
+/*
+ * vo_android_start for a window output
+ */
+int vo_window_start(window_output_t *output, vo_bind_req_t *req);
+
+/*
+ * forget the output: drops a queued start, a vo still running on it
+ * drops its frames; returns once no conversion into it is in flight
+ */
+void vo_window_unbind(window_output_t *output);
+
+#endif //GLES2JNI_PLUGIN_VO_WINDOW_H
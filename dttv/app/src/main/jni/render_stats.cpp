@@ -0,0 +1,77 @@
+//
+// render_stats - timing histograms of the render loop.
+//
+
+#include <limits.h>
+
+#include "native_atomic.h"
+#include "render_stats.h"
+
+const int g_statsBounds[STATS_BUCKETS - 1] = {
+        250, 500, 1000, 2000, 4000, 8000, 12000, 17500, 25000, 34000, 50000, 100000,
+};
+
+static int bucketOf(int64_t us) {
+    int i = 0;
+    while (i < STATS_BUCKETS - 1 && us >= g_statsBounds[i]) {
+        i++;
+    }
+    return i;
+}
+
+void stats_add(render_stats_t *s, int hist, int64_t us) {
+    stats_hist_t *h = &s->hist[hist];
+    if (us < 0) {
+        us = 0;
+    } else if (us > INT_MAX) {
+        us = INT_MAX;
+    }
+    // atomic adds, a stats_reset from another thread must not be undone by
+    // a load/store pair straddling it
+    dt_atomic_inc(&h->buckets[bucketOf(us)]);
+    dt_atomic_add(&h->sum, us);
+    int max = dt_atomic_load_relaxed(&h->max);
+    while (us > max && !dt_atomic_cas(&h->max, max, (int) us)) {
+        max = dt_atomic_load_relaxed(&h->max);
+    }
+    dt_atomic_inc(&h->count);
+}
+
+void stats_add_jank(render_stats_t *s) {
+    dt_atomic_inc(&s->jank);
+}
+
+int stats_query(render_stats_t *s, int hist, int what) {
+    if (hist < 0 || hist >= STATS_HIST_NB || what >= STATS_BUCKETS) {
+        return -1;
+    }
+    stats_hist_t *h = &s->hist[hist];
+    if (what >= 0) {
+        return dt_atomic_load(&h->buckets[what]);
+    }
+    switch (what) {
+        case STATS_COUNT:
+            return dt_atomic_load(&h->count);
+        case STATS_MEAN: {
+            int count = dt_atomic_load(&h->count);
+            return count ? (int) (dt_atomic_load(&h->sum) / count) : 0;
+        }
+        case STATS_MAX:
+            return dt_atomic_load(&h->max);
+        default:
+            return -1;
+    }
+}
+
+void stats_reset(render_stats_t *s) {
+    for (int i = 0; i < STATS_HIST_NB; i++) {
+        stats_hist_t *h = &s->hist[i];
+        dt_atomic_store(&h->count, 0);
+        for (int k = 0; k < STATS_BUCKETS; k++) {
+            dt_atomic_store(&h->buckets[k], 0);
+        }
+        dt_atomic_store(&h->sum, (int64_t) 0);
+        dt_atomic_store(&h->max, 0);
+    }
+    dt_atomic_store(&s->jank, 0);
+}
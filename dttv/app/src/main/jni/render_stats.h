@@ -0,0 +1,65 @@
+//
+// render_stats - timing histograms of the render loop.
+//
+// The GL thread is the only writer; any thread may read or reset through
+// the atomics, without a lock the render loop could block on. A reader may
+// see a sample in its bucket before it shows up in count, and a sample
+// racing a reset may survive it in part, good enough for telemetry.
+//
+
+#ifndef GLES2JNI_RENDER_STATS_H
+#define GLES2JNI_RENDER_STATS_H
+
+#include <stdint.h>
+
+// bucket i counts samples below g_statsBounds[i] us, the last the rest;
+// frame interval buckets straddle 60 and 30 Hz refresh
+#define STATS_BUCKETS 13
+
+extern const int g_statsBounds[STATS_BUCKETS - 1];
+
+enum {
+    STATS_UPLOAD_CPU = 0,   // texture upload, CPU side
+    STATS_DRAW_CPU,         // draw calls, CPU side
+    STATS_UPLOAD_GPU,       // EXT_disjoint_timer_query, when the driver has it
+    STATS_DRAW_GPU,
+    STATS_INTERVAL,         // between draws of a running render loop
+    STATS_HIST_NB,
+};
+
+// stats_query what, >= 0 is a bucket index
+enum {
+    STATS_COUNT = -1,
+    STATS_MEAN = -2,        // us
+    STATS_MAX = -3,         // us
+};
+
+typedef struct {
+    int buckets[STATS_BUCKETS];
+    int count;
+    int64_t sum;            // us
+    int max;                // us
+} stats_hist_t;
+
+typedef struct {
+    stats_hist_t hist[STATS_HIST_NB];
+    int jank;               // intervals longer than 1.5 refresh periods
+    int gpuTimer;           // GPU histograms are being filled
+} render_stats_t;
+
+/*
+ * writer side
+ */
+void stats_add(render_stats_t *s, int hist, int64_t us);
+
+void stats_add_jank(render_stats_t *s);
+
+/*
+ * any thread
+ * @return -1 for an unknown hist or what
+ */
+int stats_query(render_stats_t *s, int hist, int what);
+
+void stats_reset(render_stats_t *s);
+
+#endif //GLES2JNI_RENDER_STATS_H
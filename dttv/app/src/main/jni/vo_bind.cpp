@@ -0,0 +1,135 @@
+//
+// vo_bind - hands a starting player's output to the vo libdtp brings up.
+//
+
+#include <errno.h>
+#include <time.h>
+
+#include "native_log.h"
+#include "vo_bind.h"
+
+#define TAG "VO-BIND"
+
+static void set_deadline(struct timespec *deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += VO_BIND_TIMEOUT_MS / 1000;
+    deadline->tv_nsec += (VO_BIND_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// lock held: a pending output whose vo never came up stops holding starts
+static void expire(vo_bind_t *b) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (b->pending && !b->running &&
+        (now.tv_sec > b->deadline.tv_sec ||
+         (now.tv_sec == b->deadline.tv_sec && now.tv_nsec >= b->deadline.tv_nsec))) {
+        LOGV("vo for output %p never came up, its binding dropped\n", b->pending);
+        b->pending = NULL;
+    }
+}
+
+// lock held, dropped around the start itself
+static int run_start(vo_bind_t *b, vo_bind_req_t *req, int queued) {
+    b->pending = req->output;
+    b->running = req;
+    set_deadline(&b->deadline);
+    dt_unlock(&b->lock);
+    int ret = req->start(req->opaque, queued);
+    dt_lock(&b->lock);
+    b->running = NULL;
+    if (ret < 0 && b->pending == req->output) {
+        b->pending = NULL;
+    }
+    pthread_cond_broadcast(&b->changed);
+    return ret;
+}
+
+// runs the queued starts in order, one vo coming up at a time
+static void *bind_thread(void *arg) {
+    vo_bind_t *b = (vo_bind_t *) arg;
+    dt_lock(&b->lock);
+    for (;;) {
+        expire(b);
+        if (!b->queue || b->running) {
+            pthread_cond_wait(&b->changed, &b->lock);
+            continue;
+        }
+        if (b->pending) {
+            pthread_cond_timedwait(&b->changed, &b->lock, &b->deadline);
+            continue;
+        }
+        vo_bind_req_t *req = b->queue;
+        b->queue = req->next;
+        req->next = NULL;
+        run_start(b, req, 1);
+    }
+    return NULL;
+}
+
+int vo_bind_start(vo_bind_t *b, vo_bind_req_t *req) {
+    int ret = 0;
+    dt_lock(&b->lock);
+    expire(b);
+    if (!b->pending && !b->running && !b->queue) {
+        ret = run_start(b, req, 0);
+        dt_unlock(&b->lock);
+        return ret;
+    }
+
+    if (!b->thread) {
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        b->thread = pthread_create(&tid, &attr, bind_thread, b) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    if (!b->thread) {
+        LOGV("no bind thread, start of output %p dropped\n", req->output);
+        dt_unlock(&b->lock);
+        return -1;
+    }
+    vo_bind_req_t **tail = &b->queue;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    req->next = NULL;
+    *tail = req;
+    pthread_cond_broadcast(&b->changed);
+    LOGV("output %p queued, another vo is coming up\n", req->output);
+    dt_unlock(&b->lock);
+    return 0;
+}
+
+void *vo_bind_take(vo_bind_t *b) {
+    dt_lock(&b->lock);
+    void *output = b->pending;
+    b->pending = NULL;
+    pthread_cond_broadcast(&b->changed);
+    dt_unlock(&b->lock);
+    return output;
+}
+
+void vo_bind_withdraw(vo_bind_t *b, void *output) {
+    dt_lock(&b->lock);
+    for (vo_bind_req_t **req = &b->queue; *req;) {
+        if ((*req)->output == output) {
+            *req = (*req)->next;
+        } else {
+            req = &(*req)->next;
+        }
+    }
+    // its dtplayer_start is short, the vo may take the output meanwhile
+    while (b->running && b->running->output == output) {
+        pthread_cond_wait(&b->changed, &b->lock);
+    }
+    if (b->pending == output) {
+        b->pending = NULL;
+    }
+    pthread_cond_broadcast(&b->changed);
+    dt_unlock(&b->lock);
+}
@@ -0,0 +1,72 @@
+//
+// vo_bind - hands a starting player's output to the vo libdtp brings up.
+//
+// libdtp passes a vo nothing that tells players apart, so the output a
+// player offers goes to whichever vo_init runs next. To keep two players
+// starting together from swapping outputs, one player starts at a time: a
+// start runs once the previous one's output was taken by its vo, withdrawn,
+// or VO_BIND_TIMEOUT_MS passed because that vo never came up. Starts that
+// have to wait are queued and run in order on the bind thread, the caller
+// never waits.
+//
+
+#ifndef GLES2JNI_VO_BIND_H
+#define GLES2JNI_VO_BIND_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include "dt_lock.h"
+
+#ifndef VO_BIND_TIMEOUT_MS
+#define VO_BIND_TIMEOUT_MS 3000
+#endif
+
+/*
+ * starts the player, dtplayer_start; queued is 1 when it runs on the bind
+ * thread, the caller of vo_bind_start long gone
+ * @return < 0 when the player did not start, its output is dropped
+ */
+typedef int (*vo_bind_start_cb)(void *opaque, int queued);
+
+// owned by the player, linked into the queue while its start waits
+typedef struct vo_bind_req {
+    void *output;
+    vo_bind_start_cb start;
+    void *opaque;
+    struct vo_bind_req *next;
+} vo_bind_req_t;
+
+typedef struct {
+    dt_lock_t lock;
+    pthread_cond_t changed;
+    void *pending;              // started, its vo not up yet
+    struct timespec deadline;   // pending dropped after it
+    vo_bind_req_t *queue;       // waiting for pending, oldest first
+    vo_bind_req_t *running;     // its start runs now
+    int thread;                 // bind thread up
+} vo_bind_t;
+
+#define VO_BIND_INITIALIZER {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, {0, 0}, \
+                             NULL, NULL, 0}
+
+/*
+ * player thread, in place of dtplayer_start; runs req->start now when no
+ * other vo is coming up, else queues it. Never waits.
+ * @return the start's result when it ran now, 0 when queued
+ */
+int vo_bind_start(vo_bind_t *b, vo_bind_req_t *req);
+
+/*
+ * vo_init
+ * @return the output started last, NULL when none is pending
+ */
+void *vo_bind_take(vo_bind_t *b);
+
+/*
+ * the player goes away: drops its queued start, or its output before the
+ * vo came up. Waits for its start when that runs right now.
+ */
+void vo_bind_withdraw(vo_bind_t *b, void *output);
+
+#endif //GLES2JNI_VO_BIND_H
@@ -0,0 +1,152 @@
+//
+// window_output - GL-free video output into an ANativeWindow.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_log.h"
+#include "dt_lock.h"
+#include "gl_yuv.h"
+#include "yuv2rgb.h"
+#include "window_output.h"
+
+#define TAG "WINDOW-OUTPUT"
+
+struct window_output {
+    dt_lock_t lock;             // window against render
+    ANativeWindow *window;
+    int format;                 // YUV2RGB_*
+    yuv2rgb_pool_t *pool;
+
+    // geometry last set on window, 0 after a window change
+    int bufWidth;
+    int bufHeight;
+    int rejectedPixfmt;         // logged once, -1 none
+};
+
+static int windowFormat(int format) {
+    return (format == YUV2RGB_RGB565) ? WINDOW_FORMAT_RGB_565 : WINDOW_FORMAT_RGBA_8888;
+}
+
+static int pixelBytes(int format) {
+    return (format == YUV2RGB_RGB565) ? 2 : 4;
+}
+
+window_output_t *window_output_create(int format, int threads) {
+    window_output_t *w = (window_output_t *) malloc(sizeof(window_output_t));
+    if (!w) {
+        return NULL;
+    }
+    memset(w, 0, sizeof(window_output_t));
+    w->pool = yuv2rgb_pool_create(threads);
+    if (!w->pool) {
+        free(w);
+        return NULL;
+    }
+    dt_lock_init(&w->lock, NULL);
+    w->format = format;
+    w->rejectedPixfmt = -1;
+    return w;
+}
+
+void window_output_destroy(window_output_t *w) {
+    if (!w) {
+        return;
+    }
+    window_output_set_window(w, NULL);
+    yuv2rgb_pool_destroy(w->pool);
+    free(w);
+}
+
+void window_output_set_window(window_output_t *w, ANativeWindow *window) {
+    if (window) {
+        ANativeWindow_acquire(window);
+    }
+    dt_lock(&w->lock);
+    ANativeWindow *old = w->window;
+    w->window = window;
+    w->bufWidth = 0;
+    w->bufHeight = 0;
+    dt_unlock(&w->lock);
+    if (old) {
+        ANativeWindow_release(old);
+    }
+}
+
+/*
+ * 8-bit 4:2:0/4:2:2, planar or NV12/NV21; others are left to the GL output
+ */
+static int mapSource(window_output_t *w, dt_av_frame_t *frame, yuv2rgb_src_t *src) {
+    yuv_format_t fmt;
+    yuv_planes_t planes;
+    yuv_get_format(frame->pixfmt, &fmt);
+    if (fmt.depth > 8 || fmt.chromaShiftW != 1) {
+        if (w->rejectedPixfmt != frame->pixfmt) {
+            LOGV("pixfmt %d not supported by the window output, dropped \n", frame->pixfmt);
+            w->rejectedPixfmt = frame->pixfmt;
+        }
+        return -1;
+    }
+    yuv_get_planes(frame, &fmt, &planes);
+    for (int i = 0; i < 3; i++) {
+        src->data[i] = (i < planes.count) ? planes.data[i] : NULL;
+        src->linesize[i] = (i < planes.count) ? planes.linesize[i] : 0;
+    }
+    src->width = frame->width;
+    src->height = frame->height;
+    if (fmt.layout == YUV_LAYOUT_NV12) {
+        src->layout = YUV2RGB_NV12;
+    } else if (fmt.layout == YUV_LAYOUT_NV21) {
+        src->layout = YUV2RGB_NV21;
+    } else {
+        src->layout = YUV2RGB_PLANAR;
+    }
+    src->chromaShiftH = fmt.chromaShiftH;
+    src->bt709 = (frame->height >= YUV_HD_HEIGHT);
+    src->fullRange = fmt.fullRange;
+    return 0;
+}
+
+int window_output_render(window_output_t *w, dt_av_frame_t *frame) {
+    yuv2rgb_src_t src;
+    int ret = -1;
+    if (!frame->data[0] || frame->width <= 0 || frame->height <= 0) {
+        return -1;
+    }
+    dt_lock(&w->lock);
+    if (!w->window || mapSource(w, frame, &src) < 0) {
+        goto END;
+    }
+    if (w->bufWidth != src.width || w->bufHeight != src.height) {
+        if (ANativeWindow_setBuffersGeometry(w->window, src.width, src.height,
+                                             windowFormat(w->format)) < 0) {
+            LOGV("window geometry %dx%d failed \n", src.width, src.height);
+            goto END;
+        }
+        w->bufWidth = src.width;
+        w->bufHeight = src.height;
+        LOGV("window buffers %dx%d format:%d \n", src.width, src.height, w->format);
+    }
+
+    ANativeWindow_Buffer buf;
+    if (ANativeWindow_lock(w->window, &buf, NULL) < 0) {
+        LOGV("window lock failed \n");
+        goto END;
+    }
+    // a resize queued behind buffers of the old size: draw what fits
+    if (buf.width < src.width) {
+        src.width = buf.width;
+    }
+    if (buf.height < src.height) {
+        src.height = buf.height;
+    }
+    yuv2rgb_convert(w->pool, &src, (uint8_t *) buf.bits, buf.stride * pixelBytes(w->format),
+                    w->format);
+    ANativeWindow_unlockAndPost(w->window);
+    ret = 0;
+
+    END:
+    dt_unlock(&w->lock);
+    return ret;
+}
@@ -0,0 +1,41 @@
+//
+// window_output - GL-free video output into an ANativeWindow.
+//
+// Each frame is converted to RGB straight into a locked window buffer
+// (ANativeWindow_lock/unlockAndPost) by the yuv2rgb kernels. The buffers are
+// frame sized, the compositor scales them to the surface. For devices and
+// surfaces where a GL context is unavailable or costs more than it saves.
+//
+
+#ifndef GLES2JNI_WINDOW_OUTPUT_H
+#define GLES2JNI_WINDOW_OUTPUT_H
+
+#include <android/native_window.h>
+
+extern "C" {
+#include "../../../../3rd/libdtp/include/dt_av.h"
+}
+
+typedef struct window_output window_output_t;
+
+/*
+ * format - YUV2RGB_RGBA8888 or YUV2RGB_RGB565
+ * threads - converting threads, 0 picks from the online cores
+ */
+window_output_t *window_output_create(int format, int threads);
+
+void window_output_destroy(window_output_t *w);
+
+/*
+ * window to draw into, NULL detaches; the window is acquired and the
+ * previous one released, a frame being drawn finishes first
+ */
+void window_output_set_window(window_output_t *w, ANativeWindow *window);
+
+/*
+ * convert and post one frame, any thread but one at a time
+ * @return -1 if dropped: no window, unsupported pixel format, lock failure
+ */
+int window_output_render(window_output_t *w, dt_av_frame_t *frame);
+
+#endif //GLES2JNI_WINDOW_OUTPUT_H
@@ -0,0 +1,377 @@
+//
+// yuv2rgb - YUV to RGBA8888/RGB565 conversion on the CPU.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "native_log.h"
+#include "native_atomic.h"
+#include "dt_lock.h"
+#include "yuv2rgb.h"
+
+#define TAG "YUV2RGB"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define YUV2RGB_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define YUV2RGB_SSE2
+#endif
+
+// bands per thread, a slow band on one core does not hold up the frame
+#define YUV2RGB_BANDS_PER_THREAD 2
+
+// 6 fractional bits: y*coef + chroma terms stays within int16 up to the
+// clamp, what the vector kernels multiply in
+typedef struct {
+    int16_t y;
+    int16_t yOffset;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+} yuv2rgb_coefs_t;
+
+// [bt709][fullRange], limited range chroma scaled by 255/224
+static const yuv2rgb_coefs_t g_coefs[2][2] = {
+        {{75, 16, 102, 25, 52, 129}, {64, 0, 90, 22, 46, 113}},
+        {{75, 16, 115, 14, 34, 135}, {64, 0, 101, 12, 30, 119}},
+};
+
+static inline uint8_t clamp8(int v) {
+    return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/*
+ * pixels [from, width) of a row; u/v step over interleaved chroma
+ */
+static void convertTail(const yuv2rgb_coefs_t *c, const uint8_t *y, const uint8_t *u,
+                        const uint8_t *v, int chromaStep, uint8_t *dst, int format, int from,
+                        int width) {
+    for (int x = from; x < width; x++) {
+        int cu = u[(x >> 1) * chromaStep] - 128;
+        int cv = v[(x >> 1) * chromaStep] - 128;
+        int yt = (y[x] - c->yOffset) * c->y + 32;
+        uint8_t r = clamp8((yt + c->rv * cv) >> 6);
+        uint8_t g = clamp8((yt - c->gu * cu - c->gv * cv) >> 6);
+        uint8_t b = clamp8((yt + c->bu * cu) >> 6);
+        if (format == YUV2RGB_RGBA8888) {
+            uint8_t *p = dst + 4 * x;
+            p[0] = r;
+            p[1] = g;
+            p[2] = b;
+            p[3] = 0xff;
+        } else {
+            ((uint16_t *) dst)[x] = (uint16_t) (((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+        }
+    }
+}
+
+#if defined(YUV2RGB_NEON)
+
+// 8 pixels, chroma already duplicated per pixel
+static inline void rgb8(const yuv2rgb_coefs_t *c, int16x8_t y, int16x8_t u, int16x8_t v,
+                        uint8x8_t *r, uint8x8_t *g, uint8x8_t *b) {
+    int16x8_t yt = vaddq_s16(vmulq_s16(vsubq_s16(y, vdupq_n_s16(c->yOffset)), vdupq_n_s16(c->y)),
+                             vdupq_n_s16(32));
+    *r = vqshrun_n_s16(vqaddq_s16(yt, vmulq_s16(v, vdupq_n_s16(c->rv))), 6);
+    *g = vqshrun_n_s16(vqsubq_s16(vqsubq_s16(yt, vmulq_s16(u, vdupq_n_s16(c->gu))),
+                                  vmulq_s16(v, vdupq_n_s16(c->gv))), 6);
+    *b = vqshrun_n_s16(vqaddq_s16(yt, vmulq_s16(u, vdupq_n_s16(c->bu))), 6);
+}
+
+static inline int16x8_t centered(uint8x8_t c) {
+    return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(c)), vdupq_n_s16(128));
+}
+
+static inline uint16x8_t pack565(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+    uint16x8_t p = vsriq_n_u16(vshll_n_u8(r, 8), vshll_n_u8(g, 8), 5);
+    return vsriq_n_u16(p, vshll_n_u8(b, 8), 11);
+}
+
+static int convertVector(const yuv2rgb_coefs_t *c, const uint8_t *y, const uint8_t *u,
+                         const uint8_t *v, int interleaved, int swap, uint8_t *dst, int format,
+                         int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        int16x8_t cu, cv;
+        if (interleaved) {
+            uint8x8x2_t uv = vld2_u8(u + x);
+            cu = centered(uv.val[swap]);
+            cv = centered(uv.val[1 - swap]);
+        } else {
+            cu = centered(vld1_u8(u + x / 2));
+            cv = centered(vld1_u8(v + x / 2));
+        }
+        int16x8x2_t du = vzipq_s16(cu, cu);
+        int16x8x2_t dv = vzipq_s16(cv, cv);
+        uint8x8_t r0, g0, b0, r1, g1, b1;
+        rgb8(c, vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8))), du.val[0], dv.val[0],
+             &r0, &g0, &b0);
+        rgb8(c, vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8))), du.val[1], dv.val[1],
+             &r1, &g1, &b1);
+        if (format == YUV2RGB_RGBA8888) {
+            uint8x16x4_t px;
+            px.val[0] = vcombine_u8(r0, r1);
+            px.val[1] = vcombine_u8(g0, g1);
+            px.val[2] = vcombine_u8(b0, b1);
+            px.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(dst + 4 * x, px);
+        } else {
+            vst1q_u16((uint16_t *) dst + x, pack565(r0, g0, b0));
+            vst1q_u16((uint16_t *) dst + x + 8, pack565(r1, g1, b1));
+        }
+    }
+    return x;
+}
+
+#elif defined(YUV2RGB_SSE2)
+
+// 8 pixels as int16, chroma already duplicated per pixel
+static inline void rgb8(const yuv2rgb_coefs_t *c, __m128i y, __m128i u, __m128i v, __m128i *r,
+                        __m128i *g, __m128i *b) {
+    __m128i yt = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(c->yOffset)),
+                                               _mm_set1_epi16(c->y)), _mm_set1_epi16(32));
+    *r = _mm_srai_epi16(_mm_adds_epi16(yt, _mm_mullo_epi16(v, _mm_set1_epi16(c->rv))), 6);
+    *g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(yt, _mm_mullo_epi16(u, _mm_set1_epi16(c->gu))),
+                                       _mm_mullo_epi16(v, _mm_set1_epi16(c->gv))), 6);
+    *b = _mm_srai_epi16(_mm_adds_epi16(yt, _mm_mullo_epi16(u, _mm_set1_epi16(c->bu))), 6);
+}
+
+static inline __m128i pack565(__m128i r, __m128i g, __m128i b) {
+    // clamped 0..255 words
+    __m128i p = _mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xf8)), 8);
+    p = _mm_or_si128(p, _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3));
+    return _mm_or_si128(p, _mm_srli_epi16(b, 3));
+}
+
+static int convertVector(const yuv2rgb_coefs_t *c, const uint8_t *y, const uint8_t *u,
+                         const uint8_t *v, int interleaved, int swap, uint8_t *dst, int format,
+                         int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i cu, cv;
+        if (interleaved) {
+            __m128i uv = _mm_loadu_si128((const __m128i *) (u + x));
+            __m128i even = _mm_and_si128(uv, _mm_set1_epi16(0xff));
+            __m128i odd = _mm_srli_epi16(uv, 8);
+            cu = _mm_sub_epi16(swap ? odd : even, bias);
+            cv = _mm_sub_epi16(swap ? even : odd, bias);
+        } else {
+            cu = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (u + x / 2)),
+                                                 zero), bias);
+            cv = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (v + x / 2)),
+                                                 zero), bias);
+        }
+        __m128i r0, g0, b0, r1, g1, b1;
+        rgb8(c, _mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi16(cu, cu),
+             _mm_unpacklo_epi16(cv, cv), &r0, &g0, &b0);
+        rgb8(c, _mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi16(cu, cu),
+             _mm_unpackhi_epi16(cv, cv), &r1, &g1, &b1);
+        __m128i r = _mm_packus_epi16(r0, r1);
+        __m128i g = _mm_packus_epi16(g0, g1);
+        __m128i b = _mm_packus_epi16(b0, b1);
+        if (format == YUV2RGB_RGBA8888) {
+            __m128i a = _mm_set1_epi8((char) 0xff);
+            __m128i rgLo = _mm_unpacklo_epi8(r, g);
+            __m128i rgHi = _mm_unpackhi_epi8(r, g);
+            __m128i baLo = _mm_unpacklo_epi8(b, a);
+            __m128i baHi = _mm_unpackhi_epi8(b, a);
+            __m128i *p = (__m128i *) (dst + 4 * x);
+            _mm_storeu_si128(p, _mm_unpacklo_epi16(rgLo, baLo));
+            _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(rgLo, baLo));
+            _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(rgHi, baHi));
+            _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(rgHi, baHi));
+        } else {
+            __m128i *p = (__m128i *) ((uint16_t *) dst + x);
+            _mm_storeu_si128(p, pack565(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero),
+                                        _mm_unpacklo_epi8(b, zero)));
+            _mm_storeu_si128(p + 1, pack565(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero),
+                                            _mm_unpackhi_epi8(b, zero)));
+        }
+    }
+    return x;
+}
+
+#else
+
+static int convertVector(const yuv2rgb_coefs_t *c, const uint8_t *y, const uint8_t *u,
+                         const uint8_t *v, int interleaved, int swap, uint8_t *dst, int format,
+                         int width) {
+    return 0;
+}
+
+#endif
+
+void yuv2rgb_rows(const yuv2rgb_src_t *src, uint8_t *dst, int dstStride, int dstFormat, int y0,
+                  int y1) {
+    const yuv2rgb_coefs_t *c = &g_coefs[src->bt709 ? 1 : 0][src->fullRange ? 1 : 0];
+    int interleaved = (src->layout != YUV2RGB_PLANAR);
+    int swap = (src->layout == YUV2RGB_NV21);
+    for (int row = y0; row < y1; row++, dst += dstStride) {
+        int chromaRow = row >> src->chromaShiftH;
+        const uint8_t *y = src->data[0] + row * src->linesize[0];
+        const uint8_t *u, *v;
+        if (interleaved) {
+            const uint8_t *uv = src->data[1] + chromaRow * src->linesize[1];
+            u = uv + swap;
+            v = uv + 1 - swap;
+        } else {
+            u = src->data[1] + chromaRow * src->linesize[1];
+            v = src->data[2] + chromaRow * src->linesize[2];
+        }
+        // the vector kernels load interleaved chroma from the pair start
+        int x = convertVector(c, y, interleaved ? u - swap : u, v, interleaved, swap, dst,
+                              dstFormat, src->width);
+        convertTail(c, y, u, v, interleaved ? 2 : 1, dst, dstFormat, x, src->width);
+    }
+}
+
+struct yuv2rgb_pool {
+    int threads;
+    int bands;
+    pthread_t tids[YUV2RGB_MAX_THREADS - 1];
+    dt_lock_t lock;
+    pthread_cond_t start;       // new job or quit
+    pthread_cond_t done;        // last band of a job finished
+    int quit;
+    int job;                    // generation, workers wait for it to move
+
+    // current job, written under lock before job moves
+    const yuv2rgb_src_t *src;
+    uint8_t *dst;
+    int dstStride;
+    int dstFormat;
+    int bandRows;
+    int nextBand;
+    int doneBands;
+};
+
+static void runBands(yuv2rgb_pool_t *pool) {
+    for (;;) {
+        int band = dt_atomic_add(&pool->nextBand, 1) - 1;
+        if (band >= pool->bands) {
+            return;
+        }
+        int y0 = band * pool->bandRows;
+        int y1 = y0 + pool->bandRows;
+        if (y1 > pool->src->height) {
+            y1 = pool->src->height;
+        }
+        if (y0 < y1) {
+            yuv2rgb_rows(pool->src, pool->dst + y0 * pool->dstStride, pool->dstStride,
+                         pool->dstFormat, y0, y1);
+        }
+        if (dt_atomic_add(&pool->doneBands, 1) == pool->bands) {
+            dt_lock(&pool->lock);
+            pthread_cond_signal(&pool->done);
+            dt_unlock(&pool->lock);
+        }
+    }
+}
+
+static void *workerMain(void *arg) {
+    yuv2rgb_pool_t *pool = (yuv2rgb_pool_t *) arg;
+    int seen = 0;
+    dt_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->job == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->job;
+        dt_unlock(&pool->lock);
+        runBands(pool);
+        dt_lock(&pool->lock);
+    }
+    dt_unlock(&pool->lock);
+    return NULL;
+}
+
+yuv2rgb_pool_t *yuv2rgb_pool_create(int threads) {
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cores > 0) ? (int) cores : 1;
+    }
+    if (threads > YUV2RGB_MAX_THREADS) {
+        threads = YUV2RGB_MAX_THREADS;
+    }
+    yuv2rgb_pool_t *pool = (yuv2rgb_pool_t *) malloc(sizeof(yuv2rgb_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(yuv2rgb_pool_t));
+    dt_lock_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->threads = 1;
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool->tids[i], NULL, workerMain, pool) != 0) {
+            // fewer helpers, still converts
+            LOGV("yuv2rgb worker %d failed \n", i);
+            break;
+        }
+        pool->threads++;
+    }
+    pool->bands = pool->threads * YUV2RGB_BANDS_PER_THREAD;
+    LOGV("yuv2rgb pool, threads:%d \n", pool->threads);
+    return pool;
+}
+
+void yuv2rgb_pool_destroy(yuv2rgb_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    dt_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    dt_unlock(&pool->lock);
+    for (int i = 0; i < pool->threads - 1; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool);
+}
+
+int yuv2rgb_pool_threads(yuv2rgb_pool_t *pool) {
+    return pool->threads;
+}
+
+void yuv2rgb_convert(yuv2rgb_pool_t *pool, const yuv2rgb_src_t *src, uint8_t *dst,
+                     int dstStride, int dstFormat) {
+    if (pool->threads == 1) {
+        yuv2rgb_rows(src, dst, dstStride, dstFormat, 0, src->height);
+        return;
+    }
+    dt_lock(&pool->lock);
+    pool->src = src;
+    pool->dst = dst;
+    pool->dstStride = dstStride;
+    pool->dstFormat = dstFormat;
+    // even rows, 4:2:0 chroma rows are not split between bands
+    pool->bandRows = ((src->height + pool->bands - 1) / pool->bands + 1) & ~1;
+    pool->doneBands = 0;
+    dt_atomic_store(&pool->nextBand, 0);
+    pool->job++;
+    pthread_cond_broadcast(&pool->start);
+    dt_unlock(&pool->lock);
+
+    // the caller takes bands too
+    runBands(pool);
+    dt_lock(&pool->lock);
+    while (dt_atomic_load(&pool->doneBands) < pool->bands) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    dt_unlock(&pool->lock);
+}
@@ -0,0 +1,64 @@
+//
+// yuv2rgb - YUV to RGBA8888/RGB565 conversion on the CPU.
+//
+// The GL-free video path: 8-bit 4:2:0/4:2:2 planar and NV12/NV21 straight
+// into a locked window buffer. Integer math in 6 fractional bits, the same
+// in the NEON, SSE2 and plain C kernels so all three produce identical
+// pixels. A frame is cut into row bands converted in parallel by a small
+// pool of worker threads.
+//
+
+#ifndef GLES2JNI_YUV2RGB_H
+#define GLES2JNI_YUV2RGB_H
+
+#include <stdint.h>
+
+enum {
+    YUV2RGB_PLANAR = 0,     // Y, U, V planes
+    YUV2RGB_NV12,           // Y, interleaved UV
+    YUV2RGB_NV21,           // Y, interleaved VU
+};
+
+enum {
+    YUV2RGB_RGBA8888 = 0,   // bytes R G B A
+    YUV2RGB_RGB565,         // native endian 16-bit words
+};
+
+typedef struct {
+    const uint8_t *data[3];
+    int linesize[3];
+    int width;
+    int height;
+    int layout;             // YUV2RGB_PLANAR/NV12/NV21
+    int chromaShiftH;       // 1 for 4:2:0, 0 for 4:2:2; chroma is always half width
+    int bt709;              // else BT.601
+    int fullRange;
+} yuv2rgb_src_t;
+
+/*
+ * rows [y0, y1) of src into dst, row y0 at dst
+ */
+void yuv2rgb_rows(const yuv2rgb_src_t *src, uint8_t *dst, int dstStride, int dstFormat, int y0,
+                  int y1);
+
+typedef struct yuv2rgb_pool yuv2rgb_pool_t;
+
+/*
+ * threads - converting threads including the caller, 1 runs everything on
+ * the caller; 0 picks from the online cores, at most YUV2RGB_MAX_THREADS
+ */
+#define YUV2RGB_MAX_THREADS 4
+
+yuv2rgb_pool_t *yuv2rgb_pool_create(int threads);
+
+void yuv2rgb_pool_destroy(yuv2rgb_pool_t *pool);
+
+int yuv2rgb_pool_threads(yuv2rgb_pool_t *pool);
+
+/*
+ * whole frame, returns when every band is done; one caller at a time
+ */
+void yuv2rgb_convert(yuv2rgb_pool_t *pool, const yuv2rgb_src_t *src, uint8_t *dst,
+                     int dstStride, int dstFormat);
+
+#endif //GLES2JNI_YUV2RGB_H
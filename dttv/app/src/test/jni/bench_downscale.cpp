@@ -0,0 +1,196 @@
+//
+// bench_downscale - frame upload with and without downscale-before-upload.
+//
+// Draws a 2160p I420 picture with yuv_renderFrame on an EGL pbuffer under
+// desktop Mesa (EGL_PLATFORM=surfaceless), into a 1080p and a 540p window
+// so the renderer picks 2x and 4x, once uploading the full frame and once
+// shrinking it with frame_downscale first. Times the upload as the render
+// stats see it, CPU side and with EXT_disjoint_timer_query GPU side, and
+// a new frame to glFinish against a redraw of the same textures. Then
+// downscale_plane alone for every texel kind.
+// The kernel is whatever the compiler targets: build with an ARM compiler
+// (arm64, or -mfpu=neon) to time the NEON one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include "gl_yuv.h"
+#include "render_stats.h"
+#include "android_dtplayer.h"
+#include "frame_downscale.h"
+
+#define WIDTH   3840
+#define HEIGHT  2160
+#define WARMUP  3       // texture allocation and program link
+#define RUNS    30
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNEL "neon"
+#elif defined(__SSE2__)
+#define KERNEL "sse2"
+#else
+#define KERNEL "c"
+#endif
+
+extern "C" int64_t dt_gettime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+extern "C" int dt_usleep(unsigned usec) {
+    return usleep(usec);
+}
+
+namespace android {
+    int DTPlayer::Notify(int msg) {
+        return 0;
+    }
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static EGLDisplay g_display;
+static EGLSurface g_surface;
+
+static int egl_setup(int width, int height) {
+    EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                              EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                              EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE};
+    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    EGLint pbufferAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+    EGLConfig config;
+    EGLint numConfigs = 0;
+
+    g_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (g_display == EGL_NO_DISPLAY || !eglInitialize(g_display, NULL, NULL) ||
+        !eglChooseConfig(g_display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        return -1;
+    }
+    g_surface = eglCreatePbufferSurface(g_display, config, pbufferAttribs);
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLContext context = eglCreateContext(g_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (g_surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(g_display, g_surface, g_surface, context)) {
+        return -1;
+    }
+    return 0;
+}
+
+// a copy of picture per frame, the renderer frees it on release
+static void push_frame(yuv_renderer_t *r, const uint8_t *picture) {
+    int size = WIDTH * HEIGHT * 3 / 2;
+    dt_av_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    uint8_t *data = (uint8_t *) malloc(size);
+    memcpy(data, picture, size);
+    frame.data[0] = data;
+    frame.data[1] = data + WIDTH * HEIGHT;
+    frame.data[2] = data + WIDTH * HEIGHT * 5 / 4;
+    frame.linesize[0] = WIDTH;
+    frame.linesize[1] = frame.linesize[2] = WIDTH / 2;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.pixfmt = DTAV_PIX_FMT_YUV420P;
+    frame.pts = -1;
+    yuv_update_frame(r, &frame);
+}
+
+static void upload(const uint8_t *picture, int window, int downscale, int timerQuery) {
+    int w = WIDTH / window, h = HEIGHT / window;
+    yuv_renderer_t *r = yuv_renderer_create();
+    yuv_set_downscale(r, downscale);
+    yuv_dttv_init(r);
+    yuv_setupGraphics(r, w, h);
+
+    // a draw without a new frame repeats the textures, the difference is
+    // the upload as far as it has to finish before the picture does
+    double frame = 0, redraw = 0;
+    for (int i = 0; i < WARMUP + RUNS; i++) {
+        if (i == WARMUP) {
+            stats_reset(yuv_get_stats(r));
+        }
+        push_frame(r, picture);
+        double start = now_us();
+        yuv_renderFrame(r);
+        glFinish();
+        double mid = now_us();
+        yuv_renderFrame(r);
+        glFinish();
+        if (i >= WARMUP) {
+            frame += mid - start;
+            redraw += now_us() - mid;
+        }
+        eglSwapBuffers(g_display, g_surface);
+    }
+    render_stats_t *s = yuv_get_stats(r);
+    printf("%4dx%-4d %-9s upload cpu %6d us", w, h, downscale ? "downscale" : "full",
+           stats_query(s, STATS_UPLOAD_CPU, STATS_MEAN));
+    if (timerQuery) {
+        printf("  gpu %6d us", stats_query(s, STATS_UPLOAD_GPU, STATS_MEAN));
+    }
+    printf("  frame %6.0f us  redraw %6.0f us\n", frame / RUNS, redraw / RUNS);
+    yuv_renderer_destroy(r);
+}
+
+static void kernels(const uint8_t *src) {
+    static const char *kinds[] = {"bytes", "pairs", "words"};
+    int size = WIDTH * HEIGHT;
+    uint8_t *dst = (uint8_t *) malloc(size);
+    uint8_t *scratch = (uint8_t *) malloc(downscale_scratch_size(WIDTH, DOWNSCALE_WORDS, 4) + 64);
+
+    printf("downscale_plane alone, %dx%d bytes per plane\n", WIDTH, HEIGHT);
+    for (int kind = DOWNSCALE_BYTES; kind <= DOWNSCALE_WORDS; kind++) {
+        // same bytes for every kind: pairs and words have half the texels
+        int width = (kind == DOWNSCALE_BYTES) ? WIDTH : WIDTH / 2;
+        for (int factor = 2; factor <= 4; factor += 2) {
+            int dstStride = downscale_size(width, factor) * ((kind == DOWNSCALE_BYTES) ? 1 : 2);
+            double start = now_us();
+            for (int i = 0; i < RUNS; i++) {
+                downscale_plane(src, WIDTH, width, HEIGHT, kind, factor, dst, dstStride, scratch);
+            }
+            double us = (now_us() - start) / RUNS;
+            printf("%-6s %dx   %7.0f us %6.0f MB/s\n", kinds[kind], factor, us, size / us);
+        }
+    }
+    free(dst);
+    free(scratch);
+}
+
+int main(void) {
+    if (egl_setup(WIDTH / 2, HEIGHT / 2) < 0) {
+        printf("no EGL pbuffer, run with EGL_PLATFORM=surfaceless under Mesa\n");
+        return 1;
+    }
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    int timerQuery = extensions && strstr(extensions, "GL_EXT_disjoint_timer_query") != NULL;
+
+    int size = WIDTH * HEIGHT * 3 / 2;
+    uint8_t *picture = (uint8_t *) malloc(size);
+    for (int i = 0; i < size; i++) {
+        picture[i] = (uint8_t) rand();
+    }
+
+    printf("kernel %s, %dx%d I420 frame, %s\n", KERNEL, WIDTH, HEIGHT,
+           (const char *) glGetString(GL_RENDERER));
+    for (int window = 2; window <= 4; window += 2) {
+        upload(picture, window, 0, timerQuery);
+        upload(picture, window, 1, timerQuery);
+    }
+    kernels(picture);
+
+    free(picture);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * bench_resample.c
+ *
+ * resample.c throughput per quality preset: stereo S16 noise through the
+ * usual conversions to and from the 48 kHz device rate, in 10 ms blocks
+ * like the audio output feeds it. MB/s is of input consumed. The dot
+ * product is whatever the compiler targets: build with an ARM compiler
+ * (arm64, or -mfpu=neon) to time the NEON one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "resample.h"
+
+#define CHANNELS    2
+#define SECONDS     20      /* of audio per conversion */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNEL "neon"
+#elif defined(__SSE2__)
+#define KERNEL "sse2"
+#else
+#define KERNEL "c"
+#endif
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    static const char *names[] = {"fast", "medium", "high", "best"};
+    static const int rates[][2] = {{44100, 48000}, {48000, 44100}, {22050, 48000}, {96000, 48000}};
+    int failed = 0;
+
+    printf("kernel %s, %d channels, %d s per conversion\n", KERNEL, CHANNELS, SECONDS);
+    for (unsigned k = 0; k < sizeof(rates) / sizeof(rates[0]); k++) {
+        int in_rate = rates[k][0], out_rate = rates[k][1];
+        int block = in_rate / 100;
+        int16_t *in = malloc(block * CHANNELS * sizeof(int16_t));
+        for (int i = 0; i < block * CHANNELS; i++)
+            in[i] = (int16_t) (rand() - RAND_MAX / 2);
+
+        printf("%5d -> %5d", in_rate, out_rate);
+        for (int q = RESAMPLE_FAST; q <= RESAMPLE_BEST; q++) {
+            resampler_t *r = resampler_create(CHANNELS, in_rate, out_rate, q);
+            int16_t *out = r ? malloc(resampler_max_out(r, block) * CHANNELS * sizeof(int16_t)) : NULL;
+            if (!out) {
+                printf("  %s failed", names[q]);
+                resampler_destroy(r);
+                failed = 1;
+                continue;
+            }
+            double start = now_s();
+            for (int i = 0; i < SECONDS * 100; i++)
+                resampler_process(r, in, block, out);
+            double mbs = (double) SECONDS * 100 * block * CHANNELS * sizeof(int16_t) /
+                         (now_s() - start) / 1e6;
+            printf("  %s %7.1f MB/s", names[q], mbs);
+            free(out);
+            resampler_destroy(r);
+        }
+        printf("\n");
+        free(in);
+    }
+    return failed;
+}
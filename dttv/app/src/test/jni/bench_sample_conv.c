@@ -0,0 +1,85 @@
+/*
+ * bench_sample_conv.c
+ *
+ * sample_conv.c throughput for the conversions decoders hand the audio
+ * output: stereo in 1024 frame blocks to interleaved s16, with and without
+ * dither. MB/s is of input consumed. The s16/s32/float legs are whatever
+ * the compiler targets: build with an ARM compiler (arm64, or -mfpu=neon)
+ * to time the NEON ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sample_conv.h"
+
+#define CHANNELS    2
+#define FRAMES      1024
+#define BLOCKS      20000
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNEL "neon"
+#elif defined(__SSE2__)
+#define KERNEL "sse2"
+#else
+#define KERNEL "c"
+#endif
+
+typedef struct {
+    const char *name;
+    int src_fmt;
+    int src_planar;
+    int dst_fmt;
+    int dither;
+} conv_t;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    static const conv_t convs[] = {
+        {"s16 planar -> s16",     SAMPLE_S16, 1, SAMPLE_S16, 0},
+        {"s24 -> s16",            SAMPLE_S24, 0, SAMPLE_S16, 0},
+        {"s24 -> s16 dither",     SAMPLE_S24, 0, SAMPLE_S16, 1},
+        {"s32 -> s16",            SAMPLE_S32, 0, SAMPLE_S16, 0},
+        {"s32 -> s16 dither",     SAMPLE_S32, 0, SAMPLE_S16, 1},
+        {"flt -> s16",            SAMPLE_FLT, 0, SAMPLE_S16, 0},
+        {"flt planar -> s16",     SAMPLE_FLT, 1, SAMPLE_S16, 0},
+        {"flt planar -> s16 dither", SAMPLE_FLT, 1, SAMPLE_S16, 1},
+        {"s16 -> flt",            SAMPLE_S16, 0, SAMPLE_FLT, 0},
+    };
+    /* any bytes are valid integers; floats stay in range */
+    float *in = malloc(FRAMES * CHANNELS * sizeof(float));
+    int16_t *out = malloc(FRAMES * CHANNELS * sizeof(float));
+    for (int i = 0; i < FRAMES * CHANNELS; i++)
+        in[i] = (float) rand() / RAND_MAX * 1.8f - 0.9f;
+    int failed = 0;
+
+    printf("kernel %s, %d channels, %d frame blocks\n", KERNEL, CHANNELS, FRAMES);
+    for (unsigned k = 0; k < sizeof(convs) / sizeof(convs[0]); k++) {
+        const conv_t *t = &convs[k];
+        sample_conv_t c;
+        if (sample_conv_init(&c, t->src_fmt, t->src_planar, t->dst_fmt, CHANNELS, t->dither) < 0) {
+            printf("%-26s not supported\n", t->name);
+            failed = 1;
+            continue;
+        }
+        int bytes = sample_bytes(t->src_fmt);
+        const void *src[CHANNELS];
+        for (int ch = 0; ch < CHANNELS; ch++)
+            src[ch] = (const uint8_t *) in + (t->src_planar ? ch * FRAMES * bytes : 0);
+        double start = now_s();
+        for (int i = 0; i < BLOCKS; i++)
+            sample_conv_run(&c, out, src, FRAMES);
+        double mbs = (double) BLOCKS * FRAMES * CHANNELS * bytes / (now_s() - start) / 1e6;
+        printf("%-26s %7.1f MB/s\n", t->name, mbs);
+    }
+
+    free(in);
+    free(out);
+    return failed;
+}
@@ -0,0 +1,89 @@
+//
+// bench_yuv2rgb - CPU conversion of the window outputs into a memory buffer.
+//
+// Converts a 1080p frame of every source layout into RGBA8888 and RGB565
+// with 1, 2 and 4 pool threads, the way window_output fills a locked
+// ANativeWindow buffer, here plain memory. The kernel is whatever the
+// compiler targets: build with an ARM compiler (arm64, or -mfpu=neon) to
+// time the NEON one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yuv2rgb.h"
+
+#define WIDTH   1920
+#define HEIGHT  1080
+#define RUNS    30
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNEL "neon"
+#elif defined(__SSE2__)
+#define KERNEL "sse2"
+#else
+#define KERNEL "c"
+#endif
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(void) {
+    static const char *layouts[] = {"i420", "nv12", "nv21"};
+    static const char *formats[] = {"rgba8888", "rgb565"};
+    int cw = WIDTH / 2, ch = HEIGHT / 2;
+    uint8_t *y = (uint8_t *) malloc(WIDTH * HEIGHT);
+    uint8_t *uv = (uint8_t *) malloc(cw * ch * 2);
+    uint8_t *dst = (uint8_t *) malloc(WIDTH * HEIGHT * 4);
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        y[i] = (uint8_t) rand();
+    }
+    for (int i = 0; i < cw * ch * 2; i++) {
+        uv[i] = (uint8_t) rand();
+    }
+
+    printf("kernel %s, %dx%d\n", KERNEL, WIDTH, HEIGHT);
+    for (int layout = YUV2RGB_PLANAR; layout <= YUV2RGB_NV21; layout++) {
+        yuv2rgb_src_t src;
+        memset(&src, 0, sizeof(src));
+        src.data[0] = y;
+        src.data[1] = uv;
+        src.data[2] = uv + cw * ch;
+        src.linesize[0] = WIDTH;
+        src.linesize[1] = (layout == YUV2RGB_PLANAR) ? cw : WIDTH;
+        src.linesize[2] = cw;
+        src.width = WIDTH;
+        src.height = HEIGHT;
+        src.layout = layout;
+        src.chromaShiftH = 1;
+        src.bt709 = 1;
+        for (int format = YUV2RGB_RGBA8888; format <= YUV2RGB_RGB565; format++) {
+            int stride = WIDTH * ((format == YUV2RGB_RGBA8888) ? 4 : 2);
+            printf("%s -> %-8s", layouts[layout], formats[format]);
+            for (int threads = 1; threads <= 4; threads *= 2) {
+                yuv2rgb_pool_t *pool = yuv2rgb_pool_create(threads);
+                // first run wakes the workers and faults the buffer in
+                yuv2rgb_convert(pool, &src, dst, stride, format);
+                double start = now_us();
+                for (int i = 0; i < RUNS; i++) {
+                    yuv2rgb_convert(pool, &src, dst, stride, format);
+                }
+                double us = (now_us() - start) / RUNS;
+                printf("  %d threads %6.0f us %5.0f fps", yuv2rgb_pool_threads(pool), us,
+                       1e6 / us);
+                yuv2rgb_pool_destroy(pool);
+            }
+            printf("\n");
+        }
+    }
+
+    free(y);
+    free(uv);
+    free(dst);
+    return 0;
+}
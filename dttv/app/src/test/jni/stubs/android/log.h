@@ -0,0 +1,28 @@
+/*
+ * host stand-in for the NDK log, messages go to stderr
+ */
+
+#ifndef TEST_ANDROID_LOG_H
+#define TEST_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+enum {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+};
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", tag);
+    int n = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * host stand-in for the NDK native window; the host tests render offscreen,
+ * they only have to link
+ */
+
+#ifndef TEST_ANDROID_NATIVE_WINDOW_H
+#define TEST_ANDROID_NATIVE_WINDOW_H
+
+#include <stdint.h>
+
+typedef struct ANativeWindow ANativeWindow;
+
+typedef struct {
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t format;
+    void *bits;
+    uint32_t reserved[6];
+} ANativeWindow_Buffer;
+
+typedef struct {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+} ARect;
+
+enum {
+    WINDOW_FORMAT_RGBA_8888 = 1,
+    WINDOW_FORMAT_RGBX_8888 = 2,
+    WINDOW_FORMAT_RGB_565 = 4,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ANativeWindow_acquire(ANativeWindow *window);
+
+void ANativeWindow_release(ANativeWindow *window);
+
+int32_t ANativeWindow_getWidth(ANativeWindow *window);
+
+int32_t ANativeWindow_getHeight(ANativeWindow *window);
+
+int32_t ANativeWindow_setBuffersGeometry(ANativeWindow *window, int32_t width, int32_t height,
+                                         int32_t format);
+
+int32_t ANativeWindow_lock(ANativeWindow *window, ANativeWindow_Buffer *buffer, ARect *dirty);
+
+int32_t ANativeWindow_unlockAndPost(ANativeWindow *window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * host stand-in for the NDK jni.h, only the types the player headers name;
+ * nothing in the host tests calls into a JVM
+ */
+
+#ifndef TEST_JNI_H
+#define TEST_JNI_H
+
+#include <stdint.h>
+
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef void *jobject;
+typedef jobject jclass;
+
+struct JNIEnv;
+struct JavaVM;
+
+#endif
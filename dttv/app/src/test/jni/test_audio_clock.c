@@ -0,0 +1,155 @@
+/*
+ * test_audio_clock.c
+ *
+ * audio_clock against a simulated device: the device consumes at exactly
+ * RATE, buffer queue callbacks run up to 3 ms late, GetPosition lags the
+ * queue by HW_LATENCY and moves in mixer bursts of whole milliseconds.
+ * Readers sample the clock between callbacks and are compared with the
+ * pcm position that is really at the speaker. Includes underruns (short
+ * periods padded with silence) and a pause.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio_clock.h"
+
+#define RATE        48000
+#define PERIOD      480     /* 10 ms */
+#define BUFFERS     4
+#define HW_LATENCY  1200    /* frames between the queue and the speaker */
+#define PERIODS     1000
+#define PAUSE_AT    3.0015  /* s, device time */
+#define PAUSE_LEN   0.5
+
+typedef struct {
+    double mean_us;     /* |clock - speaker|, after the first 20 periods */
+    double max_us;
+    double period_mean_us;  /* same for counting whole queued periods */
+    int backwards;      /* reads that went back in time */
+} result_t;
+
+static double data_at[PERIODS + BUFFERS];   /* pcm frames queued before each period */
+static int data_in[PERIODS + BUFFERS];      /* pcm frames in it, rest silence */
+
+/* pcm position at the speaker at device time t, s */
+static double speaker(double t, int periods) {
+    double frames = t * RATE - HW_LATENCY;
+    if (frames < 0)
+        return 0;
+    int k = (int) (frames / PERIOD);
+    if (k >= periods)
+        return data_at[periods - 1] + data_in[periods - 1];
+    double in = frames - k * PERIOD;
+    return data_at[k] + (in < data_in[k] ? in : data_in[k]);
+}
+
+/* device time -> wall time, the pause stops the device */
+static double wall(double t) {
+    return t + (t > PAUSE_AT ? PAUSE_LEN : 0);
+}
+
+static void simulate(int burst, int positioned, result_t *r) {
+    audio_clock_t c;
+    audio_clock_init(&c, RATE, PERIOD);
+    srand(1);
+
+    int periods = 0;
+    double queued = 0;
+    for (int i = 0; i < BUFFERS; i++) {
+        /* primed with silence */
+        data_in[periods] = 0;
+        data_at[periods++] = queued;
+        audio_clock_queued(&c, 0);
+    }
+
+    double err = 0, period_err = 0;
+    int n = 0, paused = 0;
+    int64_t last = -1;
+    r->max_us = 0;
+    r->backwards = 0;
+    for (int k = 0; k < PERIODS; k++) {
+        double done = (k + 1) * (double) PERIOD / RATE;
+        double cb = done + (rand() % 3000) / 1e6;
+        if (cb > PAUSE_AT && !paused) {
+            paused = 1;
+            audio_clock_pause(&c, (int64_t) (PAUSE_AT * 1e6));
+            audio_clock_resume(&c, (int64_t) ((PAUSE_AT + PAUSE_LEN) * 1e6));
+        }
+        int64_t pos = -1;
+        if (positioned) {
+            double frames = cb * RATE - HW_LATENCY;
+            /* mixer steps, reported in ms */
+            pos = (frames < 0) ? 0 : ((int64_t) frames / burst) * burst / 48 * 48;
+        }
+        audio_clock_played(&c, pos, (int64_t) (wall(cb) * 1e6));
+
+        int data = (k % 97 == 50) ? 100 : PERIOD;
+        data_in[periods] = data;
+        data_at[periods++] = queued;
+        queued += data;
+        audio_clock_queued(&c, data);
+
+        for (int s = 1; s <= 4; s++) {
+            double t = cb + s * 2.2e-3;
+            if (t > PAUSE_AT && !paused) {
+                paused = 1;
+                audio_clock_pause(&c, (int64_t) (PAUSE_AT * 1e6));
+                audio_clock_resume(&c, (int64_t) ((PAUSE_AT + PAUSE_LEN) * 1e6));
+            }
+            int64_t pts = audio_clock_pts(&c, (int64_t) (wall(t) * 1e6));
+            if (pts < last)
+                r->backwards++;
+            last = pts;
+
+            double truth = speaker(t, periods) * 1e6 / RATE;
+            /* the estimate this replaces: queued pcm minus the periods still queued */
+            int in_queue = 0;
+            for (int j = 0; j < periods; j++)
+                if ((j + 1) * PERIOD > t * RATE)
+                    in_queue++;
+            double counted = (queued - (double) in_queue * PERIOD) * 1e6 / RATE;
+            if (k > 20) {
+                double e = fabs(pts - truth);
+                err += e;
+                period_err += fabs(counted - truth);
+                if (e > r->max_us)
+                    r->max_us = e;
+                n++;
+            }
+        }
+    }
+    r->mean_us = err / n;
+    r->period_mean_us = period_err / n;
+}
+
+int main(void) {
+    static const struct {
+        int burst;
+        int positioned;
+        double max_mean_us;
+    } cases[] = {
+        {96, 1, 1000},
+        {192, 1, 1000},
+        {240, 1, 1000},
+        {256, 1, 1000},
+        {512, 1, 1000},
+        /* steps in phase with the callbacks, the offset inside a step is unknown */
+        {480, 1, 480 * 1e6 / RATE},
+        /* no GetPosition: periods only, the hardware latency is not seen */
+        {256, 0, (HW_LATENCY + PERIOD) * 1e6 / RATE},
+    };
+    int failed = 0;
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        result_t r;
+        simulate(cases[i].burst, cases[i].positioned, &r);
+        int ok = r.backwards == 0 && r.mean_us <= cases[i].max_mean_us;
+        printf("%s burst %4d%s: error mean %5.0f us max %5.0f us, period count mean %5.0f us, "
+               "backwards %d\n", ok ? "ok  " : "FAIL", cases[i].burst,
+               cases[i].positioned ? "" : " no position", r.mean_us, r.max_us,
+               r.period_mean_us, r.backwards);
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+//
+// test_frame_mailbox - the decoder/GL hand-off under two real threads.
+//
+// A producer pushes numbered frames as fast as it can while the consumer
+// picks them up with every acquire flavour, now and then too slowly, so
+// frames get overwritten and skipped as late. Checks that the consumer
+// only ever sees pts go forward, that pushed frames add up to consumed,
+// overwritten, late and flushed ones, and that every frame is released
+// exactly once.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "frame_mailbox.h"
+#include "native_atomic.h"
+
+#define FRAMES      200000
+
+static frame_mailbox_t g_mb;
+static uint8_t g_tokens[FRAMES];    // data[0] of frame n points at g_tokens[n]
+static int g_releases[FRAMES];
+static int g_bogus;                 // releases of something never pushed
+static int g_done;
+
+static void release(dt_av_frame_t *frame) {
+    long n = frame->data[0] - g_tokens;
+    if (!frame->data[0] || n < 0 || n >= FRAMES || frame->pts != n) {
+        dt_atomic_inc(&g_bogus);
+        return;
+    }
+    dt_atomic_inc(&g_releases[n]);
+}
+
+static void *producer(void *arg) {
+    for (int n = 0; n < FRAMES; n++) {
+        dt_av_frame_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.data[0] = &g_tokens[n];
+        frame.pts = n;
+        mailbox_push_timed(&g_mb, &frame, n);
+        if (n % 4 == 0) {
+            sched_yield();
+        }
+    }
+    dt_atomic_store(&g_done, 1);
+    return NULL;
+}
+
+typedef struct {
+    int consumed;
+    int backwards;
+    int badTime;
+    int64_t last;
+} consumer_t;
+
+static void seen(consumer_t *c, int64_t pts) {
+    if (pts <= c->last) {
+        c->backwards++;
+    }
+    c->last = pts;
+    c->consumed++;
+}
+
+static void consume(consumer_t *c, int round) {
+    dt_av_frame_t *frame;
+    dt_av_frame_t taken;
+    int64_t time;
+    switch (round % 3) {
+        case 0:
+            if ((frame = mailbox_acquire(&g_mb)) != NULL) {
+                seen(c, frame->pts);
+                mailbox_release(&g_mb, frame);
+            }
+            break;
+        case 1:
+            if ((frame = mailbox_acquire_latest(&g_mb)) != NULL) {
+                seen(c, frame->pts);
+                mailbox_release(&g_mb, frame);
+            }
+            break;
+        case 2:
+            // the taken frame is the caller's to release
+            if (mailbox_take(&g_mb, &taken, &time) == 0) {
+                c->badTime += (time != taken.pts);
+                seen(c, taken.pts);
+                release(&taken);
+            }
+            break;
+    }
+}
+
+static int check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    return ok ? 0 : 1;
+}
+
+int main(void) {
+    mailbox_init(&g_mb, release);
+    consumer_t c;
+    memset(&c, 0, sizeof(c));
+    c.last = -1;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, NULL);
+    for (int round = 0; !dt_atomic_load(&g_done); round++) {
+        consume(&c, round);
+        // a slow draw now and then, the producer runs ahead
+        if (round % 1000 == 999) {
+            usleep(100);
+        }
+    }
+    pthread_join(thread, NULL);
+    for (int round = 0; mailbox_pending(&g_mb) > 1; round++) {
+        consume(&c, round);
+    }
+    int flushed = mailbox_pending(&g_mb);
+    mailbox_flush(&g_mb);
+
+    mailbox_stat_t stat;
+    mailbox_get_stat(&g_mb, &stat);
+    int once = 0, leaked = 0, twice = 0;
+    for (int n = 0; n < FRAMES; n++) {
+        once += (g_releases[n] == 1);
+        leaked += (g_releases[n] == 0);
+        twice += (g_releases[n] > 1);
+    }
+    printf("pushed %d consumed %d overwritten %d late %d flushed %d backwards %d\n",
+           stat.pushed, c.consumed, stat.overwritten, stat.late, flushed, c.backwards);
+
+    int failed = 0;
+    failed += check(stat.pushed == FRAMES, "every push counted");
+    failed += check(c.backwards == 0, "pts only go forward");
+    failed += check(c.badTime == 0, "take hands back the push time");
+    failed += check(c.consumed + stat.overwritten + stat.late + flushed == stat.pushed,
+                    "consumed, overwritten, late and flushed add up to pushed");
+    failed += check(stat.overwritten > 0 && stat.late > 0, "overwrite and late paths ran");
+    failed += check(once == FRAMES && leaked == 0 && twice == 0 && g_bogus == 0,
+                    "every frame released exactly once");
+    failed += check(mailbox_pending(&g_mb) == 0, "flush empties");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+//
+// test_render_stats - render loop telemetry on an EGL pbuffer.
+//
+// Draws frames with yuv_renderFrame under desktop Mesa
+// (EGL_PLATFORM=surfaceless) at a 60Hz pace, with one late draw, while a
+// second thread keeps querying the histograms the way native_getInfo does.
+// Checks that every draw lands in the CPU histograms and the intervals,
+// that EXT_disjoint_timer_query fills the GPU ones when the driver offers
+// it, that the late draw counts as jank, and reset and bad queries.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <EGL/egl.h>
+
+#include "gl_yuv.h"
+#include "render_stats.h"
+#include "android_dtplayer.h"
+#include "native_atomic.h"
+
+#define WIDTH       640
+#define HEIGHT      360
+#define FRAMES      120
+#define PACE_US     16000
+#define LATE        60              // this draw comes 70ms after the last
+#define LATE_US     70000
+
+extern "C" int64_t dt_gettime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+extern "C" int dt_usleep(unsigned usec) {
+    return usleep(usec);
+}
+
+namespace android {
+    int DTPlayer::Notify(int msg) {
+        return 0;
+    }
+}
+
+static EGLDisplay g_display;
+static EGLSurface g_surface;
+
+static int egl_setup(int width, int height) {
+    EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                              EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                              EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE};
+    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    EGLint pbufferAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+    EGLConfig config;
+    EGLint numConfigs = 0;
+
+    g_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (g_display == EGL_NO_DISPLAY || !eglInitialize(g_display, NULL, NULL) ||
+        !eglChooseConfig(g_display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        return -1;
+    }
+    g_surface = eglCreatePbufferSurface(g_display, config, pbufferAttribs);
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLContext context = eglCreateContext(g_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (g_surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(g_display, g_surface, g_surface, context)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void push_frame(yuv_renderer_t *r, int luma) {
+    dt_av_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    uint8_t *data = (uint8_t *) malloc(WIDTH * HEIGHT * 3 / 2);
+    memset(data, luma, WIDTH * HEIGHT);
+    memset(data + WIDTH * HEIGHT, 128, WIDTH * HEIGHT / 2);
+    frame.data[0] = data;
+    frame.data[1] = data + WIDTH * HEIGHT;
+    frame.data[2] = data + WIDTH * HEIGHT * 5 / 4;
+    frame.linesize[0] = WIDTH;
+    frame.linesize[1] = frame.linesize[2] = WIDTH / 2;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.pixfmt = DTAV_PIX_FMT_YUV420P;
+    frame.pts = -1;
+    yuv_update_frame(r, &frame);
+}
+
+static yuv_renderer_t *g_renderer;
+static int g_stop;
+static long g_reads;
+
+// native_getInfo, from another thread while the loop draws
+static void *reader(void *arg) {
+    render_stats_t *s = yuv_get_stats(g_renderer);
+    while (!dt_atomic_load(&g_stop)) {
+        for (int h = 0; h < STATS_HIST_NB; h++) {
+            for (int what = STATS_MAX; what < STATS_BUCKETS; what++) {
+                stats_query(s, h, what);
+            }
+        }
+        g_reads++;
+    }
+    return NULL;
+}
+
+static int check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    return ok ? 0 : 1;
+}
+
+int main(void) {
+    if (egl_setup(WIDTH / 2, HEIGHT / 2) < 0) {
+        printf("FAIL no EGL pbuffer, run with EGL_PLATFORM=surfaceless under Mesa\n");
+        return 1;
+    }
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    int timerQuery = extensions && strstr(extensions, "GL_EXT_disjoint_timer_query") != NULL;
+
+    g_renderer = yuv_renderer_create();
+    yuv_dttv_init(g_renderer);
+    yuv_setupGraphics(g_renderer, WIDTH / 2, HEIGHT / 2);
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader, NULL);
+    for (int i = 0; i < FRAMES; i++) {
+        push_frame(g_renderer, 16 + i);
+        yuv_renderFrame(g_renderer);
+        eglSwapBuffers(g_display, g_surface);
+        usleep(i == LATE - 1 ? LATE_US : PACE_US);
+    }
+    dt_atomic_store(&g_stop, 1);
+    pthread_join(thread, NULL);
+
+    static const char *names[STATS_HIST_NB] = {"upload cpu", "draw cpu", "upload gpu", "draw gpu",
+                                               "interval"};
+    render_stats_t *s = yuv_get_stats(g_renderer);
+    for (int h = 0; h < STATS_HIST_NB; h++) {
+        printf("%-10s n %4d mean %6d max %6d |", names[h], stats_query(s, h, STATS_COUNT),
+               stats_query(s, h, STATS_MEAN), stats_query(s, h, STATS_MAX));
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            printf(" %d", stats_query(s, h, b));
+        }
+        printf("\n");
+    }
+    printf("timer query %d, gpu timer %d, jank %d, %ld concurrent reads\n", timerQuery,
+           s->gpuTimer, s->jank, g_reads);
+
+    int failed = 0;
+    failed += check(stats_query(s, STATS_UPLOAD_CPU, STATS_COUNT) == FRAMES &&
+                    stats_query(s, STATS_DRAW_CPU, STATS_COUNT) == FRAMES,
+                    "every draw timed on the CPU");
+    int sum = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        sum += stats_query(s, STATS_INTERVAL, b);
+    }
+    failed += check(stats_query(s, STATS_INTERVAL, STATS_COUNT) == FRAMES - 1 &&
+                    sum == FRAMES - 1, "intervals between draws, buckets add up");
+    failed += check(stats_query(s, STATS_INTERVAL, STATS_MAX) >= LATE_US, "late draw is the max");
+    // a busy host adds a few of its own
+    failed += check(s->jank >= 1 && s->jank <= FRAMES / 10, "late draw counts as jank");
+    if (timerQuery) {
+        // a few frames may go untimed while their slot is still busy
+        failed += check(s->gpuTimer &&
+                        stats_query(s, STATS_UPLOAD_GPU, STATS_COUNT) >= FRAMES * 8 / 10 &&
+                        stats_query(s, STATS_DRAW_GPU, STATS_COUNT) >= FRAMES * 8 / 10,
+                        "GPU timer fills the GPU histograms");
+    } else {
+        printf("skip GPU histograms, no EXT_disjoint_timer_query\n");
+    }
+    stats_reset(s);
+    failed += check(stats_query(s, STATS_DRAW_CPU, STATS_COUNT) == 0 && s->jank == 0,
+                    "reset clears");
+    failed += check(stats_query(s, STATS_HIST_NB, 0) == -1 &&
+                    stats_query(s, 0, STATS_BUCKETS) == -1 &&
+                    stats_query(s, 0, STATS_MAX - 1) == -1, "bad queries");
+
+    yuv_renderer_destroy(g_renderer);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+//
+// test_render_thread - the native render loop on an EGL pbuffer.
+//
+// Runs render_thread with pace_us as its fake refresh under desktop Mesa
+// (EGL_PLATFORM=surfaceless, llvmpipe will do). A producer feeds bursts of
+// 30fps frames the way the vo plugin does. Checks that the loop draws once
+// per paced tick while frames come in, parks between bursts and gets woken
+// by the next frame, stays parked without frames, and that what it drew is
+// the picture that was fed, read back through a snapshot.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "gl_render_thread.h"
+#include "gl_yuv.h"
+#include "android_dtplayer.h"
+#include "native_atomic.h"
+
+#define WIDTH       320
+#define HEIGHT      180
+#define PACE_US     16667
+#define FPS         30
+#define BURST       45              // frames, 1.5s
+#define BURSTS      3
+#define PARK_US     800000          // gap between bursts, the loop parks
+#define LUMA        100             // limited range, shows as 1.1644 * (100 - 16)
+#define GRAY        98
+
+extern "C" int64_t dt_gettime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+extern "C" int dt_usleep(unsigned usec) {
+    return usleep(usec);
+}
+
+// frames only reach java when no wakeup is installed, render_thread has one
+namespace android {
+    int DTPlayer::Notify(int msg) {
+        return 0;
+    }
+}
+
+extern "C" void ANativeWindow_acquire(ANativeWindow *window) {
+}
+
+extern "C" void ANativeWindow_release(ANativeWindow *window) {
+}
+
+extern "C" int32_t ANativeWindow_setBuffersGeometry(ANativeWindow *window, int32_t width,
+                                                    int32_t height, int32_t format) {
+    return 0;
+}
+
+static int g_snapshots;
+static int g_gray;
+
+// GL thread
+static void snapshot_done(void *opaque, const uint8_t *rgba, int width, int height,
+                          int64_t pts) {
+    g_gray = rgba ? rgba[(height / 2 * width + width / 2) * 4] : -1;
+    dt_atomic_inc(&g_snapshots);
+}
+
+// I420 in one block, the vo plugin hands them over the same way
+static void make_frame(dt_av_frame_t *frame, int64_t pts) {
+    memset(frame, 0, sizeof(dt_av_frame_t));
+    uint8_t *data = (uint8_t *) malloc(WIDTH * HEIGHT * 3 / 2);
+    memset(data, LUMA, WIDTH * HEIGHT);
+    memset(data + WIDTH * HEIGHT, 128, WIDTH * HEIGHT / 2);
+    frame->data[0] = data;
+    frame->data[1] = data + WIDTH * HEIGHT;
+    frame->data[2] = data + WIDTH * HEIGHT * 5 / 4;
+    frame->linesize[0] = WIDTH;
+    frame->linesize[1] = frame->linesize[2] = WIDTH / 2;
+    frame->width = WIDTH;
+    frame->height = HEIGHT;
+    frame->pixfmt = DTAV_PIX_FMT_YUV420P;
+    frame->pts = pts;
+}
+
+static int snapshot(yuv_renderer_t *r) {
+    int before = dt_atomic_load(&g_snapshots);
+    if (yuv_request_snapshot(r, 0, 0, snapshot_done, NULL) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < 100 && dt_atomic_load(&g_snapshots) == before; i++) {
+        usleep(10000);
+    }
+    return dt_atomic_load(&g_snapshots) == before ? -1 : g_gray;
+}
+
+int main(void) {
+    yuv_renderer_t *r = yuv_renderer_create();
+    render_thread_para_t para;
+    memset(&para, 0, sizeof(para));
+    para.renderer = r;
+    para.width = WIDTH;
+    para.height = HEIGHT;
+    para.pace_us = PACE_US;
+    render_thread_t *rt = render_thread_create(&para);
+    if (!rt) {
+        printf("FAIL no EGL pbuffer, run with EGL_PLATFORM=surfaceless under Mesa\n");
+        yuv_renderer_destroy(r);
+        return 1;
+    }
+
+    int failed = 0;
+    int64_t origin = dt_gettime();
+    render_thread_stat_t before, after;
+    for (int burst = 0; burst < BURSTS; burst++) {
+        render_thread_get_stat(rt, &before);
+        int64_t start = dt_gettime();
+        for (int i = 0; i < BURST; i++) {
+            dt_av_frame_t frame;
+            make_frame(&frame, (dt_gettime() - origin) * DT_PTS_FREQ_MS / 1000);
+            yuv_update_frame(r, &frame);
+            usleep(1000000 / FPS);
+        }
+        render_thread_get_stat(rt, &after);
+        int64_t elapsed = dt_gettime() - start;
+
+        // one draw per tick while frames come in, not one per frame and
+        // not a free run
+        int loops = after.loops - before.loops;
+        int ticks = (int) (elapsed / PACE_US);
+        int paced = loops >= ticks * 7 / 10 && loops <= ticks * 11 / 10;
+        // the loop starts out running, later bursts find it parked
+        int woken = burst == 0 || after.wakeups > before.wakeups;
+        int gray = snapshot(r);
+        int drawn = gray >= GRAY - 2 && gray <= GRAY + 2;
+        int ok = paced && woken && drawn;
+        printf("%s burst %d: loops %d for %d ticks, wakeups %d, gray %d expect %d\n",
+               ok ? "ok  " : "FAIL", burst, loops, ticks, after.wakeups - before.wakeups,
+               gray, GRAY);
+        failed += !ok;
+        usleep(PARK_US);
+    }
+
+    // parked: no draws without frames
+    render_thread_get_stat(rt, &before);
+    usleep(PARK_US / 2);
+    render_thread_get_stat(rt, &after);
+    int parked = after.loops == before.loops;
+    printf("%s parked: %d loops in %d ms without frames\n", parked ? "ok  " : "FAIL",
+           after.loops - before.loops, PARK_US / 2000);
+    failed += !parked;
+
+    printf("loops %d wakeups %d draw avg %lld us swap avg %lld us wake latency avg %lld us\n",
+           after.loops, after.wakeups, (long long) (after.draw_us / after.loops),
+           (long long) (after.swap_us / after.loops),
+           (long long) (after.wakeups ? after.wake_us / after.wakeups : 0));
+
+    render_thread_destroy(rt);
+    yuv_renderer_destroy(r);
+    return failed ? 1 : 0;
+}
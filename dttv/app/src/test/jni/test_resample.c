@@ -0,0 +1,169 @@
+/*
+ * test_resample.c
+ *
+ * resample.c against ideal sines, every quality preset, up and down
+ * between 44.1 and 48 kHz and from 37.8 kHz, a rate OpenSL has no constant
+ * for. Checks the output frequency and amplitude of a 1 kHz tone, the
+ * passband ripple up to each preset's edge, that the output is in phase
+ * with the input, that resampler_delay matches the input measured as held
+ * back, and that input split into uneven blocks gives the same output as
+ * one block.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resample.h"
+
+#define CHANNELS    2
+#define AMPLITUDE   (0.5 * 32767)
+#define TONE        1000.0
+
+typedef struct {
+    double edge;        /* passband checked, fraction of the lower rate */
+    double ripple_db;   /* max - min gain in it */
+} preset_t;
+
+static const preset_t g_presets[] = {
+        {0.20, 0.10},   /* fast */
+        {0.30, 0.05},
+        {0.40, 0.20},
+        {0.40, 0.02},   /* best */
+};
+
+static const char *g_names[] = {"fast", "medium", "high", "best"};
+
+/* left the tone, right inverted, 1 s */
+static int16_t *sine(int rate, double f, int frames) {
+    int16_t *in = malloc(frames * CHANNELS * sizeof(int16_t));
+    for (int i = 0; i < frames; i++) {
+        in[2 * i] = (int16_t) lrint(AMPLITUDE * sin(2 * M_PI * f * i / rate));
+        in[2 * i + 1] = (int16_t) -in[2 * i];
+    }
+    return in;
+}
+
+/*
+ * gain and phase of the f component of the middle half of the left
+ * channel; delay_us is how far the output lags an ideal sine sampled at
+ * the output rate
+ */
+static void fit(const int16_t *out, int n, double f, int rate, double *gain_db,
+                double *delay_us) {
+    double i = 0, q = 0;
+    for (int k = n / 4; k < n * 3 / 4; k++) {
+        double t = 2 * M_PI * f * k / rate;
+        i += out[k * CHANNELS] * sin(t);
+        q += out[k * CHANNELS] * cos(t);
+    }
+    double amp = 2 * sqrt(i * i + q * q) / (n * 3 / 4 - n / 4);
+    *gain_db = 20 * log10(amp / AMPLITUDE);
+    *delay_us = -atan2(q, i) / (2 * M_PI * f) * 1e6;
+}
+
+/* from rising zero crossings of the left channel, past the filter's start */
+static double frequency(const int16_t *out, int n, int rate) {
+    double first = -1, last = 0;
+    int crossings = 0;
+    for (int k = n / 8; k < n - 1; k++) {
+        int a = out[k * CHANNELS], b = out[(k + 1) * CHANNELS];
+        if (a < 0 && b >= 0) {
+            last = k + (double) -a / (b - a);
+            if (first < 0)
+                first = last;
+            crossings++;
+        }
+    }
+    return (crossings > 1) ? (crossings - 1) * rate / (last - first) : 0;
+}
+
+static int check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    return ok ? 0 : 1;
+}
+
+static int run(int q, int in_rate, int out_rate) {
+    char what[128];
+    int failed = 0;
+    int frames = in_rate;
+    int lower = (in_rate < out_rate) ? in_rate : out_rate;
+    resampler_t *r = resampler_create(CHANNELS, in_rate, out_rate, q);
+    if (!r)
+        return check(0, "resampler_create");
+    int16_t *out = malloc(resampler_max_out(r, frames) * CHANNELS * sizeof(int16_t));
+    int16_t *split = malloc(resampler_max_out(r, frames) * CHANNELS * sizeof(int16_t));
+
+    /* the 1 kHz tone in one block */
+    int16_t *in = sine(in_rate, TONE, frames);
+    int n = resampler_process(r, in, frames, out);
+    double gain, delay;
+    fit(out, n, TONE, out_rate, &gain, &delay);
+    double f = frequency(out, n, out_rate);
+    /* input consumed minus output produced, both in us of the stream */
+    double held = (double) frames * 1e6 / in_rate - (double) n * 1e6 / out_rate;
+    int reported = resampler_delay(r);
+    printf("%-6s %5d -> %5d: %d frames, %.3f Hz, %+.4f dB, phase %+.2f us, "
+           "held %.1f us, delay %d us\n", g_names[q], in_rate, out_rate, n, f, gain, delay,
+           held, reported);
+
+    snprintf(what, sizeof(what), "%s %d -> %d frame count", g_names[q], in_rate, out_rate);
+    /* short by the look-ahead, half of at most 64 taps */
+    failed += check(abs(n - (int) ((int64_t) frames * out_rate / in_rate)) <= 40, what);
+    snprintf(what, sizeof(what), "%s %d -> %d tone frequency", g_names[q], in_rate, out_rate);
+    failed += check(fabs(f - TONE) < TONE * 1e-4, what);
+    snprintf(what, sizeof(what), "%s %d -> %d tone amplitude", g_names[q], in_rate, out_rate);
+    failed += check(fabs(gain) < 0.02, what);
+    snprintf(what, sizeof(what), "%s %d -> %d in phase with the input", g_names[q], in_rate,
+             out_rate);
+    failed += check(fabs(delay) < 2, what);
+    /* delay is whole input frames, the output ends on a whole output frame */
+    snprintf(what, sizeof(what), "%s %d -> %d delay is the input held back", g_names[q],
+             in_rate, out_rate);
+    failed += check(fabs(reported - held) <= 1e6 / in_rate + 1e6 / out_rate, what);
+
+    /* the same input in uneven blocks */
+    resampler_reset(r);
+    int pos = 0, m = 0, step = 317;
+    while (pos < frames) {
+        int k = (frames - pos < step) ? frames - pos : step;
+        m += resampler_process(r, in + pos * CHANNELS, k, split + m * CHANNELS);
+        pos += k;
+        step = step * 7 % 1013 + 1;
+    }
+    snprintf(what, sizeof(what), "%s %d -> %d split input matches one block", g_names[q],
+             in_rate, out_rate);
+    failed += check(m == n && memcmp(out, split, n * CHANNELS * sizeof(int16_t)) == 0, what);
+    free(in);
+
+    /* passband: tones from 100 Hz to the preset's edge */
+    double lo = 0, hi = -100;
+    for (int i = 0; i <= 8; i++) {
+        double tone = 100 + (g_presets[q].edge * lower - 100) * i / 8;
+        resampler_reset(r);
+        in = sine(in_rate, tone, frames);
+        n = resampler_process(r, in, frames, out);
+        fit(out, n, tone, out_rate, &gain, &delay);
+        lo = (i == 0 || gain < lo) ? gain : lo;
+        hi = (gain > hi) ? gain : hi;
+        free(in);
+    }
+    snprintf(what, sizeof(what), "%s %d -> %d ripple %.3f dB up to %.0f Hz", g_names[q],
+             in_rate, out_rate, hi - lo, g_presets[q].edge * lower);
+    failed += check(hi - lo <= g_presets[q].ripple_db, what);
+
+    free(out);
+    free(split);
+    resampler_destroy(r);
+    return failed;
+}
+
+int main(void) {
+    static const int rates[][2] = {{44100, 48000}, {48000, 44100}, {37800, 48000}};
+    int failed = 0;
+    for (int q = RESAMPLE_FAST; q <= RESAMPLE_BEST; q++)
+        for (unsigned k = 0; k < sizeof(rates) / sizeof(rates[0]); k++)
+            failed += run(q, rates[k][0], rates[k][1]);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * test_sample_conv.c
+ *
+ * sample_conv.c as built, with the NEON or SSE2 kernels, against a second
+ * copy built with SAMPLE_CONV_NO_SIMD, where everything goes through the
+ * scalar tails; the copy's entry points are renamed ref_*. Every source
+ * and destination format pair, interleaved and planar, with and without
+ * dither, channel counts and block lengths that leave tails, over several
+ * calls: output and dither state must match to the bit. Then clipping at
+ * and past +-1.0 and at s32 full scale, and s24 sign extension.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample_conv.h"
+
+int ref_sample_conv_init(sample_conv_t *c, int src_fmt, int src_planar, int dst_fmt,
+                         int channels, int dither);
+
+void ref_sample_conv_run(sample_conv_t *c, void *dst, const void *const *src, int frames);
+
+#define MAX_FRAMES  1100    /* past four conversion blocks */
+#define CALLS       3
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNEL "neon"
+#elif defined(__SSE2__)
+#define KERNEL "sse2"
+#else
+#define KERNEL "c, the comparison is trivial"
+#endif
+
+static const char *g_names[] = {"s16", "s24", "s32", "flt"};
+
+static uint8_t g_src[SAMPLE_CONV_MAX_CHANNELS][MAX_FRAMES * SAMPLE_CONV_MAX_CHANNELS * 4];
+static uint8_t g_out[MAX_FRAMES * SAMPLE_CONV_MAX_CHANNELS * 4];
+static uint8_t g_ref[MAX_FRAMES * SAMPLE_CONV_MAX_CHANNELS * 4];
+
+/* any bytes are valid integers; floats mostly in range, some clipped */
+static void fill(int fmt, uint8_t *p, int samples) {
+    if (fmt == SAMPLE_FLT) {
+        float *f = (float *) p;
+        for (int i = 0; i < samples; i++)
+            f[i] = (float) rand() / RAND_MAX * 2.4f - 1.2f;
+        f[0] = 1.0f;
+        if (samples > 1)
+            f[1] = -1.0f;
+        return;
+    }
+    for (int i = 0; i < samples * sample_bytes(fmt); i++)
+        p[i] = (uint8_t) rand();
+}
+
+static int check(int ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    return ok ? 0 : 1;
+}
+
+/* vector against scalar for one pair, every call and the dither state */
+static int compare(int src_fmt, int planar, int dst_fmt, int dither) {
+    static const int channels[] = {1, 2, 3, 6, 8};
+    static const int frames[] = {1, 7, 13, 256, 1021, MAX_FRAMES};
+    int mismatches = 0;
+    for (unsigned c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+        int ch = channels[c];
+        sample_conv_t vec, ref;
+        sample_conv_init(&vec, src_fmt, planar, dst_fmt, ch, dither);
+        ref_sample_conv_init(&ref, src_fmt, planar, dst_fmt, ch, dither);
+        for (int call = 0; call < CALLS; call++) {
+            int n = frames[(c + call) % (sizeof(frames) / sizeof(frames[0]))];
+            const void *src[SAMPLE_CONV_MAX_CHANNELS];
+            for (int i = 0; i < ch; i++) {
+                fill(src_fmt, g_src[i], planar ? n : n * ch);
+                src[i] = g_src[i];
+            }
+            int bytes = n * ch * sample_bytes(dst_fmt);
+            memset(g_out, 0xaa, bytes + 16);
+            memset(g_ref, 0x55, bytes + 16);
+            sample_conv_run(&vec, g_out, src, n);
+            ref_sample_conv_run(&ref, g_ref, src, n);
+            if (memcmp(g_out, g_ref, bytes) || memcmp(vec.seed, ref.seed, sizeof(vec.seed))
+                || g_out[bytes] != 0xaa) {
+                if (!mismatches)
+                    printf("     %s%s -> %s%s, %d channels, %d frames, call %d differs\n",
+                           g_names[src_fmt], planar ? " planar" : "", g_names[dst_fmt],
+                           dither ? " dither" : "", ch, n, call);
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+/* one sample of src_fmt through the vector path */
+static void convert1(int src_fmt, const void *in, int dst_fmt, void *out) {
+    sample_conv_t c;
+    const void *src[1] = {in};
+    sample_conv_init(&c, src_fmt, 1, dst_fmt, 1, 0);
+    sample_conv_run(&c, out, src, 1);
+}
+
+/*
+ * 8 samples at once so the vector kernels see them, not only the tails;
+ * planar keeps s32 -> s32 from being a memcpy
+ */
+static int clips(void) {
+    int failed = 0;
+    float f[8] = {1.0f, -1.0f, 1.5f, -1.5f, 1e9f, -1e9f, 0.999999f, 0.0f};
+    const void *src[1] = {f};
+    int16_t s16[8];
+    int32_t s32[8];
+    sample_conv_t c;
+
+    sample_conv_init(&c, SAMPLE_FLT, 1, SAMPLE_S16, 1, 0);
+    sample_conv_run(&c, s16, src, 8);
+    failed += check(s16[0] == 32767 && s16[1] == -32768 && s16[2] == 32767 && s16[3] == -32768
+                    && s16[4] == 32767 && s16[5] == -32768 && s16[6] == 32767 && s16[7] == 0,
+                    "float to s16 clips at and past +-1.0");
+    sample_conv_init(&c, SAMPLE_FLT, 1, SAMPLE_S16, 1, 1);
+    sample_conv_run(&c, s16, src, 8);
+    failed += check(s16[0] >= 32766 && s16[1] <= -32767 && s16[4] == 32767 && s16[5] == -32768,
+                    "dither does not wrap at +-1.0");
+
+    /* float holds no value between 2^31 - 128 and 2^31 */
+    sample_conv_init(&c, SAMPLE_FLT, 1, SAMPLE_S32, 1, 0);
+    sample_conv_run(&c, s32, src, 8);
+    failed += check(s32[0] == 2147483520 && s32[1] == INT_MIN && s32[2] == 2147483520
+                    && s32[3] == INT_MIN && s32[4] == 2147483520 && s32[5] == INT_MIN,
+                    "float to s32 clips at and past +-1.0 without wrapping");
+
+    int32_t full[8] = {INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1, 65535, -65536, 0, -1};
+    src[0] = full;
+    sample_conv_init(&c, SAMPLE_S32, 1, SAMPLE_S32, 1, 0);
+    sample_conv_run(&c, s32, src, 8);
+    failed += check(s32[0] == 2147483520 && s32[1] == INT_MIN && s32[2] == 2147483520
+                    && s32[3] == INT_MIN, "s32 full scale through float does not wrap");
+    sample_conv_init(&c, SAMPLE_S32, 1, SAMPLE_S16, 1, 0);
+    sample_conv_run(&c, s16, src, 8);
+    failed += check(s16[0] == 32767 && s16[1] == -32768 && s16[2] == 32767 && s16[3] == -32768
+                    && s16[4] == 1 && s16[5] == -1 && s16[6] == 0 && s16[7] == 0,
+                    "s32 full scale to s16");
+    float back[8];
+    sample_conv_init(&c, SAMPLE_S32, 1, SAMPLE_FLT, 1, 0);
+    sample_conv_run(&c, back, src, 8);
+    failed += check(back[0] == 1.0f && back[1] == -1.0f, "s32 full scale to float is +-1.0");
+    return failed;
+}
+
+static int s24(void) {
+    int failed = 0;
+    /* little endian: -8388608, -1, 8388607, 1 */
+    static const uint8_t in[][3] = {{0x00, 0x00, 0x80}, {0xff, 0xff, 0xff},
+                                    {0xff, 0xff, 0x7f}, {0x01, 0x00, 0x00}};
+    float f[4];
+    int16_t s16[4];
+    int32_t s32[4];
+    for (int i = 0; i < 4; i++) {
+        convert1(SAMPLE_S24, in[i], SAMPLE_FLT, &f[i]);
+        convert1(SAMPLE_S24, in[i], SAMPLE_S16, &s16[i]);
+        convert1(SAMPLE_S24, in[i], SAMPLE_S32, &s32[i]);
+    }
+    failed += check(f[0] == -1.0f && f[1] == -1.0f / 8388608 && f[2] == 8388607.0f / 8388608
+                    && f[3] == 1.0f / 8388608, "s24 to float sign extends");
+    failed += check(s16[0] == -32768 && s16[1] == 0 && s16[2] == 32767 && s16[3] == 0,
+                    "s24 to s16 sign extends");
+    failed += check(s32[0] == INT_MIN && s32[1] == -256 && s32[2] == 8388607 * 256
+                    && s32[3] == 256, "s24 to s32 sign extends");
+
+    int16_t neg[2] = {-1, -32768};
+    uint8_t out[6];
+    const void *src[1] = {neg};
+    sample_conv_t c;
+    sample_conv_init(&c, SAMPLE_S16, 1, SAMPLE_S24, 1, 0);
+    sample_conv_run(&c, out, src, 2);
+    failed += check(out[0] == 0x00 && out[1] == 0xff && out[2] == 0xff
+                    && out[3] == 0x00 && out[4] == 0x00 && out[5] == 0x80,
+                    "negative s16 to s24 keeps the sign byte");
+    return failed;
+}
+
+int main(void) {
+    int failed = 0;
+    srand(1);
+    printf("kernel %s\n", KERNEL);
+    for (int src_fmt = SAMPLE_S16; src_fmt <= SAMPLE_FLT; src_fmt++) {
+        for (int dst_fmt = SAMPLE_S16; dst_fmt <= SAMPLE_FLT; dst_fmt++) {
+            int mismatches = 0;
+            for (int planar = 0; planar <= 1; planar++)
+                for (int dither = 0; dither <= 1; dither++)
+                    mismatches += compare(src_fmt, planar, dst_fmt, dither);
+            char what[64];
+            snprintf(what, sizeof(what), "%s -> %s vector matches scalar", g_names[src_fmt],
+                     g_names[dst_fmt]);
+            failed += check(mismatches == 0, what);
+        }
+    }
+    failed += clips();
+    failed += s24();
+    return failed ? 1 : 0;
+}
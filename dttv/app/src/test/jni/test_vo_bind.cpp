@@ -0,0 +1,83 @@
+//
+// test_vo_bind - two players starting at once must not swap outputs, and
+// neither start may wait for the other's vo.
+//
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "vo_bind.h"
+#include "native_atomic.h"
+
+static vo_bind_t g_bind = VO_BIND_INITIALIZER;
+static int g_outputs[3];
+static vo_bind_req_t g_reqs[3];
+static int g_started[3];        // start calls, 2 when queued
+static int g_fail[3];
+
+static int start_player(void *opaque, int queued) {
+    int i = (int *) opaque - g_outputs;
+    dt_atomic_store(&g_started[i], queued ? 2 : 1);
+    return g_fail[i] ? -1 : 0;
+}
+
+static int start(int i) {
+    g_reqs[i].output = &g_outputs[i];
+    g_reqs[i].start = start_player;
+    g_reqs[i].opaque = &g_outputs[i];
+    g_started[i] = 0;
+    return vo_bind_start(&g_bind, &g_reqs[i]);
+}
+
+// the bind thread runs a queued start soon after the way is clear
+static int started(int i) {
+    for (int n = 0; n < 100 && !dt_atomic_load(&g_started[i]); n++) {
+        usleep(1000);
+    }
+    return dt_atomic_load(&g_started[i]);
+}
+
+static int check(const char *what, int ok) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    return ok;
+}
+
+int main(void) {
+    int ok = 1;
+
+    // a starts right away, b is queued until a's vo took the binding
+    ok &= check("first start runs on the caller", start(0) == 0 && g_started[0] == 1);
+    ok &= check("second start returns at once", start(1) == 0);
+    usleep(50000);
+    ok &= check("second start waits for the first vo", !dt_atomic_load(&g_started[1]));
+    ok &= check("first vo gets the first output", vo_bind_take(&g_bind) == &g_outputs[0]);
+    ok &= check("second start runs on the bind thread once it is taken", started(1) == 2);
+    ok &= check("second vo gets the second output", vo_bind_take(&g_bind) == &g_outputs[1]);
+    ok &= check("nothing left for a third vo", vo_bind_take(&g_bind) == NULL);
+
+    // a failed start lets the next one go right away
+    g_fail[0] = 1;
+    ok &= check("failed start reports it", start(0) < 0);
+    g_fail[0] = 0;
+    ok &= check("next start after a failure runs now", start(1) == 0 && g_started[1] == 1);
+    ok &= check("failed output never reaches a vo", vo_bind_take(&g_bind) == &g_outputs[1]);
+
+    // withdraw releases the next start, or drops a queued one
+    start(0);
+    start(1);
+    start(2);
+    vo_bind_withdraw(&g_bind, &g_outputs[1]);
+    vo_bind_withdraw(&g_bind, &g_outputs[0]);
+    ok &= check("withdraw releases the next start", started(2) == 2);
+    ok &= check("withdrawn queued start never runs", !dt_atomic_load(&g_started[1]));
+    ok &= check("next vo gets the output after the withdrawn ones",
+                vo_bind_take(&g_bind) == &g_outputs[2]);
+
+    // a vo that never comes up only holds the next start for the timeout
+    start(0);
+    start(1);
+    usleep((VO_BIND_TIMEOUT_MS + 100) * 1000);
+    ok &= check("timeout drops a stale binding", dt_atomic_load(&g_started[1]) == 2 &&
+                                                 vo_bind_take(&g_bind) == &g_outputs[1]);
+    return ok ? 0 : 1;
+}